@@ -47,10 +47,14 @@
 #include <rpc/auth_gss.h>
 #include <rpc/rpcsec_gss.h>
 #include <rpc/clnt.h>
+#include <rpc/rpc.h>
 #include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/time.h>
 #include <reentrant.h>
 
 #include "debug.h"
+#include "rpc_com.h"
 
 static void	authgss_nextverf(AUTH *);
 static bool_t	authgss_marshal(AUTH *, XDR *);
@@ -136,6 +140,61 @@ char *p;
 }
 
 extern pthread_mutex_t		 auth_ref_lock;
+extern pthread_mutex_t		 authgss_cache_lock;
+
+/*
+ * Established contexts are kept in a process-wide cache, so that a new
+ * AUTH for the same server, program, principal, mechanism and security
+ * parameters, under the same effective uid and default credentials,
+ * takes one over instead of negotiating.  The shared part -- the GSS
+ * context, the handle the server knows it by, the window and the
+ * sequence numbers -- is counted, and goes with its last user; the
+ * cache holds a reference until the context expires or fails.  GSS
+ * contexts are not safe for concurrent use, so every per-message call
+ * on a shared one holds its sc_ctxlock.  A call
+ * the server turns away with RPCSEC_GSS_CREDPROBLEM or _CTXPROBLEM
+ * marks the context lost: it leaves the cache at once, and each AUTH
+ * still using it negotiates a new one on its next refresh.
+ */
+#define AUTHGSS_CACHE_SLACK	60	/* don't hand out contexts this close
+					 * to expiry (seconds) */
+#define AUTHGSS_CACHE_MAXMECH	32	/* longest mechanism OID cached */
+
+struct authgss_key {
+	struct sockaddr_storage	 addr;		/* server address */
+	u_int			 addrlen;
+	u_int32_t		 prog;
+	uid_t			 uid;
+	char			*principal;	/* target's display name */
+	u_char			 mech[AUTHGSS_CACHE_MAXMECH];
+	u_int			 mechlen;
+	OM_uint32		 req_flags;
+	rpc_gss_svc_t		 svc;
+	gss_qop_t		 qop;
+};
+
+struct authgss_ctx {
+	struct authgss_ctx	*sc_next;	/* cache chain */
+	int			 sc_refcnt;	/* under auth_ref_lock */
+	bool_t			 sc_cached;	/* under authgss_cache_lock */
+	struct authgss_key	 sc_key;
+	time_t			 sc_expires;	/* 0 if never */
+	gss_ctx_id_t		 sc_ctx;	/* context id */
+	gss_buffer_desc		 sc_handle;	/* server's context handle */
+	gss_OID			 sc_mech;	/* actual mechanism */
+	OM_uint32		 sc_flags;	/* init_sec_context ret_flags */
+	u_int			 sc_win;	/* sequence window */
+	mutex_t			 sc_ctxlock;	/* held over per-message calls
+						 * on sc_ctx */
+	mutex_t			 sc_seqlock;	/* protects sc_seq, sc_inflight */
+	cond_t			 sc_seqcond;	/* signalled as calls finish */
+	u_int			 sc_seq;	/* last sequence number */
+	u_int			 sc_inflight;	/* calls holding a number */
+	bool_t			 sc_lost;	/* the server has dropped it
+						 * (under sc_seqlock) */
+};
+
+static struct authgss_ctx	*authgss_cache = NULL;
 
 struct rpc_gss_data {
 	bool_t			 established;	/* context established */
@@ -147,6 +206,8 @@ struct rpc_gss_data {
 	gss_ctx_id_t		 ctx;		/* context id */
 	struct rpc_gss_cred	 gc;		/* client credentials */
 	u_int			 win;		/* sequence window */
+	struct authgss_ctx	*sc;		/* established context */
+	bool_t			 nocache;	/* don't share the context */
 	int			 time_req;	/* init_sec_context time_req */
 	gss_channel_bindings_t	 icb;		/* input channel bindings */
 	int			 refcnt;	/* reference count gss AUTHs */
@@ -178,6 +239,361 @@ authgss_auth_put(AUTH *auth)
 	return refcnt;
 }
 
+static void
+authgss_ctx_get(struct authgss_ctx *sc)
+{
+	mutex_lock(&auth_ref_lock);
+	++sc->sc_refcnt;
+	mutex_unlock(&auth_ref_lock);
+}
+
+static void
+authgss_ctx_put(struct authgss_ctx *sc)
+{
+	OM_uint32	min_stat;
+	int		refcnt;
+
+	mutex_lock(&auth_ref_lock);
+	refcnt = --sc->sc_refcnt;
+	mutex_unlock(&auth_ref_lock);
+	if (refcnt > 0)
+		return;
+
+	if (sc->sc_ctx != GSS_C_NO_CONTEXT)
+		gss_delete_sec_context(&min_stat, &sc->sc_ctx, NULL);
+	gss_release_buffer(&min_stat, &sc->sc_handle);
+	free(sc->sc_key.principal);
+	mutex_destroy(&sc->sc_ctxlock);
+	mutex_destroy(&sc->sc_seqlock);
+	cond_destroy(&sc->sc_seqcond);
+	free(sc);
+}
+
+/* Takes sc out of the cache, if it is there. */
+static void
+authgss_cache_drop(struct authgss_ctx *sc)
+{
+	struct authgss_ctx	**scp;
+	bool_t			 cached = FALSE;
+
+	mutex_lock(&authgss_cache_lock);
+	if (sc->sc_cached) {
+		for (scp = &authgss_cache; *scp != sc; scp = &(*scp)->sc_next)
+			continue;
+		*scp = sc->sc_next;
+		sc->sc_cached = FALSE;
+		cached = TRUE;
+	}
+	mutex_unlock(&authgss_cache_lock);
+	if (cached)
+		authgss_ctx_put(sc);
+}
+
+/*
+ * Fills in the cache key for gd's target.  FALSE if gd's context
+ * must not be shared, or the target can't be told apart.
+ */
+static bool_t
+authgss_cache_key(struct rpc_gss_data *gd, struct authgss_key *key)
+{
+	struct netbuf		 nb;
+	gss_buffer_desc		 dname;
+	OM_uint32		 maj_stat, min_stat;
+
+	if (gd->nocache || gd->sec.cred != GSS_C_NO_CREDENTIAL ||
+	    gd->icb != GSS_C_NO_CHANNEL_BINDINGS || gd->name == GSS_C_NO_NAME)
+		return (FALSE);
+
+	memset(key, 0, sizeof(*key));
+	memset(&nb, 0, sizeof(nb));
+	if (!clnt_control(gd->clnt, CLGET_SVC_ADDR, (char *)&nb) ||
+	    nb.len == 0 || nb.len > sizeof(key->addr) ||
+	    !clnt_control(gd->clnt, CLGET_PROG, (char *)&key->prog))
+		return (FALSE);
+	memcpy(&key->addr, nb.buf, nb.len);
+	key->addrlen = nb.len;
+
+	if (gd->sec.mech != GSS_C_NO_OID) {
+		if (gd->sec.mech->length > sizeof(key->mech))
+			return (FALSE);
+		memcpy(key->mech, gd->sec.mech->elements,
+		       gd->sec.mech->length);
+		key->mechlen = gd->sec.mech->length;
+	}
+
+	maj_stat = gss_display_name(&min_stat, gd->name, &dname, NULL);
+	if (maj_stat != GSS_S_COMPLETE)
+		return (FALSE);
+	key->principal = strndup(dname.value, dname.length);
+	gss_release_buffer(&min_stat, &dname);
+	if (key->principal == NULL)
+		return (FALSE);
+
+	key->uid = geteuid();
+	key->req_flags = gd->sec.req_flags;
+	key->svc = gd->sec.svc;
+	key->qop = gd->sec.qop;
+	return (TRUE);
+}
+
+static bool_t
+authgss_key_equal(struct authgss_key *a, struct authgss_key *b)
+{
+	return (a->addrlen == b->addrlen &&
+		memcmp(&a->addr, &b->addr, a->addrlen) == 0 &&
+		a->prog == b->prog && a->uid == b->uid &&
+		a->mechlen == b->mechlen &&
+		memcmp(a->mech, b->mech, a->mechlen) == 0 &&
+		a->req_flags == b->req_flags &&
+		a->svc == b->svc && a->qop == b->qop &&
+		strcmp(a->principal, b->principal) == 0);
+}
+
+/*
+ * Returns a referenced context for key, dropping expired ones on the
+ * way, or NULL.
+ */
+static struct authgss_ctx *
+authgss_cache_lookup(struct authgss_key *key)
+{
+	struct authgss_ctx	**scp, *sc, *expired = NULL;
+	time_t			 now = time(NULL);
+
+	mutex_lock(&authgss_cache_lock);
+	for (scp = &authgss_cache; (sc = *scp) != NULL; ) {
+		if (sc->sc_expires != 0 &&
+		    sc->sc_expires <= now + AUTHGSS_CACHE_SLACK) {
+			*scp = sc->sc_next;
+			sc->sc_cached = FALSE;
+			sc->sc_next = expired;
+			expired = sc;
+			continue;
+		}
+		if (authgss_key_equal(&sc->sc_key, key)) {
+			authgss_ctx_get(sc);
+			break;
+		}
+		scp = &sc->sc_next;
+	}
+	mutex_unlock(&authgss_cache_lock);
+
+	while (expired != NULL) {
+		struct authgss_ctx *next = expired->sc_next;
+
+		authgss_ctx_put(expired);
+		expired = next;
+	}
+	return (sc);
+}
+
+static void
+authgss_cache_enter(struct authgss_ctx *sc)
+{
+	authgss_ctx_get(sc);
+	mutex_lock(&authgss_cache_lock);
+	sc->sc_next = authgss_cache;
+	sc->sc_cached = TRUE;
+	authgss_cache = sc;
+	mutex_unlock(&authgss_cache_lock);
+}
+
+/* Makes gd a user of the established context sc. */
+static void
+authgss_ctx_use(struct rpc_gss_data *gd, struct authgss_ctx *sc)
+{
+	gd->sc = sc;
+	gd->ctx = sc->sc_ctx;
+	gd->gc.gc_ctx = sc->sc_handle;
+	gd->win = sc->sc_win;
+	gd->gc.gc_proc = RPCSEC_GSS_DATA;
+	gd->established = TRUE;
+}
+
+/*
+ * The lock per-message calls on gd->ctx hold, or NULL while gd is
+ * negotiating a context nobody else uses.
+ */
+static mutex_t *
+authgss_ctx_lock(struct rpc_gss_data *gd)
+{
+	if (!gd->established || gd->sc == NULL)
+		return (NULL);
+	return (&gd->sc->sc_ctxlock);
+}
+
+static mutex_t *
+authgss_ctx_enter(struct rpc_gss_data *gd)
+{
+	mutex_t	*lock = authgss_ctx_lock(gd);
+
+	if (lock != NULL)
+		mutex_lock(lock);
+	return (lock);
+}
+
+static void
+authgss_ctx_leave(mutex_t *lock)
+{
+	if (lock != NULL)
+		mutex_unlock(lock);
+}
+
+/* Gives up gd's hold on its established context. */
+static void
+authgss_ctx_unuse(struct rpc_gss_data *gd)
+{
+	struct authgss_ctx	*sc = gd->sc;
+
+	gd->sc = NULL;
+	gd->ctx = GSS_C_NO_CONTEXT;
+	memset(&gd->gc.gc_ctx, 0, sizeof(gd->gc.gc_ctx));
+	authgss_ctx_put(sc);
+}
+
+/*
+ * The sequence number the calling thread's current call went out
+ * with, so that its reply is checked against that number however
+ * many threads and AUTHs share the context.  A held number counts
+ * against the server's window, and keeps a reference on the context,
+ * until the call is over: the client transports report that with
+ * __authgss_call_done() however the call ended.
+ */
+struct authgss_call {
+	AUTH			*ac_auth;	/* compared, not referenced */
+	struct authgss_ctx	*ac_sc;
+	u_int			 ac_seq;
+};
+
+extern thread_key_t		 authgss_call_key;
+extern mutex_t			 tsd_lock;
+
+static void
+authgss_call_end(struct authgss_call *ac)
+{
+	struct authgss_ctx	*sc = ac->ac_sc;
+
+	ac->ac_auth = NULL;
+	ac->ac_sc = NULL;
+	if (sc == NULL)
+		return;
+
+	mutex_lock(&sc->sc_seqlock);
+	sc->sc_inflight--;
+	cond_signal(&sc->sc_seqcond);
+	mutex_unlock(&sc->sc_seqlock);
+	authgss_ctx_put(sc);
+}
+
+static void
+authgss_call_free(void *p)
+{
+	authgss_call_end((struct authgss_call *)p);
+	free(p);
+}
+
+static struct authgss_call *
+authgss_call(bool_t create)
+{
+	struct authgss_call	*ac;
+
+	if (authgss_call_key == KEY_INITIALIZER) {
+		if (!create)
+			return (NULL);
+		mutex_lock(&tsd_lock);
+		if (authgss_call_key == KEY_INITIALIZER)
+			thr_keycreate(&authgss_call_key, authgss_call_free);
+		mutex_unlock(&tsd_lock);
+	}
+	ac = (struct authgss_call *)thr_getspecific(authgss_call_key);
+	if (ac == NULL && create) {
+		if ((ac = calloc(1, sizeof (*ac))) == NULL)
+			return (NULL);
+		thr_setspecific(authgss_call_key, ac);
+	}
+	return (ac);
+}
+
+/* Sequence number of the calling thread's call on auth. */
+static u_int
+authgss_call_seq(AUTH *auth)
+{
+	struct authgss_call	*ac;
+
+	ac = authgss_call(FALSE);
+	if (ac != NULL && ac->ac_auth == auth)
+		return (ac->ac_seq);
+	return (AUTH_PRIVATE(auth)->gc.gc_seq);
+}
+
+/*
+ * Takes the next sequence number for a call, waiting while the
+ * server's window is full of calls still in flight, but for no
+ * longer than AUTH_TIMEOUT.
+ */
+static bool_t
+authgss_call_begin(AUTH *auth, u_int *seqp)
+{
+	struct authgss_ctx	*sc = AUTH_PRIVATE(auth)->sc;
+	struct authgss_call	*ac;
+	struct timeval		 now;
+	struct timespec		 deadline;
+
+	if (sc == NULL || (ac = authgss_call(TRUE)) == NULL)
+		return (FALSE);
+	authgss_call_end(ac);
+
+	mutex_lock(&sc->sc_seqlock);
+	if (sc->sc_inflight >= sc->sc_win && sc->sc_win > 0) {
+		gettimeofday(&now, NULL);
+		deadline.tv_sec = now.tv_sec + AUTH_TIMEOUT.tv_sec;
+		deadline.tv_nsec = now.tv_usec * 1000;
+		while (sc->sc_inflight >= sc->sc_win &&
+		       pthread_cond_timedwait(&sc->sc_seqcond, &sc->sc_seqlock,
+					      &deadline) == 0)
+			continue;
+	}
+	sc->sc_inflight++;
+	*seqp = ++sc->sc_seq;
+	mutex_unlock(&sc->sc_seqlock);
+
+	authgss_ctx_get(sc);
+	ac->ac_auth = auth;
+	ac->ac_sc = sc;
+	ac->ac_seq = *seqp;
+	return (TRUE);
+}
+
+/* TRUE if err says the server no longer knows the context. */
+static bool_t
+authgss_lost(enum auth_stat why)
+{
+	return (why == RPCSEC_GSS_CREDPROBLEM || why == RPCSEC_GSS_CTXPROBLEM);
+}
+
+/*
+ * The calling thread is done with its call on auth, whether it got a
+ * reply or not.  errp, if not NULL, says how the call went.
+ */
+void
+__authgss_call_done(AUTH *auth, struct rpc_err *errp)
+{
+	struct authgss_call	*ac;
+	struct authgss_ctx	*sc;
+
+	ac = authgss_call(FALSE);
+	if (ac == NULL || ac->ac_auth != auth)
+		return;
+	sc = ac->ac_sc;
+	if (sc != NULL && errp != NULL && errp->re_status == RPC_AUTHERROR &&
+	    authgss_lost(errp->re_why)) {
+		mutex_lock(&sc->sc_seqlock);
+		sc->sc_lost = TRUE;
+		mutex_unlock(&sc->sc_seqlock);
+		authgss_cache_drop(sc);
+	}
+	authgss_call_end(ac);
+}
+
 AUTH *
 authgss_create(CLIENT *clnt, gss_name_t name, struct rpc_gss_sec *sec)
 {
@@ -229,10 +645,11 @@ authgss_create(CLIENT *clnt, gss_name_t name, struct rpc_gss_sec *sec)
 	save_auth = clnt->cl_auth;
 	clnt->cl_auth = auth;
 
-	if (!authgss_refresh(auth, NULL))
+	authgss_auth_get(auth); /* Reference for caller */
+	if (!authgss_refresh(auth, NULL)) {
+		authgss_destroy(auth);
 		auth = NULL;
-	else
-		authgss_auth_get(auth); /* Reference for caller */
+	}
 
 	clnt->cl_auth = save_auth;
 
@@ -278,6 +695,8 @@ bool_t
 authgss_get_private_data(AUTH *auth, struct authgss_private_data *pd)
 {
 	struct rpc_gss_data	*gd;
+	struct authgss_ctx	*sc;
+	bool_t			 shared;
 
 	gss_log_debug("in authgss_get_private_data()");
 
@@ -286,12 +705,30 @@ authgss_get_private_data(AUTH *auth, struct authgss_private_data *pd)
 
 	gd = AUTH_PRIVATE(auth);
 
-	if (!gd || !gd->established)
+	if (!gd || !gd->established || gd->sc == NULL)
 		return (FALSE);
 
-	pd->pd_ctx = gd->ctx;
-	pd->pd_ctx_hndl = gd->gc.gc_ctx;
-	pd->pd_seq_win = gd->win;
+	/*
+	 * The context is handed over, so nobody else may hold it.  If
+	 * another AUTH shares it, negotiate one of our own to give away.
+	 */
+	authgss_cache_drop(gd->sc);
+	mutex_lock(&auth_ref_lock);
+	shared = (gd->sc->sc_refcnt > 1);
+	mutex_unlock(&auth_ref_lock);
+	if (shared) {
+		gd->nocache = TRUE;
+		authgss_ctx_unuse(gd);
+		gd->established = FALSE;
+		gd->gc.gc_proc = RPCSEC_GSS_INIT;
+		if (!authgss_refresh(auth, NULL))
+			return (FALSE);
+	}
+	sc = gd->sc;
+
+	pd->pd_ctx = sc->sc_ctx;
+	pd->pd_ctx_hndl = sc->sc_handle;
+	pd->pd_seq_win = sc->sc_win;
 	/*
 	 * We've given this away -- don't try to use it ourself any more
 	 * Caller should call authgss_free_private_data to free data.
@@ -299,9 +736,9 @@ authgss_get_private_data(AUTH *auth, struct authgss_private_data *pd)
 	 * send an RPCSEC_GSS_DESTROY request which might inappropriately
 	 * destroy the context.
 	 */
-        gd->ctx = GSS_C_NO_CONTEXT;
-	gd->gc.gc_ctx.length = 0;
-	gd->gc.gc_ctx.value = NULL;
+	sc->sc_ctx = GSS_C_NO_CONTEXT;
+	memset(&sc->sc_handle, 0, sizeof(sc->sc_handle));
+	authgss_ctx_unuse(gd);
 
 	return (TRUE);
 }
@@ -337,30 +774,35 @@ authgss_marshal(AUTH *auth, XDR *xdrs)
 	XDR			 tmpxdrs;
 	char			 tmp[MAX_AUTH_BYTES];
 	struct rpc_gss_data	*gd;
+	struct rpc_gss_cred	 gc;
+	struct opaque_auth	 cred, verf;
 	gss_buffer_desc		 rpcbuf, checksum;
 	OM_uint32		 maj_stat, min_stat;
 	bool_t			 xdr_stat;
+	mutex_t			*lock;
 
 	gss_log_debug("in authgss_marshal()");
 
 	gd = AUTH_PRIVATE(auth);
 
-	if (gd->established)
-		gd->gc.gc_seq++;
+	/* Other threads may be marshalling with gd too. */
+	gc = gd->gc;
+	if (gd->established && !authgss_call_begin(auth, &gc.gc_seq))
+		return (FALSE);
 
 	xdrmem_create(&tmpxdrs, tmp, sizeof(tmp), XDR_ENCODE);
 
-	if (!xdr_rpc_gss_cred(&tmpxdrs, &gd->gc)) {
+	if (!xdr_rpc_gss_cred(&tmpxdrs, &gc)) {
 		XDR_DESTROY(&tmpxdrs);
 		return (FALSE);
 	}
-	auth->ah_cred.oa_flavor = RPCSEC_GSS;
-	auth->ah_cred.oa_base = tmp;
-	auth->ah_cred.oa_length = XDR_GETPOS(&tmpxdrs);
+	cred.oa_flavor = RPCSEC_GSS;
+	cred.oa_base = tmp;
+	cred.oa_length = XDR_GETPOS(&tmpxdrs);
 
 	XDR_DESTROY(&tmpxdrs);
 
-	if (!xdr_opaque_auth(xdrs, &auth->ah_cred))
+	if (!xdr_opaque_auth(xdrs, &cred))
 		return (FALSE);
 
 	if (gd->gc.gc_proc == RPCSEC_GSS_INIT ||
@@ -372,8 +814,10 @@ authgss_marshal(AUTH *auth, XDR *xdrs)
 	XDR_SETPOS(xdrs, 0);
 	rpcbuf.value = XDR_INLINE(xdrs, rpcbuf.length);
 
+	lock = authgss_ctx_enter(gd);
 	maj_stat = gss_get_mic(&min_stat, gd->ctx, gd->sec.qop,
 			    &rpcbuf, &checksum);
+	authgss_ctx_leave(lock);
 
 	if (maj_stat != GSS_S_COMPLETE) {
 		gss_log_status("authgss_marshal: gss_get_mic", 
@@ -384,11 +828,11 @@ authgss_marshal(AUTH *auth, XDR *xdrs)
 		}
 		return (FALSE);
 	}
-	auth->ah_verf.oa_flavor = RPCSEC_GSS;
-	auth->ah_verf.oa_base = checksum.value;
-	auth->ah_verf.oa_length = checksum.length;
+	verf.oa_flavor = RPCSEC_GSS;
+	verf.oa_base = checksum.value;
+	verf.oa_length = checksum.length;
 
-	xdr_stat = xdr_opaque_auth(xdrs, &auth->ah_verf);
+	xdr_stat = xdr_opaque_auth(xdrs, &verf);
 	gss_release_buffer(&min_stat, &checksum);
 
 	return (xdr_stat);
@@ -401,6 +845,7 @@ authgss_validate(AUTH *auth, struct opaque_auth *verf)
 	u_int			 num, qop_state;
 	gss_buffer_desc		 signbuf, checksum;
 	OM_uint32		 maj_stat, min_stat;
+	mutex_t			*lock;
 
 	gss_log_debug("in authgss_validate()");
 
@@ -427,7 +872,7 @@ authgss_validate(AUTH *auth, struct opaque_auth *verf)
 	    gd->gc.gc_proc == RPCSEC_GSS_CONTINUE_INIT) {
 		num = htonl(gd->win);
 	}
-	else num = htonl(gd->gc.gc_seq);
+	else num = htonl(authgss_call_seq(auth));
 
 	signbuf.value = &num;
 	signbuf.length = sizeof(num);
@@ -435,8 +880,10 @@ authgss_validate(AUTH *auth, struct opaque_auth *verf)
 	checksum.value = verf->oa_base;
 	checksum.length = verf->oa_length;
 
+	lock = authgss_ctx_enter(gd);
 	maj_stat = gss_verify_mic(&min_stat, gd->ctx, &signbuf,
 				  &checksum, &qop_state);
+	authgss_ctx_leave(lock);
 
 	if (maj_stat != GSS_S_COMPLETE || qop_state != gd->sec.qop) {
 		gss_log_status("authgss_validate: gss_verify_mic", 
@@ -450,8 +897,58 @@ authgss_validate(AUTH *auth, struct opaque_auth *verf)
 	return (TRUE);
 }
 
+static void
+authgss_options_ret(struct rpc_gss_data *gd, rpc_gss_options_ret_t *options_ret)
+{
+	struct authgss_ctx	*sc = gd->sc;
+	char			*mechanism;
+	time_t			 now;
+
+	options_ret->major_status = GSS_S_COMPLETE;
+	options_ret->minor_status = 0;
+	options_ret->rpcsec_version = gd->gc.gc_v;
+	options_ret->ret_flags = sc->sc_flags;
+	now = time(NULL);
+	if (sc->sc_expires == 0)
+		options_ret->time_ret = GSS_C_INDEFINITE;
+	else
+		options_ret->time_ret = sc->sc_expires > now ?
+			sc->sc_expires - now : 0;
+	options_ret->gss_context = sc->sc_ctx;
+	options_ret->actual_mechanism[0] = '\0';
+	if (rpc_gss_oid_to_mech(sc->sc_mech, &mechanism)) {
+		strncpy(options_ret->actual_mechanism,
+			mechanism,
+			(sizeof(options_ret->actual_mechanism)-1));
+	}
+}
+
+/*
+ * TRUE if gd's established context is no longer any good: the server
+ * turned a call with it away (msg is the reply to the call that
+ * prompted the refresh, if any).
+ */
+static bool_t
+authgss_ctx_lost(struct rpc_gss_data *gd, struct rpc_msg *msg)
+{
+	struct authgss_ctx	*sc = gd->sc;
+	bool_t			 lost;
+
+	if (msg != NULL && msg->rm_reply.rp_stat == MSG_DENIED &&
+	    msg->rjcted_rply.rj_stat == AUTH_ERROR &&
+	    authgss_lost(msg->rjcted_rply.rj_why))
+		return (TRUE);
+	if (sc == NULL)
+		return (FALSE);
+	mutex_lock(&sc->sc_seqlock);
+	lost = sc->sc_lost;
+	mutex_unlock(&sc->sc_seqlock);
+	return (lost);
+}
+
 static bool_t
-_rpc_gss_refresh(AUTH *auth, rpc_gss_options_ret_t *options_ret)
+_rpc_gss_refresh(AUTH *auth, struct rpc_msg *msg,
+		 rpc_gss_options_ret_t *options_ret)
 {
 	struct rpc_gss_data	*gd;
 	struct rpc_gss_init_res	 gr;
@@ -459,18 +956,41 @@ _rpc_gss_refresh(AUTH *auth, rpc_gss_options_ret_t *options_ret)
 	OM_uint32		 maj_stat, min_stat, call_stat, ret_flags,
 				 time_ret;
 	gss_OID			 actual_mech_type;
-	char			*mechanism;
+	struct authgss_ctx	*sc;
+	struct authgss_key	 key;
 
 	gss_log_debug("in authgss_refresh()");
 
 	gd = AUTH_PRIVATE(auth);
 
-	if (gd->established)
-		return (TRUE);
+	if (gd->established) {
+		if (!authgss_ctx_lost(gd, msg))
+			return (TRUE);
+		/* Nobody can use it any more; there is nothing to destroy. */
+		gss_log_debug("authgss_refresh: server lost the context");
+		if (gd->sc != NULL) {
+			authgss_cache_drop(gd->sc);
+			authgss_ctx_unuse(gd);
+		}
+		gd->established = FALSE;
+	}
+
+	/* Take over an established context for the same target, if any. */
+	if (authgss_cache_key(gd, &key)) {
+		sc = authgss_cache_lookup(&key);
+		free(key.principal);
+		if (sc != NULL) {
+			gss_log_debug("authgss_refresh: reusing cached context");
+			authgss_ctx_use(gd, sc);
+			authgss_options_ret(gd, options_ret);
+			return (TRUE);
+		}
+	}
 
 	/* GSS context establishment loop. */
 	memset(&gr, 0, sizeof(gr));
 	recv_tokenp = GSS_C_NO_BUFFER;
+	gd->gc.gc_proc = RPCSEC_GSS_INIT;
 
 	print_rpc_gss_sec(&gd->sec);
 
@@ -583,23 +1103,28 @@ _rpc_gss_refresh(AUTH *auth, rpc_gss_options_ret_t *options_ret)
 				return (FALSE);
 			}
 
-			options_ret->major_status = GSS_S_COMPLETE;
-			options_ret->minor_status = 0;
-			options_ret->rpcsec_version = gd->gc.gc_v;
-			options_ret->ret_flags = ret_flags;
-			options_ret->time_ret = time_ret;
-			options_ret->gss_context = gd->ctx;
-			options_ret->actual_mechanism[0] = '\0';
-			if (rpc_gss_oid_to_mech(actual_mech_type, &mechanism)) {
-				strncpy(options_ret->actual_mechanism,
-					mechanism,
-					(sizeof(options_ret->actual_mechanism)-1));
+			if ((sc = calloc(1, sizeof(*sc))) == NULL) {
+				rpc_gss_set_error(ENOMEM);
+				options_ret->major_status = GSS_S_FAILURE;
+				options_ret->minor_status = 0;
+				return (FALSE);
 			}
-
-			gd->established = TRUE;
-			gd->gc.gc_proc = RPCSEC_GSS_DATA;
-			gd->gc.gc_seq = 0;
-			gd->win = gr.gr_win;
+			mutex_init(&sc->sc_ctxlock, NULL);
+			mutex_init(&sc->sc_seqlock, NULL);
+			cond_init(&sc->sc_seqcond, NULL, NULL);
+			sc->sc_refcnt = 1;
+			sc->sc_ctx = gd->ctx;
+			sc->sc_handle = gd->gc.gc_ctx;
+			sc->sc_mech = actual_mech_type;
+			sc->sc_flags = ret_flags;
+			sc->sc_win = gr.gr_win;
+			if (time_ret != GSS_C_INDEFINITE)
+				sc->sc_expires = time(NULL) + time_ret;
+
+			authgss_ctx_use(gd, sc);
+			if (authgss_cache_key(gd, &sc->sc_key))
+				authgss_cache_enter(sc);
+			authgss_options_ret(gd, options_ret);
 			break;
 		}
 	}
@@ -608,8 +1133,6 @@ _rpc_gss_refresh(AUTH *auth, rpc_gss_options_ret_t *options_ret)
 		if (gr.gr_token.length != 0)
 			gss_release_buffer(&min_stat, &gr.gr_token);
 
-		authgss_destroy(auth);
-		auth = NULL;
 		rpc_createerr.cf_stat = RPC_AUTHERROR;
 		rpc_gss_set_error(EPERM);
 
@@ -619,12 +1142,12 @@ _rpc_gss_refresh(AUTH *auth, rpc_gss_options_ret_t *options_ret)
 }
 
 static bool_t
-authgss_refresh(AUTH *auth, void *dummy)
+authgss_refresh(AUTH *auth, void *msg)
 {
 	rpc_gss_options_ret_t ret;
 
 	memset(&ret, 0, sizeof(ret));
-	return _rpc_gss_refresh(auth, &ret);
+	return _rpc_gss_refresh(auth, (struct rpc_msg *)msg, &ret);
 }
 
 bool_t
@@ -648,14 +1171,30 @@ static void
 authgss_destroy_context(AUTH *auth)
 {
 	struct rpc_gss_data	*gd;
+	struct authgss_ctx	*sc;
 	OM_uint32		 min_stat;
+	bool_t			 last;
 
 	gss_log_debug("in authgss_destroy_context()");
 
 	gd = AUTH_PRIVATE(auth);
 
-	if (gd->gc.gc_ctx.length != 0) {
-		if (gd->established) {
+	/* A call of ours that failed with the context is over. */
+	__authgss_call_done(auth, NULL);
+
+	if ((sc = gd->sc) != NULL) {
+		/* A context that failed is no use to anyone else. */
+		if (!gd->established)
+			authgss_cache_drop(sc);
+
+		/* Tell the server only if no one else can use it. */
+		mutex_lock(&authgss_cache_lock);
+		mutex_lock(&auth_ref_lock);
+		last = (sc->sc_refcnt == 1 && !sc->sc_cached);
+		mutex_unlock(&auth_ref_lock);
+		mutex_unlock(&authgss_cache_lock);
+
+		if (gd->established && last) {
 			AUTH *save_auth = NULL;
 
 			/* Make sure we use the right auth_ops */
@@ -671,6 +1210,9 @@ authgss_destroy_context(AUTH *auth)
 			if (save_auth != NULL)
 				gd->clnt->cl_auth = save_auth;
 		}
+		authgss_ctx_unuse(gd);
+	}
+	if (gd->gc.gc_ctx.length != 0) {
 		gss_release_buffer(&min_stat, &gd->gc.gc_ctx);
 		/* XXX ANDROS check size of context  - should be 8 */
 		memset(&gd->gc.gc_ctx, 0, sizeof(gd->gc.gc_ctx));
@@ -723,26 +1265,31 @@ authgss_wrap(AUTH *auth, XDR *xdrs, xdrproc_t xdr_func, caddr_t xdr_ptr)
 	if (!gd->established || gd->sec.svc == RPCSEC_GSS_SVC_NONE) {
 		return ((*xdr_func)(xdrs, xdr_ptr));
 	}
-	return (xdr_rpc_gss_data(xdrs, xdr_func, xdr_ptr,
-				 gd->ctx, gd->sec.qop,
-				 gd->sec.svc, gd->gc.gc_seq));
+	return (__xdr_rpc_gss_data(xdrs, xdr_func, xdr_ptr,
+				   gd->ctx, authgss_ctx_lock(gd), gd->sec.qop,
+				   gd->sec.svc, authgss_call_seq(auth)));
 }
 
 static bool_t
 authgss_unwrap(AUTH *auth, XDR *xdrs, xdrproc_t xdr_func, caddr_t xdr_ptr)
 {
 	struct rpc_gss_data	*gd;
+	bool_t			 xdr_stat;
 
 	gss_log_debug("in authgss_unwrap()");
 
 	gd = AUTH_PRIVATE(auth);
 
 	if (!gd->established || gd->sec.svc == RPCSEC_GSS_SVC_NONE) {
-		return ((*xdr_func)(xdrs, xdr_ptr));
+		xdr_stat = (*xdr_func)(xdrs, xdr_ptr);
+		__authgss_call_done(auth, NULL);
+		return (xdr_stat);
 	}
-	return (xdr_rpc_gss_data(xdrs, xdr_func, xdr_ptr,
-				 gd->ctx, gd->sec.qop,
-				 gd->sec.svc, gd->gc.gc_seq));
+	xdr_stat = __xdr_rpc_gss_data(xdrs, xdr_func, xdr_ptr,
+				      gd->ctx, authgss_ctx_lock(gd), gd->sec.qop,
+				      gd->sec.svc, authgss_call_seq(auth));
+	__authgss_call_done(auth, NULL);
+	return (xdr_stat);
 }
 
 static AUTH *
@@ -858,12 +1405,12 @@ rpc_gss_seccreate(CLIENT *clnt, char *principal, char *mechanism,
 	save_auth = clnt->cl_auth;
 	clnt->cl_auth = auth;
 
-	if (_rpc_gss_refresh(auth, ret) == FALSE) {
+	authgss_auth_get(auth);		/* Reference for caller */
+	if (_rpc_gss_refresh(auth, NULL, ret) == FALSE) {
+		authgss_destroy(auth);
 		auth = NULL;
-	} else {
+	} else
 		rpc_gss_clear_error();
-		authgss_auth_get(auth);
-	}
 
 	clnt->cl_auth = save_auth;
 
@@ -946,6 +1493,7 @@ rpc_gss_max_data_length(AUTH *auth, int maxlen)
 	struct rpc_gss_data *gd;
 	int conf_req_flag;
 	int result;
+	mutex_t *lock;
 
 	if (auth == NULL) {
 		rpc_gss_set_error(EINVAL);
@@ -974,8 +1522,10 @@ rpc_gss_max_data_length(AUTH *auth, int maxlen)
 	}
 
 	result = 0;
+	lock = authgss_ctx_enter(gd);
 	maj_stat = gss_wrap_size_limit(&min_stat, gd->ctx, conf_req_flag,
 					gd->sec.qop, maxlen, &max_input_size);
+	authgss_ctx_leave(lock);
 	if (maj_stat == GSS_S_COMPLETE)
 		if ((int)max_input_size > 0)
 			result = (int)max_input_size;
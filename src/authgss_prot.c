@@ -45,18 +45,53 @@
 #include <rpc/rpc.h>
 #include <ctype.h>
 #include <gssapi/gssapi.h>
+#ifdef HAVE_GSSAPI_GSSAPI_EXT_H
+#include <gssapi/gssapi_ext.h>
+#endif
+#include <reentrant.h>
 
 #include "debug.h"
+#include "rpc_com.h"
 
 /* additional space needed for encoding */
 #define RPC_SLACK_SPACE 1024
 
+/*
+ * A GSS context is not safe for concurrent use: per-message calls on
+ * one that is shared take its lock, if the caller passed one.
+ */
+#define GSS_CTX_LOCK(lock) \
+	do { if ((lock) != NULL) mutex_lock(lock); } while (0)
+#define GSS_CTX_UNLOCK(lock) \
+	do { if ((lock) != NULL) mutex_unlock(lock); } while (0)
+
 bool_t
 xdr_rpc_gss_buf(XDR *xdrs, gss_buffer_t buf, u_int maxsize)
 {
 	bool_t xdr_stat;
 	u_int tmplen;
 
+	if (xdrs->x_op == XDR_DECODE && buf->value == NULL) {
+		/*
+		 * The buffer is released with gss_release_buffer(), so it
+		 * must come from malloc() even while a decode arena is bound.
+		 */
+		if (!xdr_u_int(xdrs, &tmplen) || tmplen > maxsize)
+			return FALSE;
+		if (tmplen == 0) {
+			buf->length = 0;
+			return TRUE;
+		}
+		if ((buf->value = malloc(tmplen)) == NULL)
+			return FALSE;
+		if (!xdr_opaque(xdrs, buf->value, tmplen)) {
+			free(buf->value);
+			buf->value = NULL;
+			return FALSE;
+		}
+		buf->length = tmplen;
+		return TRUE;
+	}
 	if (xdrs->x_op != XDR_DECODE) {
 		if (buf->length > UINT_MAX)
 			return FALSE;
@@ -138,9 +173,92 @@ xdr_rpc_gss_init_res(XDR *xdrs, struct rpc_gss_init_res *p)
 	return (xdr_stat);
 }
 
-bool_t
+#ifdef HAVE_GSS_WRAP_IOV
+/*
+ * Seal rpc_gss_data_t where it lies: the data is marshalled after
+ * room for the token header, and gss_wrap_iov() encrypts it in place
+ * and fills in the header, padding and trailer around it.  The
+ * contiguous result is the token gss_wrap() would have produced.
+ * Returns 1 on success, 0 on failure, and -1 if the stream can't
+ * lend a buffer for the whole token; the caller then starts over at
+ * start with gss_wrap().
+ */
+static int
+xdr_rpc_gss_wrap_iov(XDR *xdrs, xdrproc_t xdr_func, caddr_t xdr_ptr,
+		     gss_ctx_id_t ctx, mutex_t *lock, gss_qop_t qop,
+		     u_int seq, u_int start)
+{
+	gss_iov_buffer_desc iov[4];
+	OM_uint32	maj_stat, min_stat;
+	int		conf_state;
+	u_int		hdrlen, datalen, toklen;
+	char		*buf;
+
+	memset(iov, 0, sizeof(iov));
+	iov[0].type = GSS_IOV_BUFFER_TYPE_HEADER;
+	iov[1].type = GSS_IOV_BUFFER_TYPE_DATA;
+	iov[2].type = GSS_IOV_BUFFER_TYPE_PADDING;
+	iov[3].type = GSS_IOV_BUFFER_TYPE_TRAILER;
+
+	/* The header size doesn't depend on the data; keep it aligned. */
+	GSS_CTX_LOCK(lock);
+	maj_stat = gss_wrap_iov_length(&min_stat, ctx, TRUE, qop,
+				       &conf_state, iov, 4);
+	GSS_CTX_UNLOCK(lock);
+	if (maj_stat != GSS_S_COMPLETE)
+		return (-1);
+	hdrlen = iov[0].buffer.length;
+	if (hdrlen % BYTES_PER_XDR_UNIT != 0 ||
+	    !XDR_SETPOS(xdrs, start + 4 + hdrlen))
+		return (-1);
+
+	/* Marshal rpc_gss_data_t (sequence number + arguments). */
+	if (!xdr_u_int(xdrs, &seq) || !(*xdr_func)(xdrs, xdr_ptr))
+		return (0);
+	datalen = XDR_GETPOS(xdrs) - start - 4 - hdrlen;
+
+	iov[1].buffer.length = datalen;
+	GSS_CTX_LOCK(lock);
+	maj_stat = gss_wrap_iov_length(&min_stat, ctx, TRUE, qop,
+				       &conf_state, iov, 4);
+	GSS_CTX_UNLOCK(lock);
+	if (maj_stat != GSS_S_COMPLETE || iov[0].buffer.length != hdrlen)
+		return (-1);
+	toklen = hdrlen + datalen + iov[2].buffer.length +
+		iov[3].buffer.length;
+
+	/* Lay the token out in the stream buffer. */
+	XDR_SETPOS(xdrs, start);
+	buf = (char *)XDR_INLINE(xdrs, 4 + RNDUP(toklen));
+	if (buf == NULL)
+		return (-1);
+	iov[0].buffer.value = buf + 4;
+	iov[1].buffer.value = buf + 4 + hdrlen;
+	iov[2].buffer.value = (char *)iov[1].buffer.value + datalen;
+	iov[3].buffer.value = (char *)iov[2].buffer.value +
+		iov[2].buffer.length;
+
+	/* Encrypt rpc_gss_data_t. */
+	GSS_CTX_LOCK(lock);
+	maj_stat = gss_wrap_iov(&min_stat, ctx, TRUE, qop, &conf_state,
+				iov, 4);
+	GSS_CTX_UNLOCK(lock);
+	if (maj_stat != GSS_S_COMPLETE) {
+		gss_log_status("xdr_rpc_gss_wrap_iov: gss_wrap_iov",
+			maj_stat, min_stat);
+		return (0);
+	}
+
+	/* Marshal the databody_priv length and pad. */
+	*(u_int32_t *)(void *)buf = htonl(toklen);
+	memset(buf + 4 + toklen, 0, RNDUP(toklen) - toklen);
+	return (1);
+}
+#endif
+
+static bool_t
 xdr_rpc_gss_wrap_data(XDR *xdrs, xdrproc_t xdr_func, caddr_t xdr_ptr,
-		      gss_ctx_id_t ctx, gss_qop_t qop,
+		      gss_ctx_id_t ctx, mutex_t *lock, gss_qop_t qop,
 		      rpc_gss_svc_t svc, u_int seq)
 {
 	gss_buffer_desc	databuf, wrapbuf;
@@ -151,6 +269,18 @@ xdr_rpc_gss_wrap_data(XDR *xdrs, xdrproc_t xdr_func, caddr_t xdr_ptr,
 
 	/* Skip databody length. */
 	start = XDR_GETPOS(xdrs);
+
+#ifdef HAVE_GSS_WRAP_IOV
+	if (svc == RPCSEC_GSS_SVC_PRIVACY) {
+		switch (xdr_rpc_gss_wrap_iov(xdrs, xdr_func, xdr_ptr,
+					     ctx, lock, qop, seq, start)) {
+		case 1:
+			return (TRUE);
+		case 0:
+			return (FALSE);
+		}
+	}
+#endif
 	XDR_SETPOS(xdrs, start + 4);
 
 	memset(&databuf, 0, sizeof(databuf));
@@ -175,24 +305,68 @@ xdr_rpc_gss_wrap_data(XDR *xdrs, xdrproc_t xdr_func, caddr_t xdr_ptr,
 		if (!xdr_u_int(xdrs, (u_int *)&databuflen))
 			return (FALSE);
 
+		XDR_SETPOS(xdrs, end);
+#ifdef HAVE_GSS_GET_MIC_IOV
+		{
+			gss_iov_buffer_desc iov[2];
+			char	*buf;
+
+			/* Checksum into the stream, if it has room. */
+			memset(iov, 0, sizeof(iov));
+			iov[0].type = GSS_IOV_BUFFER_TYPE_DATA;
+			iov[0].buffer = databuf;
+			iov[1].type = GSS_IOV_BUFFER_TYPE_MIC_TOKEN;
+			GSS_CTX_LOCK(lock);
+			maj_stat = gss_get_mic_iov_length(&min_stat, ctx, qop,
+							  iov, 2);
+			GSS_CTX_UNLOCK(lock);
+			buf = NULL;
+			if (maj_stat == GSS_S_COMPLETE)
+				buf = (char *)XDR_INLINE(xdrs, 4 +
+					RNDUP(iov[1].buffer.length));
+			if (buf != NULL) {
+				iov[1].buffer.value = buf + 4;
+				GSS_CTX_LOCK(lock);
+				maj_stat = gss_get_mic_iov(&min_stat, ctx, qop,
+							   iov, 2);
+				GSS_CTX_UNLOCK(lock);
+				if (maj_stat != GSS_S_COMPLETE) {
+					gss_log_status("xdr_rpc_gss_wrap_data: "
+						"gss_get_mic_iov",
+						maj_stat, min_stat);
+					return (FALSE);
+				}
+				*(u_int32_t *)(void *)buf =
+					htonl(iov[1].buffer.length);
+				memset(buf + 4 + iov[1].buffer.length, 0,
+				       RNDUP(iov[1].buffer.length) -
+				       iov[1].buffer.length);
+				return (TRUE);
+			}
+			XDR_SETPOS(xdrs, end);
+		}
+#endif
 		/* Checksum rpc_gss_data_t. */
+		GSS_CTX_LOCK(lock);
 		maj_stat = gss_get_mic(&min_stat, ctx, qop,
 				       &databuf, &wrapbuf);
+		GSS_CTX_UNLOCK(lock);
 		if (maj_stat != GSS_S_COMPLETE) {
 			gss_log_status("xdr_rpc_gss_wrap_data: gss_get_mic", 
 				maj_stat, min_stat);
 			return (FALSE);
 		}
 		/* Marshal checksum. */
-		XDR_SETPOS(xdrs, end);
 		maxwrapsz = (u_int)(wrapbuf.length + RPC_SLACK_SPACE);
 		xdr_stat = xdr_rpc_gss_buf(xdrs, &wrapbuf, maxwrapsz);
 		gss_release_buffer(&min_stat, &wrapbuf);
 	}
 	else if (svc == RPCSEC_GSS_SVC_PRIVACY) {
 		/* Encrypt rpc_gss_data_t. */
+		GSS_CTX_LOCK(lock);
 		maj_stat = gss_wrap(&min_stat, ctx, TRUE, qop, &databuf,
 				    &conf_state, &wrapbuf);
+		GSS_CTX_UNLOCK(lock);
 		if (maj_stat != GSS_S_COMPLETE) {
 			gss_log_status("xdr_rpc_gss_wrap_data: gss_wrap", 
 				maj_stat, min_stat);
@@ -207,9 +381,40 @@ xdr_rpc_gss_wrap_data(XDR *xdrs, xdrproc_t xdr_func, caddr_t xdr_ptr,
 	return (xdr_stat);
 }
 
-bool_t
+/*
+ * Decode an opaque<> without copying it if the stream holds it in
+ * one piece.  *lent says whether buf points into the stream; if not,
+ * it was copied into memory the caller frees.
+ */
+static bool_t
+xdr_rpc_gss_lend(XDR *xdrs, gss_buffer_t buf, bool_t *lent)
+{
+	u_int	len;
+
+	*lent = FALSE;
+	buf->value = NULL;
+	if (!xdr_u_int(xdrs, &len))
+		return (FALSE);
+	buf->length = len;
+	if (len == 0)
+		return (TRUE);
+	if ((buf->value = XDR_INLINE(xdrs, RNDUP(len))) != NULL) {
+		*lent = TRUE;
+		return (TRUE);
+	}
+	if ((buf->value = malloc(len)) == NULL)
+		return (FALSE);
+	if (!xdr_opaque(xdrs, buf->value, len)) {
+		free(buf->value);
+		buf->value = NULL;
+		return (FALSE);
+	}
+	return (TRUE);
+}
+
+static bool_t
 xdr_rpc_gss_unwrap_data(XDR *xdrs, xdrproc_t xdr_func, caddr_t xdr_ptr,
-			gss_ctx_id_t ctx, gss_qop_t qop,
+			gss_ctx_id_t ctx, mutex_t *lock, gss_qop_t qop,
 			rpc_gss_svc_t svc, u_int seq)
 {
 	XDR		tmpxdrs;
@@ -217,33 +422,39 @@ xdr_rpc_gss_unwrap_data(XDR *xdrs, xdrproc_t xdr_func, caddr_t xdr_ptr,
 	OM_uint32	maj_stat, min_stat;
 	u_int		seq_num, qop_state;
 	int			conf_state;
-	bool_t		xdr_stat;
+	bool_t		xdr_stat, data_lent, wrap_lent;
 
 	if (xdr_func == (xdrproc_t)xdr_void || xdr_ptr == NULL)
 		return (TRUE);
 
 	memset(&databuf, 0, sizeof(databuf));
 	memset(&wrapbuf, 0, sizeof(wrapbuf));
+	data_lent = wrap_lent = FALSE;
 
 	if (svc == RPCSEC_GSS_SVC_INTEGRITY) {
 		/* Decode databody_integ. */
-		if (!xdr_rpc_gss_buf(xdrs, &databuf, (u_int)-1)) {
+		if (!xdr_rpc_gss_lend(xdrs, &databuf, &data_lent)) {
 			LIBTIRPC_DEBUG(1, ("xdr_rpc_gss_unwrap_data: decode databody_integ failed"));
 			return (FALSE);
 		}
 		/* Decode checksum. */
-		if (!xdr_rpc_gss_buf(xdrs, &wrapbuf, (u_int)-1)) {
-			gss_release_buffer(&min_stat, &databuf);
+		if (!xdr_rpc_gss_lend(xdrs, &wrapbuf, &wrap_lent)) {
+			if (!data_lent)
+				free(databuf.value);
 			LIBTIRPC_DEBUG(1, ("xdr_rpc_gss_unwrap_data: decode checksum failed"));
 			return (FALSE);
 		}
 		/* Verify checksum and QOP. */
+		GSS_CTX_LOCK(lock);
 		maj_stat = gss_verify_mic(&min_stat, ctx, &databuf,
 					  &wrapbuf, &qop_state);
-		gss_release_buffer(&min_stat, &wrapbuf);
+		GSS_CTX_UNLOCK(lock);
+		if (!wrap_lent)
+			free(wrapbuf.value);
 
 		if (maj_stat != GSS_S_COMPLETE || qop_state != qop) {
-			gss_release_buffer(&min_stat, &databuf);
+			if (!data_lent)
+				free(databuf.value);
 			gss_log_status("xdr_rpc_gss_unwrap_data: gss_verify_mic", 
 				maj_stat, min_stat);
 			return (FALSE);
@@ -251,20 +462,45 @@ xdr_rpc_gss_unwrap_data(XDR *xdrs, xdrproc_t xdr_func, caddr_t xdr_ptr,
 	}
 	else if (svc == RPCSEC_GSS_SVC_PRIVACY) {
 		/* Decode databody_priv. */
-		if (!xdr_rpc_gss_buf(xdrs, &wrapbuf, (u_int)-1)) {
+		if (!xdr_rpc_gss_lend(xdrs, &wrapbuf, &wrap_lent)) {
 			LIBTIRPC_DEBUG(1, ("xdr_rpc_gss_unwrap_data: decode databody_priv failed"));
 			return (FALSE);
 		}
+#ifdef HAVE_GSS_UNWRAP_IOV
+		{
+			gss_iov_buffer_desc iov[2];
+
+			/* Decrypt databody in place; it ends up in iov[1]. */
+			memset(iov, 0, sizeof(iov));
+			iov[0].type = GSS_IOV_BUFFER_TYPE_STREAM;
+			iov[0].buffer = wrapbuf;
+			iov[1].type = GSS_IOV_BUFFER_TYPE_DATA;
+			GSS_CTX_LOCK(lock);
+			maj_stat = gss_unwrap_iov(&min_stat, ctx, &conf_state,
+						  &qop_state, iov, 2);
+			GSS_CTX_UNLOCK(lock);
+			databuf = iov[1].buffer;
+			data_lent = TRUE;
+		}
+#else
 		/* Decrypt databody. */
+		GSS_CTX_LOCK(lock);
 		maj_stat = gss_unwrap(&min_stat, ctx, &wrapbuf, &databuf,
 				      &conf_state, &qop_state);
-
-		gss_release_buffer(&min_stat, &wrapbuf);
+		GSS_CTX_UNLOCK(lock);
+		if (!wrap_lent)
+			free(wrapbuf.value);
+#endif
 
 		/* Verify encryption and QOP. */
 		if (maj_stat != GSS_S_COMPLETE || qop_state != qop ||
 			conf_state != TRUE) {
-			gss_release_buffer(&min_stat, &databuf);
+			if (!data_lent)
+				gss_release_buffer(&min_stat, &databuf);
+#ifdef HAVE_GSS_UNWRAP_IOV
+			if (!wrap_lent)
+				free(wrapbuf.value);
+#endif
 			gss_log_status("xdr_rpc_gss_unwrap_data: gss_unwrap", 
 				maj_stat, min_stat);
 			return (FALSE);
@@ -275,7 +511,18 @@ xdr_rpc_gss_unwrap_data(XDR *xdrs, xdrproc_t xdr_func, caddr_t xdr_ptr,
 	xdr_stat = (xdr_u_int(&tmpxdrs, &seq_num) &&
 		    (*xdr_func)(&tmpxdrs, xdr_ptr));
 	XDR_DESTROY(&tmpxdrs);
-	gss_release_buffer(&min_stat, &databuf);
+	if (svc == RPCSEC_GSS_SVC_INTEGRITY) {
+		if (!data_lent)
+			free(databuf.value);
+	}
+	else {
+#ifdef HAVE_GSS_UNWRAP_IOV
+		if (!wrap_lent)
+			free(wrapbuf.value);
+#else
+		gss_release_buffer(&min_stat, &databuf);
+#endif
+	}
 
 	/* Verify sequence number. */
 	if (xdr_stat == TRUE && seq_num != seq) {
@@ -286,25 +533,35 @@ xdr_rpc_gss_unwrap_data(XDR *xdrs, xdrproc_t xdr_func, caddr_t xdr_ptr,
 	return (xdr_stat);
 }
 
+/* As xdr_rpc_gss_data(), holding lock (if not NULL) over calls on ctx. */
 bool_t
-xdr_rpc_gss_data(XDR *xdrs, xdrproc_t xdr_func, caddr_t xdr_ptr,
-		 gss_ctx_id_t ctx, gss_qop_t qop,
-		 rpc_gss_svc_t svc, u_int seq)
+__xdr_rpc_gss_data(XDR *xdrs, xdrproc_t xdr_func, caddr_t xdr_ptr,
+		   gss_ctx_id_t ctx, mutex_t *lock, gss_qop_t qop,
+		   rpc_gss_svc_t svc, u_int seq)
 {
 	switch (xdrs->x_op) {
 
 	case XDR_ENCODE:
 		return (xdr_rpc_gss_wrap_data(xdrs, xdr_func, xdr_ptr,
-					      ctx, qop, svc, seq));
+					      ctx, lock, qop, svc, seq));
 	case XDR_DECODE:
 		return (xdr_rpc_gss_unwrap_data(xdrs, xdr_func, xdr_ptr,
-						ctx, qop,svc, seq));
+						ctx, lock, qop, svc, seq));
 	case XDR_FREE:
 		return (TRUE);
 	}
 	return (FALSE);
 }
 
+bool_t
+xdr_rpc_gss_data(XDR *xdrs, xdrproc_t xdr_func, caddr_t xdr_ptr,
+		 gss_ctx_id_t ctx, gss_qop_t qop,
+		 rpc_gss_svc_t svc, u_int seq)
+{
+	return (__xdr_rpc_gss_data(xdrs, xdr_func, xdr_ptr, ctx, NULL,
+				   qop, svc, seq));
+}
+
 void
 gss_log_debug(const char *fmt, ...)
 {
@@ -131,6 +131,8 @@ struct cu_data {
 	int			cu_async;
 	int			cu_connect;	/* Use connect(). */
 	int			cu_connected;	/* Have done connect(). */
+	xdr_arena_t		*cu_arena;	/* results arena (CLSET_ARENA) */
+	int			cu_borrow;	/* borrow from cu_inbuf */
 	char			cu_inbuf[1];
 };
 
@@ -230,6 +232,8 @@ clnt_dg_create(fd, svcaddr, program, version, sendsz, recvsz)
 	cu->cu_async = FALSE;
 	cu->cu_connect = FALSE;
 	cu->cu_connected = FALSE;
+	cu->cu_arena = NULL;
+	cu->cu_borrow = FALSE;
 	(void) gettimeofday(&now, NULL);
 	call_msg.rm_xid = __RPC_GETXID(&now);
 	call_msg.rm_call.cb_prog = program;
@@ -515,10 +519,21 @@ get_reply:
 					    &reply_msg.acpted_rply.ar_verf)) {
 				cu->cu_error.re_status = RPC_AUTHERROR;
 				cu->cu_error.re_why = AUTH_INVALIDRESP;
-			} else if (! AUTH_UNWRAP(cl->cl_auth, &reply_xdrs,
-						 xresults, resultsp)) {
-				if (cu->cu_error.re_status == RPC_SUCCESS)
-				     cu->cu_error.re_status = RPC_CANTDECODERES;
+			} else {
+				if (cu->cu_arena != NULL) {
+					xdr_arena_bind(NULL, cu->cu_arena);
+					if (cu->cu_borrow)
+						xdr_arena_borrow(&reply_xdrs);
+				}
+				if (! AUTH_UNWRAP(cl->cl_auth, &reply_xdrs,
+						  xresults, resultsp)) {
+					if (cu->cu_error.re_status ==
+					    RPC_SUCCESS)
+						cu->cu_error.re_status =
+						    RPC_CANTDECODERES;
+				}
+				if (cu->cu_arena != NULL)
+					xdr_arena_bind(NULL, NULL);
 			}
 			if (reply_msg.acpted_rply.ar_verf.oa_base != NULL) {
 				xdrs->x_op = XDR_FREE;
@@ -544,6 +559,11 @@ get_reply:
 
 	}
 out:
+#ifdef HAVE_RPCSEC_GSS
+	/* frees the call's sequence number, however the call ended */
+	if (is_authgss_client(cl))
+		__authgss_call_done(cl->cl_auth, &cu->cu_error);
+#endif
 	release_fd_lock(cu->cu_fd_lock, mask);
 	return (cu->cu_error.re_status);
 }
@@ -576,8 +596,13 @@ clnt_dg_freeres(cl, xdr_res, res_ptr)
 	cu->cu_fd_lock->pending++;
 	while (cu->cu_fd_lock->active)
 		cond_wait(&cu->cu_fd_lock->cv, &clnt_fd_lock);
-	xdrs->x_op = XDR_FREE;
-	dummy = (*xdr_res)(xdrs, res_ptr);
+	if (cu->cu_arena != NULL) {
+		/* released by the caller's xdr_arena_reset() */
+		dummy = TRUE;
+	} else {
+		xdrs->x_op = XDR_FREE;
+		dummy = (*xdr_res)(xdrs, res_ptr);
+	}
 	cu->cu_fd_lock->pending--;
 	thr_sigsetmask(SIG_SETMASK, &mask, NULL);
 	cond_signal(&cu->cu_fd_lock->cv);
@@ -726,6 +751,18 @@ clnt_dg_control(cl, request, info)
 	case CLSET_CONNECT:
 		cu->cu_connect = *(int *)info;
 		break;
+	case CLSET_ARENA:
+		cu->cu_arena = *(xdr_arena_t **)info;
+		break;
+	case CLGET_ARENA:
+		*(xdr_arena_t **)info = cu->cu_arena;
+		break;
+	case CLSET_BORROW:
+		cu->cu_borrow = *(int *)info;
+		break;
+	case CLGET_BORROW:
+		*(int *)info = cu->cu_borrow;
+		break;
 	default:
 		release_fd_lock(cu->cu_fd_lock, mask);
 		return (FALSE);
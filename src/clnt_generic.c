@@ -266,6 +266,8 @@ clnt_tp_create_timed(const char *hostname, rpcprog_t prog, rpcvers_t vers,
 {
 	struct netbuf *svcaddr;			/* servers address */
 	CLIENT *cl = NULL;			/* client handle */
+	bool_t retried = FALSE;
+	bool_t cached;
 
 	if (nconf == NULL) {
 		rpc_createerr.cf_stat = RPC_UNKNOWNPROTO;
@@ -275,9 +277,10 @@ clnt_tp_create_timed(const char *hostname, rpcprog_t prog, rpcvers_t vers,
 	/*
 	 * Get the address of the server
 	 */
+again:
 	if ((svcaddr = __rpcb_findaddr_timed(prog, vers,
 			(struct netconfig *)nconf, (char *)hostname,
-			&cl, (struct timeval *)tp)) == NULL) {
+			&cl, (struct timeval *)tp, &cached)) == NULL) {
 		/* appropriate error number is set by rpcbind libraries */
 		return (NULL);
 	}
@@ -301,6 +304,18 @@ clnt_tp_create_timed(const char *hostname, rpcprog_t prog, rpcvers_t vers,
 	}
 	free(svcaddr->buf);
 	free(svcaddr);
+
+	/*
+	 * The address may have come from the rpcbind lookup cache and
+	 * be stale (e.g. the server was restarted on another port).
+	 * Drop it and ask rpcbind once more.  An address rpcbind has just
+	 * given us is not asked for again.
+	 */
+	if (cl == NULL && cached && !retried &&
+	    __rpcb_invalidate(prog, vers, nconf, hostname)) {
+		retried = TRUE;
+		goto again;
+	}
 	return (cl);
 }
 
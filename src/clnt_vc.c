@@ -127,6 +127,8 @@ struct ct_data {
 	} ct_u;
 	u_int		ct_mpos;	/* pos after marshal */
 	XDR		ct_xdrs;	/* XDR stream */
+	xdr_arena_t	*ct_arena;	/* results arena (CLSET_ARENA) */
+	bool_t		ct_zerocopy;	/* CLSET_ZEROCOPY */
 };
 
 /*
@@ -272,6 +274,8 @@ clnt_vc_create(fd, raddr, prog, vers, sendsz, recvsz)
 	ct->ct_fd_lock = fd_lock;
 	ct->ct_wait.tv_usec = 0;
 	ct->ct_waitset = FALSE;
+	ct->ct_arena = NULL;
+	ct->ct_zerocopy = FALSE;
 	ct->ct_addr.buf = malloc(raddr->maxlen);
 	if (ct->ct_addr.buf == NULL)
 		goto err;
@@ -390,23 +394,20 @@ call_again:
 		if (ct->ct_error.re_status == RPC_SUCCESS)
 			ct->ct_error.re_status = RPC_CANTENCODEARGS;
 		(void)xdrrec_endofrecord(xdrs, TRUE);
-		release_fd_lock(ct->ct_fd_lock, mask);
-		return (ct->ct_error.re_status);
+		goto out;
 	}
 	if (! xdrrec_endofrecord(xdrs, shipnow)) {
-		release_fd_lock(ct->ct_fd_lock, mask);
-		return (ct->ct_error.re_status = RPC_CANTSEND);
-	}
-	if (! shipnow) {
-		release_fd_lock(ct->ct_fd_lock, mask);
-		return (RPC_SUCCESS);
+		ct->ct_error.re_status = RPC_CANTSEND;
+		goto out;
 	}
+	if (! shipnow)
+		goto out;
 	/*
 	 * Hack to provide rpc-based message passing
 	 */
 	if (timeout.tv_sec == 0 && timeout.tv_usec == 0) {
-		release_fd_lock(ct->ct_fd_lock, mask);
-		return(ct->ct_error.re_status = RPC_TIMEDOUT);
+		ct->ct_error.re_status = RPC_TIMEDOUT;
+		goto out;
 	}
 
 
@@ -418,16 +419,13 @@ call_again:
 		reply_msg.acpted_rply.ar_verf = _null_auth;
 		reply_msg.acpted_rply.ar_results.where = NULL;
 		reply_msg.acpted_rply.ar_results.proc = (xdrproc_t)xdr_void;
-		if (! xdrrec_skiprecord(xdrs)) {
-			release_fd_lock(ct->ct_fd_lock, mask);
-			return (ct->ct_error.re_status);
-		}
+		if (! xdrrec_skiprecord(xdrs))
+			goto out;
 		/* now decode and validate the response header */
 		if (! xdr_replymsg(xdrs, &reply_msg)) {
 			if (ct->ct_error.re_status == RPC_SUCCESS)
 				continue;
-			release_fd_lock(ct->ct_fd_lock, mask);
-			return (ct->ct_error.re_status);
+			goto out;
 		}
 		if (reply_msg.rm_xid == x_id)
 			break;
@@ -442,10 +440,17 @@ call_again:
 		    &reply_msg.acpted_rply.ar_verf)) {
 			ct->ct_error.re_status = RPC_AUTHERROR;
 			ct->ct_error.re_why = AUTH_INVALIDRESP;
-		} else if (! AUTH_UNWRAP(cl->cl_auth, xdrs,
-					 xdr_results, results_ptr)) {
-			if (ct->ct_error.re_status == RPC_SUCCESS)
-				ct->ct_error.re_status = RPC_CANTDECODERES;
+		} else {
+			if (ct->ct_arena != NULL)
+				xdr_arena_bind(NULL, ct->ct_arena);
+			if (! AUTH_UNWRAP(cl->cl_auth, xdrs,
+			    xdr_results, results_ptr)) {
+				if (ct->ct_error.re_status == RPC_SUCCESS)
+					ct->ct_error.re_status =
+					    RPC_CANTDECODERES;
+			}
+			if (ct->ct_arena != NULL)
+				xdr_arena_bind(NULL, NULL);
 		}
 		/* free verifier ... */
 		if (reply_msg.acpted_rply.ar_verf.oa_base != NULL) {
@@ -459,6 +464,12 @@ call_again:
 		if (refreshes-- && AUTH_REFRESH(cl->cl_auth, &reply_msg))
 			goto call_again;
 	}  /* end of unsuccessful completion */
+out:
+#ifdef HAVE_RPCSEC_GSS
+	/* frees the call's sequence number, however the call ended */
+	if (is_authgss_client(cl))
+		__authgss_call_done(cl->cl_auth, &ct->ct_error);
+#endif
 	release_fd_lock(ct->ct_fd_lock, mask);
 	return (ct->ct_error.re_status);
 }
@@ -500,8 +511,13 @@ clnt_vc_freeres(cl, xdr_res, res_ptr)
 	ct->ct_fd_lock->pending++;
 	while (ct->ct_fd_lock->active)
 		cond_wait(&ct->ct_fd_lock->cv, &clnt_fd_lock);
-	xdrs->x_op = XDR_FREE;
-	dummy = (*xdr_res)(xdrs, res_ptr);
+	if (ct->ct_arena != NULL) {
+		/* released by the caller's xdr_arena_reset() */
+		dummy = TRUE;
+	} else {
+		xdrs->x_op = XDR_FREE;
+		dummy = (*xdr_res)(xdrs, res_ptr);
+	}
 	ct->ct_fd_lock->pending--;
 	thr_sigsetmask(SIG_SETMASK, &(mask), NULL);
 	cond_signal(&ct->ct_fd_lock->cv);
@@ -637,6 +653,27 @@ clnt_vc_control(cl, request, info)
 		memcpy(ct->ct_u.ct_mcallc + 3 * BYTES_PER_XDR_UNIT, &tmp, sizeof(tmp));
 		break;
 
+	case CLSET_ARENA:
+		ct->ct_arena = *(xdr_arena_t **)info;
+		break;
+
+	case CLGET_ARENA:
+		*(xdr_arena_t **)info = ct->ct_arena;
+		break;
+
+	case CLSET_ZEROCOPY:
+		if (! __xdrrec_setzerocopy(&(ct->ct_xdrs), ct->ct_fd,
+		    *(int *)info != 0)) {
+			release_fd_lock(ct->ct_fd_lock, mask);
+			return (FALSE);
+		}
+		ct->ct_zerocopy = (*(int *)info != 0);
+		break;
+
+	case CLGET_ZEROCOPY:
+		*(int *)info = ct->ct_zerocopy;
+		break;
+
 	default:
 		release_fd_lock(ct->ct_fd_lock, mask);
 		return (FALSE);
@@ -668,10 +705,11 @@ clnt_vc_destroy(cl)
 		/* keep waiting... */
 		cond_wait(&ct_fd_lock->cv, &clnt_fd_lock);
 	}
+	/* zerocopy buffers are reclaimed through the socket */
+	XDR_DESTROY(&(ct->ct_xdrs));
 	if (ct->ct_closeit && ct->ct_fd != -1) {
 		(void)close(ct->ct_fd);
 	}
-	XDR_DESTROY(&(ct->ct_xdrs));
 	if (ct->ct_addr.buf)
 		free(ct->ct_addr.buf);
 	mem_free(ct, sizeof(struct ct_data));
@@ -723,6 +761,10 @@ read_vc(ctp, buf, len)
 			ct->ct_error.re_errno = errno;
 			return (-1);
 		}
+		/* woken by zerocopy completions rather than the reply */
+		if ((fd.revents & POLLIN) == 0 &&
+		    __xdrrec_zcreap(&(ct->ct_xdrs)) > 0)
+			continue;
 		break;
 	}
 
@@ -754,7 +796,14 @@ write_vc(ctp, buf, len)
 	int i = 0, cnt;
 
 	for (cnt = len; cnt > 0; cnt -= i, buf += i) {
-	    if ((i = write(ct->ct_fd, buf, (size_t)cnt)) == -1) {
+	    /*
+	     * Don't let a peer that went away (e.g. a long-lived
+	     * connection to rpcbind) kill the process with SIGPIPE.
+	     */
+	    i = send(ct->ct_fd, buf, (size_t)cnt, MSG_NOSIGNAL);
+	    if (i == -1 && errno == ENOTSOCK)
+		i = write(ct->ct_fd, buf, (size_t)cnt);
+	    if (i == -1) {
 		ct->ct_error.re_errno = errno;
 		ct->ct_error.re_status = RPC_CANTSEND;
 		return (-1);
@@ -38,7 +38,10 @@
 #include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
+#include <sys/stat.h>
 #include <rpc/rpc.h>
+#include <rpc/nettype.h>
 #include <unistd.h>
 #include "rpc_com.h"
 
@@ -88,23 +91,47 @@ static const char * const _nc_errors[] = {
     "Netid not found in netconfig database"
 };
 
-struct netconfig_info {
-    int		eof;	/* all entries has been read */
-    int		ref;	/* # of times setnetconfig() has been called */
-    struct netconfig_list	*head;	/* head of the list */
-    struct netconfig_list	*tail;	/* last of the list */
+/*
+ * The netconfig database is parsed once into an immutable snapshot: the
+ * entries in file order, a hash index by netid and, for every nettype
+ * that is resolved from /etc/netconfig, the ordered list of entries
+ * belonging to it.  The snapshot is replaced as a whole when the file's
+ * identity or modification time changes (checked at most every
+ * NC_RECHECK seconds).  Callers pin a snapshot with a reference, which
+ * is the only thing done under nc_db_lock; lookups and walks are made
+ * on the pinned snapshot without holding any lock.
+ */
+#define NC_HASHSIZE	32
+#define NC_NTYPES	(_RPC_UDP + 1)
+#define NC_RECHECK	1	/* seconds between stat()s of NETCONFIG */
+
+struct netconfig_entry {
+    struct netconfig	ne_nc;
+    char		*ne_line;	/* parse buffer holding the strings */
+    int			ne_next;	/* next entry in hash chain, or -1 */
 };
 
-struct netconfig_list {
-    char			*linep;	/* hold line read from netconfig */
-    struct netconfig		*ncp;
-    struct netconfig_list	*next;
+struct netconfig_db {
+    int		ref;		/* # of pins, including the current one */
+    dev_t	dev;		/* identity of the parsed file */
+    ino_t	ino;
+    off_t	size;
+    struct timespec	mtime;
+    int		count;		/* # of entries */
+    struct netconfig_entry	*entries;	/* in file order */
+    int		hash[NC_HASHSIZE];	/* netid index, -1 terminated */
+    int		*types[NC_NTYPES];	/* entries of each nettype */
+    int		ntypes[NC_NTYPES];
+    int		iptcp;		/* first inet/tcp entry, or -1 */
+    int		ipudp;		/* first inet/udp entry, or -1 */
 };
 
 struct netconfig_vars {
     int   valid;	/* token that indicates a valid netconfig_vars */
-    int   flag;		/* first time flag */
-    struct netconfig_list *nc_configs;  /* pointer to the current netconfig entry */
+    struct netconfig_db *db;	/* snapshot pinned by this session */
+    int   *list;	/* entries to walk, or NULL for all of them */
+    int   count;	/* # of entries to walk */
+    int   pos;		/* next entry to return */
 };
 
 #define NC_VALID	0xfeed
@@ -117,8 +144,8 @@ static int parse_ncp(char *, struct netconfig *);
 static struct netconfig *dup_ncp(struct netconfig *);
 
 
-static FILE *nc_file;		/* for netconfig db */
-static struct netconfig_info	ni = { 0, 0, NULL, NULL};
+static struct netconfig_db *nc_db;	/* current snapshot */
+static time_t nc_db_checked;		/* when NETCONFIG was last stat()ed */
 extern pthread_mutex_t nc_db_lock;
 
 #define MAXNETCONFIGLINE    1000
@@ -159,6 +186,284 @@ __nc_error()
 }
 
 #define nc_error        (*(__nc_error()))
+
+static u_int
+nc_hash(netid)
+	const char *netid;
+{
+    u_int h = 2166136261U;
+
+    while (*netid)
+	h = (h ^ (u_char)*netid++) * 16777619U;
+    return (h % NC_HASHSIZE);
+}
+
+static time_t
+nc_now()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (ts.tv_sec);
+}
+
+/*
+ * Returns TRUE if the netconfig entry belongs to the given nettype
+ * (one of the _RPC_* values of <rpc/nettype.h>).
+ */
+int
+__nc_matchtype(nconf, nettype)
+	const struct netconfig *nconf;
+	int nettype;
+{
+    if ((nconf->nc_semantics != NC_TPI_CLTS) &&
+	    (nconf->nc_semantics != NC_TPI_COTS) &&
+	    (nconf->nc_semantics != NC_TPI_COTS_ORD))
+	return (FALSE);
+    switch (nettype) {
+    case _RPC_VISIBLE:
+	if (!(nconf->nc_flag & NC_VISIBLE))
+	    return (FALSE);
+	/* FALLTHROUGH */
+    case _RPC_NETPATH:	/* Be happy */
+	break;
+    case _RPC_CIRCUIT_V:
+	if (!(nconf->nc_flag & NC_VISIBLE))
+	    return (FALSE);
+	/* FALLTHROUGH */
+    case _RPC_CIRCUIT_N:
+	if ((nconf->nc_semantics != NC_TPI_COTS) &&
+		(nconf->nc_semantics != NC_TPI_COTS_ORD))
+	    return (FALSE);
+	break;
+    case _RPC_DATAGRAM_V:
+	if (!(nconf->nc_flag & NC_VISIBLE))
+	    return (FALSE);
+	/* FALLTHROUGH */
+    case _RPC_DATAGRAM_N:
+	if (nconf->nc_semantics != NC_TPI_CLTS)
+	    return (FALSE);
+	break;
+    case _RPC_TCP:
+	if (((nconf->nc_semantics != NC_TPI_COTS) &&
+		(nconf->nc_semantics != NC_TPI_COTS_ORD)) ||
+		(strcmp(nconf->nc_protofmly, NC_INET)
+#ifdef INET6
+		 && strcmp(nconf->nc_protofmly, NC_INET6))
+#else
+		)
+#endif
+		||
+		strcmp(nconf->nc_proto, NC_TCP))
+	    return (FALSE);
+	break;
+    case _RPC_UDP:
+	if ((nconf->nc_semantics != NC_TPI_CLTS) ||
+		(strcmp(nconf->nc_protofmly, NC_INET)
+#ifdef INET6
+		&& strcmp(nconf->nc_protofmly, NC_INET6))
+#else
+		)
+#endif
+		||
+		strcmp(nconf->nc_proto, NC_UDP))
+	    return (FALSE);
+	break;
+    default:
+	return (FALSE);
+    }
+    return (TRUE);
+}
+
+static void
+nc_db_free(db)
+	struct netconfig_db *db;
+{
+    int i;
+
+    for (i = 0; i < db->count; i++) {
+	if (db->entries[i].ne_nc.nc_lookups != NULL)
+	    free(db->entries[i].ne_nc.nc_lookups);
+	free(db->entries[i].ne_line);
+    }
+    for (i = 0; i < NC_NTYPES; i++)
+	if (db->types[i] != NULL)
+	    free(db->types[i]);
+    free(db->entries);
+    free(db);
+}
+
+/*
+ * Reads and indexes the whole netconfig database.  Lines that do not
+ * parse are skipped.
+ */
+static struct netconfig_db *
+nc_db_load()
+{
+    FILE *file;
+    struct stat st;
+    struct netconfig_db *db;
+    struct netconfig_entry *ne;
+    struct netconfig *ncp;
+    char line[MAXNETCONFIGLINE];
+    char *linep;
+    int i, t, size;
+    u_int h;
+
+    if ((file = fopen(NETCONFIG, "r")) == NULL) {
+	nc_error = NC_NONETCONFIG;
+	return (NULL);
+    }
+    if (fstat(fileno(file), &st) == -1 ||
+	    (db = (struct netconfig_db *)calloc(1, sizeof (*db))) == NULL) {
+	fclose(file);
+	nc_error = NC_NOMEM;
+	return (NULL);
+    }
+    db->dev = st.st_dev;
+    db->ino = st.st_ino;
+    db->size = st.st_size;
+    db->mtime = st.st_mtim;
+    size = 0;
+    while (fgets(line, sizeof (line), file) != NULL) {
+	if (*line == '#')
+	    continue;
+	if (db->count == size) {
+	    size = size ? size * 2 : 16;
+	    ne = (struct netconfig_entry *)realloc(db->entries,
+		(size_t)size * sizeof (*ne));
+	    if (ne == NULL)
+		goto nomem;
+	    db->entries = ne;
+	}
+	if ((linep = strdup(line)) == NULL)
+	    goto nomem;
+	ne = &db->entries[db->count];
+	ne->ne_nc.nc_lookups = NULL;
+	if (parse_ncp(linep, &ne->ne_nc) == -1) {
+	    free(linep);
+	    continue;
+	}
+	ne->ne_line = linep;
+	db->count++;
+    }
+    fclose(file);
+    file = NULL;
+
+    /*
+     * Chains are built back to front so that the first entry with a
+     * given netid wins, as it did with a sequential scan.
+     */
+    for (h = 0; h < NC_HASHSIZE; h++)
+	db->hash[h] = -1;
+    db->iptcp = db->ipudp = -1;
+    for (i = db->count - 1; i >= 0; i--) {
+	ncp = &db->entries[i].ne_nc;
+	h = nc_hash(ncp->nc_netid);
+	db->entries[i].ne_next = db->hash[h];
+	db->hash[h] = i;
+	if (strcmp(ncp->nc_protofmly, NC_INET) == 0) {
+	    if (strcmp(ncp->nc_proto, NC_TCP) == 0)
+		db->iptcp = i;
+	    else if (strcmp(ncp->nc_proto, NC_UDP) == 0)
+		db->ipudp = i;
+	}
+    }
+    for (t = _RPC_VISIBLE; t < NC_NTYPES; t++) {
+	if (db->count == 0)
+	    break;
+	if ((db->types[t] = (int *)malloc((size_t)db->count *
+		sizeof (int))) == NULL)
+	    goto nomem;
+	for (i = 0; i < db->count; i++)
+	    if (__nc_matchtype(&db->entries[i].ne_nc, t))
+		db->types[t][db->ntypes[t]++] = i;
+    }
+    return (db);
+
+nomem:
+    if (file != NULL)
+	fclose(file);
+    nc_db_free(db);
+    nc_error = NC_NOMEM;
+    return (NULL);
+}
+
+static void
+nc_db_release(db)
+	struct netconfig_db *db;
+{
+    int ref;
+
+    mutex_lock(&nc_db_lock);
+    ref = --db->ref;
+    mutex_unlock(&nc_db_lock);
+    if (ref == 0)
+	nc_db_free(db);
+}
+
+/*
+ * Returns the current snapshot, pinned, reloading it first if the
+ * file has changed.  Returns NULL and sets nc_error on failure.
+ */
+static struct netconfig_db *
+nc_db_get()
+{
+    struct netconfig_db *db, *ndb, *odb;
+    struct stat st;
+    time_t now = nc_now();
+
+    mutex_lock(&nc_db_lock);
+    if ((db = nc_db) != NULL) {
+	db->ref++;
+	if (now - nc_db_checked < NC_RECHECK) {
+	    mutex_unlock(&nc_db_lock);
+	    return (db);
+	}
+    }
+    nc_db_checked = now;
+    mutex_unlock(&nc_db_lock);
+
+    if (db != NULL) {
+	if (stat(NETCONFIG, &st) == 0 && st.st_dev == db->dev &&
+		st.st_ino == db->ino && st.st_size == db->size &&
+		st.st_mtim.tv_sec == db->mtime.tv_sec &&
+		st.st_mtim.tv_nsec == db->mtime.tv_nsec)
+	    return (db);
+	nc_db_release(db);
+    }
+
+    ndb = nc_db_load();
+    mutex_lock(&nc_db_lock);
+    odb = nc_db;
+    nc_db = ndb;
+    if (ndb != NULL)
+	ndb->ref = 2;		/* the current snapshot and our pin */
+    if (odb != NULL && --odb->ref > 0)
+	odb = NULL;
+    mutex_unlock(&nc_db_lock);
+    if (odb != NULL)
+	nc_db_free(odb);
+    return (ndb);
+}
+
+/*
+ * Returns the index of the entry for netid, or -1.
+ */
+static int
+nc_db_find(db, netid)
+	struct netconfig_db *db;
+	const char *netid;
+{
+    int i;
+
+    for (i = db->hash[nc_hash(netid)]; i >= 0;
+	    i = db->entries[i].ne_next)
+	if (strcmp(db->entries[i].ne_nc.nc_netid, netid) == 0)
+	    break;
+    return (i);
+}
+
 /*
  * A call to setnetconfig() establishes a /etc/netconfig "session".  A session
  * "handle" is returned on a successful call.  At the start of a session (after
@@ -172,7 +477,8 @@ __nc_error()
  * A new session is established with each call to setnetconfig(), with a new
  * handle being returned on each call.  Previously established sessions remain
  * active until endnetconfig() is called with that session's handle as an
- * argument.
+ * argument.  A session keeps seeing the database as it was when the session
+ * was established, even if /etc/netconfig changes in the meantime.
  *
  * setnetconfig() need *not* be called before a call to getnetconfigent().
  * setnetconfig() returns a NULL pointer on failure (for example, if
@@ -187,25 +493,34 @@ setnetconfig()
 		(struct netconfig_vars))) == NULL) {
 	return(NULL);
     }
+    if ((nc_vars->db = nc_db_get()) == NULL) {
+	free(nc_vars);
+	return (NULL);
+    }
+    nc_vars->valid = NC_VALID;
+    nc_vars->list = NULL;
+    nc_vars->count = nc_vars->db->count;
+    nc_vars->pos = 0;
+    return ((void *)nc_vars);
+}
 
-    /*
-     * For multiple calls, i.e. nc_file is not NULL, we just return the
-     * handle without reopening the netconfig db.
-     */
-    mutex_lock(&nc_db_lock);
-    ni.ref++;
-    if ((nc_file != NULL) || (nc_file = fopen(NETCONFIG, "r")) != NULL) {
-	nc_vars->valid = NC_VALID;
-	nc_vars->flag = 0;
-	nc_vars->nc_configs = ni.head;
-	mutex_unlock(&nc_db_lock);
-	return ((void *)nc_vars);
+/*
+ * Like setnetconfig(), but the session only walks the entries that belong
+ * to nettype (one of the _RPC_* values of <rpc/nettype.h>), in file order.
+ */
+void *
+__nc_setnettype(nettype)
+	int nettype;
+{
+    struct netconfig_vars *nc_vars;
+
+    if ((nc_vars = (struct netconfig_vars *)setnetconfig()) == NULL)
+	return (NULL);
+    if (nettype >= _RPC_VISIBLE && nettype < NC_NTYPES) {
+	nc_vars->list = nc_vars->db->types[nettype];
+	nc_vars->count = nc_vars->db->ntypes[nettype];
     }
-    ni.ref--;
-    mutex_unlock(&nc_db_lock);
-    nc_error = NC_NONETCONFIG;
-    free(nc_vars);
-    return (NULL);
+    return ((void *)nc_vars);
 }
 
 
@@ -222,128 +537,20 @@ getnetconfig(handlep)
 void *handlep;
 {
     struct netconfig_vars *ncp = (struct netconfig_vars *)handlep;
-    char *stringp;		/* tmp string pointer */
-    struct netconfig_list	*list;
-    struct netconfig *np;
-    struct netconfig *result;
+    int i;
 
     /*
      * Verify that handle is valid
      */
-    mutex_lock(&nc_db_lock);
-    if (ncp == NULL || nc_file == NULL) {
+    if (ncp == NULL || ncp->valid != NC_VALID) {
 	nc_error = NC_NOTINIT;
-	mutex_unlock(&nc_db_lock);
 	return (NULL);
     }
-
-    switch (ncp->valid) {
-    case NC_VALID:
-	/*
-	 * If entry has already been read into the list,
-	 * we return the entry in the linked list.
-	 * If this is the first time call, check if there are any entries in
-	 * linked list.  If no entries, we need to read the netconfig db.
-	 * If we have been here and the next entry is there, we just return
-	 * it.
-	 */
-	if (ncp->flag == 0) {	/* first time */
-	    ncp->flag = 1;
-	    ncp->nc_configs = ni.head;
-	    if (ncp->nc_configs != NULL)	/* entry already exist */ {
-		mutex_unlock(&nc_db_lock);
-		return(ncp->nc_configs->ncp);
-		}
-	}
-	else if (ncp->nc_configs != NULL && ncp->nc_configs->next != NULL) {
-	    ncp->nc_configs = ncp->nc_configs->next;
-	    mutex_unlock(&nc_db_lock);
-	    return(ncp->nc_configs->ncp);
-	}
-
-	/*
-	 * If we cannot find the entry in the list and is end of file,
-	 * we give up.
-	 */
-	if (ni.eof == 1) {
-	    mutex_unlock(&nc_db_lock);
-	    return(NULL);
-	}
-	break;
-    default:
-	nc_error = NC_NOTINIT;
-	mutex_unlock(&nc_db_lock);
-	return (NULL);
-    }
-
-    stringp = (char *) malloc(MAXNETCONFIGLINE);
-    if (stringp == NULL) {
-    mutex_unlock(&nc_db_lock);
-    return (NULL);
-    }
-
-#ifdef MEM_CHK
-    if (malloc_verify() == 0) {
-	fprintf(stderr, "memory heap corrupted in getnetconfig\n");
-	exit(1);
-    }
-#endif
-
-    /*
-     * Read a line from netconfig file.
-     */
-    do {
-	if (fgets(stringp, MAXNETCONFIGLINE, nc_file) == NULL) {
-	    free(stringp);
-	    ni.eof = 1;
-	    mutex_unlock(&nc_db_lock);
-	    return (NULL);
-        }
-    } while (*stringp == '#');
-
-    list = (struct netconfig_list *) malloc(sizeof (struct netconfig_list));
-    if (list == NULL) {
-    	free(stringp);
-		mutex_unlock(&nc_db_lock);
-    	return(NULL);
-    }
-    np = (struct netconfig *) malloc(sizeof (struct netconfig));
-    if (np == NULL) {
-    	free(stringp);
-		free(list);
-		mutex_unlock(&nc_db_lock);
-    	return(NULL);
-    }
-    list->ncp = np;
-    list->next = NULL;
-    list->ncp->nc_lookups = NULL;
-    list->linep = stringp;
-    if (parse_ncp(stringp, list->ncp) == -1) {
-	free(stringp);
-	free(np);
-	free(list);
-	mutex_unlock(&nc_db_lock);
+    if (ncp->pos >= ncp->count)
 	return (NULL);
-    }
-    else {
-	/*
-	 * If this is the first entry that's been read, it is the head of
-	 * the list.  If not, put the entry at the end of the list.
-	 * Reposition the current pointer of the handle to the last entry
-	 * in the list.
-	 */
-	if (ni.head == NULL) {	/* first entry */
-	    ni.head = ni.tail = list;
-	}
-    	else {
-    	    ni.tail->next = list;
-    	    ni.tail = ni.tail->next;
-    	}
-	ncp->nc_configs = ni.tail;
-	result = ni.tail->ncp;
-	mutex_unlock(&nc_db_lock);
-	return result;
-    }
+    i = ncp->list != NULL ? ncp->list[ncp->pos] : ncp->pos;
+    ncp->pos++;
+    return (&ncp->db->entries[i].ne_nc);
 }
 
 /*
@@ -359,8 +566,6 @@ void *handlep;
 {
     struct netconfig_vars *nc_handlep = (struct netconfig_vars *)handlep;
 
-    struct netconfig_list *q, *p;
-
     /*
      * Verify that handle is valid
      */
@@ -371,40 +576,12 @@ void *handlep;
     }
 
     /*
-     * Return 0 if anyone still needs it.
+     * Drop our pin; the snapshot goes away with the last one once
+     * it is no longer current.
      */
     nc_handlep->valid = NC_INVALID;
-    nc_handlep->flag = 0;
-    nc_handlep->nc_configs = NULL;
-    mutex_lock(&nc_db_lock);
-    if (--ni.ref > 0) {
-	mutex_unlock(&nc_db_lock);
-	free(nc_handlep);
-	return(0);
-    }
-
-    /*
-     * Noone needs these entries anymore, then frees them.
-     * Make sure all info in netconfig_info structure has been reinitialized.
-     */
-    q = p = ni.head;
-    ni.eof = ni.ref = 0;
-    ni.head = NULL;
-    ni.tail = NULL;
-    while (q) {
-	p = q->next;
-	if (q->ncp->nc_lookups != NULL) free(q->ncp->nc_lookups);
-	free(q->ncp);
-	free(q->linep);
-	free(q);
-	q = p;
-    }
+    nc_db_release(nc_handlep->db);
     free(nc_handlep);
-    if(nc_file != NULL) {
-        fclose(nc_file);
-    }
-    nc_file = NULL;
-    mutex_unlock(&nc_db_lock);
     return (0);
 }
 
@@ -420,11 +597,9 @@ struct netconfig *
 getnetconfigent(netid)
 	const char *netid;
 {
-    FILE *file;		/* NETCONFIG db's file pointer */
-    char *linep;	/* holds current netconfig line */
-    char *stringp;	/* temporary string pointer */
+    struct netconfig_db *db;
     struct netconfig *ncp = NULL;   /* returned value */
-    struct netconfig_list *list;	/* pointer to cache list */
+    int i;
 
     nc_error = NC_NOTFOUND;	/* default error. */
     if (netid == NULL || strlen(netid) == 0) {
@@ -438,78 +613,41 @@ getnetconfigent(netid)
 	fprintf(stderr, "or run mergemaster(8).\n");
     }
 
-    /*
-     * Look up table if the entries have already been read and parsed in
-     * getnetconfig(), then copy this entry into a buffer and return it.
-     * If we cannot find the entry in the current list and there are more
-     * entries in the netconfig db that has not been read, we then read the
-     * db and try find the match netid.
-     * If all the netconfig db has been read and placed into the list and
-     * there is no match for the netid, return NULL.
-     */
-    mutex_lock(&nc_db_lock);
-    if (ni.head != NULL) {
-	for (list = ni.head; list; list = list->next) {
-	    if (strcmp(list->ncp->nc_netid, netid) == 0) {
-			ncp = dup_ncp(list->ncp);
-			mutex_unlock(&nc_db_lock);
-			return ncp;
-	    }
-	}
-        if (ni.eof == 1) {	/* that's all the entries */
-	    	mutex_unlock(&nc_db_lock);
-	    	return(NULL);
-        }
-    }
-    mutex_unlock(&nc_db_lock);
-
-    if ((file = fopen(NETCONFIG, "r")) == NULL) {
-	nc_error = NC_NONETCONFIG;
+    if ((db = nc_db_get()) == NULL)
 	return (NULL);
-    }
-
-    if ((linep = malloc(MAXNETCONFIGLINE)) == NULL) {
-	fclose(file);
+    if ((i = nc_db_find(db, netid)) >= 0 &&
+	    (ncp = dup_ncp(&db->entries[i].ne_nc)) == NULL)
 	nc_error = NC_NOMEM;
-	return (NULL);
-    }
-    do {
-	ptrdiff_t len;
-	char *tmpp;	/* tmp string pointer */
-
-	do {
-	    if ((stringp = fgets(linep, MAXNETCONFIGLINE, file)) == NULL) {
-		break;
-	    }
-	} while (*stringp == '#');
-	if (stringp == NULL) {	    /* eof */
-	    break;
-	}
-	if ((tmpp = strpbrk(stringp, "\t ")) == NULL) {	/* can't parse file */
-	    nc_error = NC_BADFILE;
-	    break;
-	}
-	if (strlen(netid) == (size_t) (len = tmpp - stringp) &&	/* a match */
-		strncmp(stringp, netid, (size_t)len) == 0) {
-	    if ((ncp = (struct netconfig *)
-		    malloc(sizeof (struct netconfig))) == NULL) {
-		break;
-	    }
-	    ncp->nc_lookups = NULL;
-	    if (parse_ncp(linep, ncp) == -1) {
-		free(ncp);
-		ncp = NULL;
-	    }
-	    break;
-	}
-    } while (stringp != NULL);
-    if (ncp == NULL) {
-	free(linep);
-    }
-    fclose(file);
+    nc_db_release(db);
     return(ncp);
 }
 
+/*
+ * Returns a copy of the first inet entry of the given protocol (NC_TCP or
+ * NC_UDP), or NULL.  The copy should be freed by freenetconfigent().
+ */
+struct netconfig *
+__nc_getconfip(proto)
+	const char *proto;
+{
+    struct netconfig_db *db;
+    struct netconfig *ncp = NULL;
+    int i;
+
+    if ((db = nc_db_get()) == NULL)
+	return (NULL);
+    if (strcmp(proto, NC_TCP) == 0)
+	i = db->iptcp;
+    else if (strcmp(proto, NC_UDP) == 0)
+	i = db->ipudp;
+    else
+	i = -1;
+    if (i >= 0)
+	ncp = dup_ncp(&db->entries[i].ne_nc);
+    nc_db_release(db);
+    return (ncp);
+}
+
 /*
  * freenetconfigent(netconfigp) frees the netconfig structure pointed to by
  * netconfigp (previously returned by getnetconfigent()).
@@ -549,7 +687,8 @@ struct netconfig *ncp;	/* where to put results */
     char    *lasts;
 
     nc_error = NC_BADFILE;	/* nearly anything that breaks is for this reason */
-    stringp[strlen(stringp)-1] = '\0';	/* get rid of newline */
+    if ((tokenp = strchr(stringp, '\n')) != NULL)
+	*tokenp = '\0';	/* get rid of newline */
     /* netid */
     if ((ncp->nc_netid = strtok_r(stringp, "\t ", &lasts)) == NULL) {
 	return (-1);
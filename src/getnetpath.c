@@ -30,6 +30,8 @@
  * Copyright (c) 1989 by Sun Microsystems, Inc.
  */
 
+#include <pthread.h>
+#include <reentrant.h>
 #include <stdio.h>
 #include <errno.h>
 #include <netconfig.h>
@@ -45,13 +47,25 @@ struct netpath_chain {
     struct netpath_chain *nchain_next;	/* next nconf entry allocated */
 };
 
+/*
+ * NETPATH split into its netids.  The last parse is kept and shared by
+ * all sessions for as long as the variable does not change.
+ */
+struct netpath_cache {
+    int   ref;		    /* # of sessions using it, plus np_cache */
+    char *env;		    /* NETPATH value it was parsed from */
+    char *buf;		    /* the netids, unescaped */
+    char **netids;
+    int   count;
+};
 
 struct netpath_vars {
     int   valid;	    /* token that indicates a valid netpath_vars */
     void *nc_handlep;	    /* handle for current netconfig "session" */
-    char *netpath;	    /* pointer to current view-point in NETPATH */
-    char *netpath_start;    /* pointer to start of our copy of NETPATH */
+    struct netpath_cache *np;	/* parsed NETPATH, or NULL if not set */
+    int   pos;		    /* next netid of np to look up */
     struct netpath_chain *ncp_list;  /* list of nconfs allocated this session*/
+    struct netpath_chain *ncp_tail;  /* last entry of ncp_list */
 };
 
 #define NP_VALID	0xf00d
@@ -59,6 +73,81 @@ struct netpath_vars {
 
 char *_get_next_token(char *, int);
 
+static struct netpath_cache *np_cache;
+extern pthread_mutex_t np_cache_lock;
+
+static void
+np_cache_free(np)
+    struct netpath_cache *np;
+{
+    free(np->env);
+    free(np->buf);
+    free(np->netids);
+    free(np);
+}
+
+static void
+np_cache_release(np)
+    struct netpath_cache *np;
+{
+    int ref;
+
+    mutex_lock(&np_cache_lock);
+    ref = --np->ref;
+    mutex_unlock(&np_cache_lock);
+    if (ref == 0)
+	np_cache_free(np);
+}
+
+/*
+ * Returns the parsed form of the NETPATH value env, parsing it only if
+ * it differs from the last one seen.
+ */
+static struct netpath_cache *
+np_cache_get(env)
+    const char *env;
+{
+    struct netpath_cache *np, *onp;
+    char *npp, *cp;
+    int n;
+
+    mutex_lock(&np_cache_lock);
+    if ((np = np_cache) != NULL && strcmp(np->env, env) == 0) {
+	np->ref++;
+	mutex_unlock(&np_cache_lock);
+	return (np);
+    }
+    mutex_unlock(&np_cache_lock);
+
+    if ((np = (struct netpath_cache *)calloc(1, sizeof (*np))) == NULL)
+	return (NULL);
+    for (n = 1, cp = (char *)env; (cp = strchr(cp, ':')) != NULL; cp++)
+	n++;
+    if ((np->env = strdup(env)) == NULL ||
+	    (np->buf = strdup(env)) == NULL ||
+	    (np->netids = (char **)malloc(n * sizeof (char *))) == NULL) {
+	np_cache_free(np);
+	return (NULL);
+    }
+    npp = np->buf;
+    while (npp != NULL && strlen(npp) != 0) {
+	cp = _get_next_token(npp, ':');
+	np->netids[np->count++] = npp;
+	npp = cp;
+    }
+
+    mutex_lock(&np_cache_lock);
+    onp = np_cache;
+    np_cache = np;
+    np->ref = 2;		/* np_cache and the caller */
+    if (onp != NULL && --onp->ref > 0)
+	onp = NULL;
+    mutex_unlock(&np_cache_lock);
+    if (onp != NULL)
+	np_cache_free(onp);
+    return (np);
+}
+
 
 /*
  * A call to setnetpath() establishes a NETPATH "session".  setnetpath()
@@ -93,19 +182,18 @@ setnetpath()
     }
     np_sessionp->valid = NP_VALID;
     np_sessionp->ncp_list = NULL;
+    np_sessionp->ncp_tail = NULL;
+    np_sessionp->pos = 0;
     if ((npp = getenv(NETPATH)) == NULL) {
-	np_sessionp->netpath = NULL;
+	np_sessionp->np = NULL;
     } else {
 	(void) endnetconfig(np_sessionp->nc_handlep);/* won't need nc session*/
 	np_sessionp->nc_handlep = NULL;
-	if ((np_sessionp->netpath = malloc(strlen(npp)+1)) == NULL) {
+	if ((np_sessionp->np = np_cache_get(npp)) == NULL) {
 	    free(np_sessionp);
 	    return (NULL);
-	} else {
-	    (void) strcpy(np_sessionp->netpath, npp);
 	}
     }
-    np_sessionp->netpath_start = np_sessionp->netpath;
     return ((void *)np_sessionp);
 }
 
@@ -141,7 +229,7 @@ getnetpath(handlep)
 	errno = EINVAL;
 	return (NULL);
     }
-    if (np_sessionp->netpath_start == NULL) {	/* NETPATH was not set */
+    if (np_sessionp->np == NULL) {	/* NETPATH was not set */
 	do {                /* select next visible network */
 	    if (np_sessionp->nc_handlep == NULL) {
 		np_sessionp->nc_handlep = setnetconfig();
@@ -155,23 +243,28 @@ getnetpath(handlep)
 	return (ncp);
     }
     /*
-     * Find first valid network ID in netpath.
+     * Find next valid network ID in netpath.
      */
-    while ((npp = np_sessionp->netpath) != NULL && strlen(npp) != 0) {
-	np_sessionp->netpath = _get_next_token(npp, ':');
+    while (np_sessionp->pos < np_sessionp->np->count) {
+	npp = np_sessionp->np->netids[np_sessionp->pos++];
     	/*
     	 * npp is a network identifier.
 	 */
 	if ((ncp = getnetconfigent(npp)) != NULL) {
 	    chainp = (struct netpath_chain *)	/* cobble alloc chain entry */
 		    malloc(sizeof (struct netpath_chain));
+	    if (chainp == NULL) {
+		freenetconfigent(ncp);
+		return (NULL);
+	    }
 	    chainp->ncp = ncp;
 	    chainp->nchain_next = NULL;
 	    if (np_sessionp->ncp_list == NULL) {
 		np_sessionp->ncp_list = chainp;
 	    } else {
-		np_sessionp->ncp_list->nchain_next = chainp;
+		np_sessionp->ncp_tail->nchain_next = chainp;
 	    }
+	    np_sessionp->ncp_tail = chainp;
 	    return (ncp);
 	}
 	/* couldn't find this token in the database; go to next one. */
@@ -197,8 +290,8 @@ endnetpath(handlep)
     }
     if (np_sessionp->nc_handlep != NULL)
 	endnetconfig(np_sessionp->nc_handlep);
-    if (np_sessionp->netpath_start != NULL)
-	free(np_sessionp->netpath_start);
+    if (np_sessionp->np != NULL)
+	np_cache_release(np_sessionp->np);
     for (chainp = np_sessionp->ncp_list; chainp != NULL;
 	    lastp=chainp, chainp=chainp->nchain_next, free(lastp)) {
 	freenetconfigent(chainp->ncp);
@@ -45,6 +45,7 @@
 #include <string.h>
 #include <stdlib.h>
 
+#include "rpc_com.h"
 #include "debug.h"
 
 #define PKFILE "/etc/publickey"
@@ -54,6 +55,8 @@
  */
 int (*__getpublickey_LOCAL)() = 0;
 
+static int getkeys(char *, char *, size_t);
+
 /*
  * Get somebody's public key
  */
@@ -67,7 +70,7 @@ __getpublickey_real(netname, publickey)
 
 	if (publickey == NULL)
 		return (0);
-	if (!getpublicandprivatekey(netname, lookup))
+	if (!getkeys(netname, lookup, sizeof (lookup)))
 		return (0);
 	p = strchr(lookup, ':');
 	if (p == NULL) {
@@ -80,83 +83,68 @@ __getpublickey_real(netname, publickey)
 }
 
 /*
- * reads the file /etc/publickey looking for a + to optionally go to the
- * yellow pages
+ * looks the key up in /etc/publickey, going to the yellow pages where
+ * the file has a + ahead of it
  */
 
+static struct __rpc_keyfile pkfile = { PKFILE, NULL };
+
 int
 getpublicandprivatekey(key, ret)
 	char *key;
 	char *ret;
 {
-	char buf[1024];	/* big enough */
-	char *res;
-	FILE *fd;
-	char *mkey;
-	char *mval;
+	/* The interface gives no length; callers have always passed 1024. */
+	return (getkeys(key, ret, 1024));
+}
+
+/* As getpublicandprivatekey(), into the retlen bytes at ret. */
+static int
+getkeys(key, ret, retlen)
+	char *key;
+	char *ret;
+	size_t retlen;
+{
+	bool_t plus;
+	int found;
 
-	fd = fopen(PKFILE, "r");
-	if (fd == NULL)
+	found = __rpc_keyfile_lookup(&pkfile, key, ret, retlen, &plus);
+	if (found < 0)
 		return (0);
-	for (;;) {
-		res = fgets(buf, sizeof(buf), fd);
-		if (res == NULL) {
-			fclose(fd);
-			return (0);
-		}
-		if (res[0] == '#')
-			continue;
-		else if (res[0] == '+') {
+	if (plus) {
 #ifdef YP
-			char *PKMAP = "publickey.byname";
-			char *lookup;
-			char *domain;
-			int err;
-			int len;
+		char *PKMAP = "publickey.byname";
+		char *lookup;
+		char *domain;
+		int err;
+		int len;
 
-			err = yp_get_default_domain(&domain);
-			if (err) {
-				continue;
-			}
-			lookup = NULL;
-			err = yp_match(domain, PKMAP, key, strlen(key), &lookup, &len);
-			if (err) {
-				LIBTIRPC_DEBUG(1, 
-					("getpublicandprivatekey: match failed error %d\n", err));
-				continue;
-			}
-			lookup[len] = 0;
-			strcpy(ret, lookup);
-			fclose(fd);
+		err = yp_get_default_domain(&domain);
+		if (err)
+			return (found);
+		lookup = NULL;
+		err = yp_match(domain, PKMAP, key, strlen(key), &lookup, &len);
+		if (err) {
+			LIBTIRPC_DEBUG(1, 
+				("getpublicandprivatekey: match failed error %d\n", err));
+			return (found);
+		}
+		if ((size_t)len >= retlen) {
+			LIBTIRPC_DEBUG(1, 
+				("getpublicandprivatekey: %s entry too long\n", key));
 			free(lookup);
-			return (2);
+			return (found);
+		}
+		memcpy(ret, lookup, len);
+		ret[len] = 0;
+		free(lookup);
+		return (2);
 #else /* YP */
-			LIBTIRPC_DEBUG(1, 
+		LIBTIRPC_DEBUG(1, 
 ("Bad record in %s '+' -- NIS not supported in this library copy\n", PKFILE));
-			continue;
 #endif /* YP */
-		} else {
-			mkey = strsep(&res, "\t ");
-			if (mkey == NULL) {
-				fprintf(stderr,
-				"Bad record in %s -- %s", PKFILE, buf);
-				continue;
-			}
-			do {
-				mval = strsep(&res, " \t#\n");
-			} while (mval != NULL && !*mval);
-			if (mval == NULL) {
-				fprintf(stderr,
-			"Bad record in %s val problem - %s", PKFILE, buf);
-				continue;
-			}
-			if (strcmp(mkey, key) == 0) {
-				strcpy(ret, mval);
-				fclose(fd);
-				return (1);
-			}
-		}
 	}
+	return (found);
 }
 
 int getpublickey(netname, publickey)
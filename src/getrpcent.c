@@ -35,6 +35,7 @@
 #endif
 
 #include <sys/types.h>
+#include <sys/stat.h>
 
 #include <netinet/in.h>
 #include <arpa/inet.h>
@@ -44,6 +45,9 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <reentrant.h>
 
 #include <rpc/rpc.h>
 #ifdef YP
@@ -79,6 +83,7 @@ static struct rpcdata {
 } *rpcdata;
 
 static	struct rpcent *interpret(char *val, size_t len);
+static	int parse_rpcent(char *, struct rpcent *, char **);
 
 #ifdef	YP
 static int	__yp_nomap = 0;
@@ -100,6 +105,260 @@ _rpcdata()
 	return (d);
 }
 
+#if !HAVE_GETRPCBYNUMBER || !HAVE_GETRPCBYNAME
+/*
+ * getrpcbynumber() and getrpcbyname() are answered from a process-wide
+ * index of RPCDB, built on first use and rebuilt when the file's
+ * identity or modification time changes (checked at most every
+ * RPCDB_RECHECK seconds).  The index hashes entries by number and by
+ * name and alias; the first entry of the file wins, as it did with a
+ * sequential scan.  A missing RPCDB is remembered like a file with no
+ * entries.  Lookups share the index under a read lock; the entry found
+ * is copied into rpcdata, so callers see the same storage as before.
+ *
+ * This serves only C libraries that lack these functions (configure
+ * checks for them); glibc's own getrpcbyname() and getrpcbynumber()
+ * are used where they exist.
+ */
+#define	RPCDB_HASHSIZE	128
+#define	RPCDB_RECHECK	1	/* seconds between stat()s of RPCDB */
+
+struct rpcdb_entry {
+	struct	rpcent re_rpc;		/* points into re_line */
+	char	*re_line;		/* the line, split in place */
+	size_t	re_len;
+	int	re_next;		/* next entry in number chain, or -1 */
+};
+
+struct rpcdb_name {
+	const char *rn_name;		/* name or alias of rn_entry */
+	int	rn_entry;
+	int	rn_next;		/* next name in chain, or -1 */
+};
+
+static struct rpcdb_index {
+	dev_t	dev;			/* identity of the indexed file */
+	ino_t	ino;
+	off_t	size;
+	struct	timespec mtime;
+	time_t	checked;		/* when RPCDB was last stat()ed */
+	bool_t	missing;		/* there was no file */
+	int	count;
+	struct	rpcdb_entry *entries;
+	int	nnames;
+	struct	rpcdb_name *names;
+	int	bynumber[RPCDB_HASHSIZE];
+	int	byname[RPCDB_HASHSIZE];
+} *rpcdb;
+extern pthread_rwlock_t rpcdb_lock;
+
+static u_int
+rpcdb_hash(name)
+	const char *name;
+{
+	u_int h = 2166136261U;
+
+	while (*name)
+		h = (h ^ (u_char)*name++) * 16777619U;
+	return (h % RPCDB_HASHSIZE);
+}
+
+static void
+rpcdb_free(db)
+	struct rpcdb_index *db;
+{
+	int i;
+
+	for (i = 0; i < db->count; i++) {
+		free(db->entries[i].re_rpc.r_aliases);
+		free(db->entries[i].re_line);
+	}
+	free(db->entries);
+	free(db->names);
+	free(db);
+}
+
+static void
+rpcdb_addname(db, n, name, entry)
+	struct rpcdb_index *db;
+	int n;
+	const char *name;
+	int entry;
+{
+	struct rpcdb_name *rn = &db->names[n];
+	u_int h = rpcdb_hash(name);
+
+	rn->rn_name = name;
+	rn->rn_entry = entry;
+	rn->rn_next = db->byname[h];
+	db->byname[h] = n;
+}
+
+static struct rpcdb_index *
+rpcdb_load()
+{
+	FILE *f;
+	struct stat st;
+	struct rpcdb_index *db;
+	struct rpcdb_entry *re;
+	char *aliases[MAXALIASES];
+	char line[BUFSIZ+1];
+	int i, k, n, size;
+	u_int h;
+
+	if ((db = (struct rpcdb_index *)calloc(1, sizeof (*db))) == NULL)
+		return (NULL);
+	for (h = 0; h < RPCDB_HASHSIZE; h++)
+		db->bynumber[h] = db->byname[h] = -1;
+	if ((f = fopen(RPCDB, "r")) == NULL) {
+		db->missing = TRUE;
+		return (db);
+	}
+	if (fstat(fileno(f), &st) == -1) {
+		fclose(f);
+		free(db);
+		return (NULL);
+	}
+	db->dev = st.st_dev;
+	db->ino = st.st_ino;
+	db->size = st.st_size;
+	db->mtime = st.st_mtim;
+	size = 0;
+	while (fgets(line, BUFSIZ - 1, f) != NULL) {
+		if (db->count == size) {
+			size = size ? size * 2 : 64;
+			re = (struct rpcdb_entry *)realloc(db->entries,
+			    (size_t)size * sizeof (*re));
+			if (re == NULL)
+				goto nomem;
+			db->entries = re;
+		}
+		re = &db->entries[db->count];
+		re->re_len = strlen(line);
+		/* a last line without its newline still counts */
+		if (re->re_len == 0 || line[re->re_len - 1] != '\n') {
+			line[re->re_len++] = '\n';
+			line[re->re_len] = '\0';
+		}
+		if ((re->re_line = malloc(re->re_len + 1)) == NULL)
+			goto nomem;
+		memcpy(re->re_line, line, re->re_len + 1);
+		if (parse_rpcent(re->re_line, &re->re_rpc, aliases) == -1) {
+			free(re->re_line);
+			continue;
+		}
+		for (n = 0; aliases[n] != NULL; n++)
+			;
+		re->re_rpc.r_aliases = (char **)malloc((n + 1) *
+		    sizeof (char *));
+		if (re->re_rpc.r_aliases == NULL) {
+			free(re->re_line);
+			goto nomem;
+		}
+		memcpy(re->re_rpc.r_aliases, aliases, (n + 1) * sizeof (char *));
+		db->count++;
+		db->nnames += n + 1;
+	}
+	fclose(f);
+	f = NULL;
+
+	if (db->nnames > 0 && (db->names = (struct rpcdb_name *)malloc(
+	    (size_t)db->nnames * sizeof (struct rpcdb_name))) == NULL)
+		goto nomem;
+	/*
+	 * Chains are built back to front so that the first entry of the
+	 * file ends up at the head of each chain.
+	 */
+	n = db->nnames;
+	for (i = db->count - 1; i >= 0; i--) {
+		re = &db->entries[i];
+		h = (u_int)re->re_rpc.r_number % RPCDB_HASHSIZE;
+		re->re_next = db->bynumber[h];
+		db->bynumber[h] = i;
+		for (k = 0; re->re_rpc.r_aliases[k] != NULL; k++)
+			;
+		while (k-- > 0)
+			rpcdb_addname(db, --n, re->re_rpc.r_aliases[k], i);
+		rpcdb_addname(db, --n, re->re_rpc.r_name, i);
+	}
+	return (db);
+
+nomem:
+	if (f != NULL)
+		fclose(f);
+	rpcdb_free(db);
+	return (NULL);
+}
+
+/*
+ * Returns the current index, rebuilding it if RPCDB changed.
+ * Called with rpcdb_lock held for writing.
+ */
+static struct rpcdb_index *
+rpcdb_get(now)
+	time_t now;
+{
+	struct rpcdb_index *db = rpcdb;
+	struct stat st;
+	int err;
+
+	if (db != NULL) {
+		if (now - db->checked < RPCDB_RECHECK)
+			return (db);
+		db->checked = now;
+		err = stat(RPCDB, &st);
+		if (db->missing ? err == -1 :
+		    err == 0 && st.st_dev == db->dev &&
+		    st.st_ino == db->ino && st.st_size == db->size &&
+		    st.st_mtim.tv_sec == db->mtime.tv_sec &&
+		    st.st_mtim.tv_nsec == db->mtime.tv_nsec)
+			return (db);
+		rpcdb_free(db);
+	}
+	if ((rpcdb = db = rpcdb_load()) != NULL)
+		db->checked = now;
+	return (db);
+}
+
+/*
+ * Returns the current index with rpcdb_lock held, for reading unless
+ * it is due to be checked against RPCDB.  The caller unlocks.
+ */
+static struct rpcdb_index *
+rpcdb_hold()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	rwlock_rdlock(&rpcdb_lock);
+	if (rpcdb != NULL && ts.tv_sec - rpcdb->checked < RPCDB_RECHECK)
+		return (rpcdb);
+	rwlock_unlock(&rpcdb_lock);
+	rwlock_wrlock(&rpcdb_lock);
+	return (rpcdb_get(ts.tv_sec));
+}
+
+/*
+ * Copies entry re of the index into the static rpcdata.
+ */
+static struct rpcent *
+rpcdb_copy(d, re)
+	struct rpcdata *d;
+	struct rpcdb_entry *re;
+{
+	char **rp, **q;
+
+	memcpy(d->line, re->re_line, re->re_len + 1);
+	d->rpc.r_name = d->line + (re->re_rpc.r_name - re->re_line);
+	d->rpc.r_number = re->re_rpc.r_number;
+	q = d->rpc.r_aliases = d->rpc_aliases;
+	for (rp = re->re_rpc.r_aliases; *rp != NULL; rp++)
+		*q++ = d->line + (*rp - re->re_line);
+	*q = NULL;
+	return (&d->rpc);
+}
+#endif /* !HAVE_GETRPCBYNUMBER || !HAVE_GETRPCBYNAME */
+
 #if !HAVE_GETRPCBYNUMBER
 struct rpcent *
 getrpcbynumber(number)
@@ -111,6 +370,8 @@ getrpcbynumber(number)
 #endif
 	struct rpcent *p;
 	struct rpcdata *d = _rpcdata();
+	struct rpcdb_index *db;
+	int i;
 
 	if (d == 0)
 		return (0);
@@ -138,12 +399,17 @@ getrpcbynumber(number)
 no_yp:
 #endif	/* YP */
 
-	setrpcent(0);
-	while ((p = getrpcent()) != NULL) {
-		if (p->r_number == number)
-			break;
+	p = NULL;
+	if ((db = rpcdb_hold()) != NULL && !db->missing) {
+		for (i = db->bynumber[(u_int)number % RPCDB_HASHSIZE]; i >= 0;
+		    i = db->entries[i].re_next) {
+			if (db->entries[i].re_rpc.r_number == number) {
+				p = rpcdb_copy(d, &db->entries[i]);
+				break;
+			}
+		}
 	}
-	endrpcent();
+	rwlock_unlock(&rpcdb_lock);
 	return (p);
 }
 #endif /* !HAVE_GETRPCBYNUMBER */
@@ -154,21 +420,25 @@ getrpcbyname(name)
 	const char *name;
 {
 	struct rpcent *rpc = NULL;
-	char **rp;
+	struct rpcdata *d = _rpcdata();
+	struct rpcdb_index *db;
+	int n;
 
 	assert(name != NULL);
 
-	setrpcent(0);
-	while ((rpc = getrpcent()) != NULL) {
-		if (strcmp(rpc->r_name, name) == 0)
-			goto done;
-		for (rp = rpc->r_aliases; *rp != NULL; rp++) {
-			if (strcmp(*rp, name) == 0)
-				goto done;
+	if (d == 0)
+		return (0);
+	if ((db = rpcdb_hold()) != NULL && !db->missing) {
+		for (n = db->byname[rpcdb_hash(name)]; n >= 0;
+		    n = db->names[n].rn_next) {
+			if (strcmp(db->names[n].rn_name, name) == 0) {
+				rpc = rpcdb_copy(d,
+				    &db->entries[db->names[n].rn_entry]);
+				break;
+			}
 		}
 	}
-done:
-	endrpcent();
+	rwlock_unlock(&rpcdb_lock);
 	return (rpc);
 }
 #endif /* !HAVE_GETRPCBYNAME */
@@ -284,33 +554,49 @@ interpret(val, len)
 	size_t len;
 {
 	struct rpcdata *d = _rpcdata();
-	char *p;
-	char *cp, **q;
 
 	assert(val != NULL);
 
 	if (d == 0)
 		return (0);
-	(void) strncpy(d->line, val, BUFSIZ);
+	if (val != d->line)
+		(void) strncpy(d->line, val, BUFSIZ);
 	d->line[BUFSIZ] = '\0';
-	p = d->line;
-	p[len] = '\n';
-	if (*p == '#')
+	d->line[len] = '\n';
+	if (parse_rpcent(d->line, &d->rpc, d->rpc_aliases) == -1)
 		return (getrpcent());
+	return (&d->rpc);
+}
+
+/*
+ * Splits an RPCDB line in place into rpc, whose aliases are stored in
+ * the MAXALIASES slots of aliases.  Returns -1 if the line holds no
+ * entry.
+ */
+static int
+parse_rpcent(p, rpc, aliases)
+	char *p;
+	struct rpcent *rpc;
+	char **aliases;
+{
+	char *cp, **q;
+
+	if (*p == '#')
+		return (-1);
 	cp = strpbrk(p, "#\n");
 	if (cp == NULL)
-		return (getrpcent());
+		return (-1);
 	*cp = '\0';
 	cp = strpbrk(p, " \t");
 	if (cp == NULL)
-		return (getrpcent());
+		return (-1);
 	*cp++ = '\0';
 	/* THIS STUFF IS INTERNET SPECIFIC */
-	d->rpc.r_name = d->line;
+	rpc->r_name = p;
 	while (*cp == ' ' || *cp == '\t')
 		cp++;
-	d->rpc.r_number = atoi(cp);
-	q = d->rpc.r_aliases = d->rpc_aliases;
+	rpc->r_number = atoi(cp);
+	q = rpc->r_aliases = aliases;
 	cp = strpbrk(cp, " \t");
 	if (cp != NULL)
 		*cp++ = '\0';
@@ -319,14 +605,14 @@ interpret(val, len)
 			cp++;
 			continue;
 		}
-		if (q < &(d->rpc_aliases[MAXALIASES - 1]))
+		if (q < &aliases[MAXALIASES - 1])
 			*q++ = cp;
 		cp = strpbrk(cp, " \t");
 		if (cp != NULL)
 			*cp++ = '\0';
 	}
 	*q = NULL;
-	return (&d->rpc);
+	return (0);
 }
 
 #endif
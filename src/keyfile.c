@@ -0,0 +1,266 @@
+/*
+ * Copyright (c) 2009, Sun Microsystems, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * - Neither the name of Sun Microsystems, Inc. nor the names of its
+ *   contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * keyfile.c, indexes of the "name value" files behind the netname and
+ * public key routines, /etc/publickey and /etc/netid.
+ *
+ * Each file is read into a process-wide index on first use and read
+ * again when its identity or modification time changes (checked at
+ * most every KEYFILE_RECHECK seconds).  The index hashes records by
+ * name; the first record of the file wins, as it did with a sequential
+ * scan, and a "+" record ahead of it is reported so that the caller
+ * can consult NIS first.
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <pthread.h>
+#include <reentrant.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <rpc/rpc.h>
+#include "rpc_com.h"
+
+#define	KEYFILE_HASHSIZE	256
+#define	KEYFILE_RECHECK		1	/* seconds between stat()s */
+
+struct keyfile_entry {
+	char	*ke_name;		/* "name\0value\0" */
+	char	*ke_value;
+	int	ke_line;
+	int	ke_next;		/* next entry in chain, or -1 */
+};
+
+struct keyfile_index {
+	bool_t	missing;		/* there was no file */
+	dev_t	dev;			/* identity of the indexed file */
+	ino_t	ino;
+	off_t	size;
+	struct	timespec mtime;
+	time_t	checked;		/* when the file was last stat()ed */
+	int	plus;			/* line of the first "+", or 0 */
+	int	count;
+	struct	keyfile_entry *entries;
+	int	byname[KEYFILE_HASHSIZE];
+};
+
+extern pthread_mutex_t keyfile_lock;
+
+static u_int
+keyfile_hash(name)
+	const char *name;
+{
+	u_int h = 2166136261U;
+
+	while (*name)
+		h = (h ^ (u_char)*name++) * 16777619U;
+	return (h % KEYFILE_HASHSIZE);
+}
+
+static void
+keyfile_free(idx)
+	struct keyfile_index *idx;
+{
+	int i;
+
+	for (i = 0; i < idx->count; i++)
+		free(idx->entries[i].ke_name);
+	free(idx->entries);
+	free(idx);
+}
+
+static struct keyfile_index *
+keyfile_load(path)
+	const char *path;
+{
+	FILE *f;
+	struct stat st;
+	struct keyfile_index *idx;
+	struct keyfile_entry *ke;
+	char buf[1024];	/* big enough */
+	char *res, *mkey, *mval;
+	size_t klen, vlen;
+	int i, line, size;
+	u_int h;
+
+	if ((idx = (struct keyfile_index *)calloc(1, sizeof (*idx))) == NULL)
+		return (NULL);
+	for (h = 0; h < KEYFILE_HASHSIZE; h++)
+		idx->byname[h] = -1;
+	if ((f = fopen(path, "r")) == NULL) {
+		idx->missing = TRUE;
+		return (idx);
+	}
+	if (fstat(fileno(f), &st) == -1) {
+		fclose(f);
+		free(idx);
+		return (NULL);
+	}
+	idx->dev = st.st_dev;
+	idx->ino = st.st_ino;
+	idx->size = st.st_size;
+	idx->mtime = st.st_mtim;
+	size = 0;
+	for (line = 1; (res = fgets(buf, sizeof(buf), f)) != NULL; line++) {
+		if (res[0] == '#')
+			continue;
+		if (res[0] == '+') {
+			if (idx->plus == 0)
+				idx->plus = line;
+			continue;
+		}
+		mkey = strsep(&res, "\t ");
+		if (mkey == NULL) {
+			fprintf(stderr, "Bad record in %s -- %s", path, buf);
+			continue;
+		}
+		do {
+			mval = strsep(&res, " \t#\n");
+		} while (mval != NULL && !*mval);
+		if (mval == NULL) {
+			fprintf(stderr,
+			    "Bad record in %s val problem - %s", path, buf);
+			continue;
+		}
+		if (idx->count == size) {
+			size = size ? size * 2 : 64;
+			ke = (struct keyfile_entry *)realloc(idx->entries,
+			    (size_t)size * sizeof (*ke));
+			if (ke == NULL)
+				goto nomem;
+			idx->entries = ke;
+		}
+		ke = &idx->entries[idx->count];
+		klen = strlen(mkey) + 1;
+		vlen = strlen(mval) + 1;
+		if ((ke->ke_name = malloc(klen + vlen)) == NULL)
+			goto nomem;
+		memcpy(ke->ke_name, mkey, klen);
+		ke->ke_value = ke->ke_name + klen;
+		memcpy(ke->ke_value, mval, vlen);
+		ke->ke_line = line;
+		idx->count++;
+	}
+	fclose(f);
+
+	/*
+	 * Chains are built back to front so that the first record of the
+	 * file ends up at the head of each chain.
+	 */
+	for (i = idx->count - 1; i >= 0; i--) {
+		ke = &idx->entries[i];
+		h = keyfile_hash(ke->ke_name);
+		ke->ke_next = idx->byname[h];
+		idx->byname[h] = i;
+	}
+	return (idx);
+
+nomem:
+	fclose(f);
+	keyfile_free(idx);
+	return (NULL);
+}
+
+/*
+ * Returns the current index of kf, rebuilding it if the file changed.
+ * Called with keyfile_lock held.
+ */
+static struct keyfile_index *
+keyfile_get(kf)
+	struct __rpc_keyfile *kf;
+{
+	struct keyfile_index *idx = kf->kf_index;
+	struct timespec ts;
+	struct stat st;
+	int err;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	if (idx != NULL) {
+		if (ts.tv_sec - idx->checked < KEYFILE_RECHECK)
+			return (idx);
+		idx->checked = ts.tv_sec;
+		err = stat(kf->kf_path, &st);
+		if (idx->missing ? err == -1 :
+		    err == 0 && st.st_dev == idx->dev &&
+		    st.st_ino == idx->ino && st.st_size == idx->size &&
+		    st.st_mtim.tv_sec == idx->mtime.tv_sec &&
+		    st.st_mtim.tv_nsec == idx->mtime.tv_nsec)
+			return (idx);
+		keyfile_free(idx);
+	}
+	if ((kf->kf_index = idx = keyfile_load(kf->kf_path)) != NULL)
+		idx->checked = ts.tv_sec;
+	return (idx);
+}
+
+/*
+ * Looks name up in kf, copying its value (truncated to retlen) into
+ * ret.  Returns 1 if found, 0 if not and -1 if the file could not be
+ * read.  *plusp says whether a "+" record comes before the one found,
+ * or anywhere if there is none.
+ */
+int
+__rpc_keyfile_lookup(kf, name, ret, retlen, plusp)
+	struct __rpc_keyfile *kf;
+	const char *name;
+	char *ret;
+	size_t retlen;
+	bool_t *plusp;
+{
+	struct keyfile_index *idx;
+	struct keyfile_entry *ke = NULL;
+	size_t len;
+	int i, found = -1;
+
+	*plusp = FALSE;
+	mutex_lock(&keyfile_lock);
+	if ((idx = keyfile_get(kf)) != NULL && !idx->missing) {
+		for (i = idx->byname[keyfile_hash(name)]; i >= 0;
+		    i = ke->ke_next) {
+			ke = &idx->entries[i];
+			if (strcmp(ke->ke_name, name) == 0)
+				break;
+		}
+		found = i >= 0;
+		if (found) {
+			len = strlen(ke->ke_value);
+			if (len >= retlen)
+				len = retlen - 1;
+			memcpy(ret, ke->ke_value, len);
+			ret[len] = '\0';
+		}
+		*plusp = idx->plus != 0 &&
+		    (!found || idx->plus < ke->ke_line);
+	}
+	mutex_unlock(&keyfile_lock);
+	return (found);
+}
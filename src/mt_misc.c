@@ -15,6 +15,9 @@ pthread_rwlock_t	svc_fd_lock = PTHREAD_RWLOCK_INITIALIZER;
 /* protects the RPCBIND address cache */
 pthread_mutex_t	rpcbaddr_cache_lock = PTHREAD_MUTEX_INITIALIZER;
 
+/* protects the pool of RPCBIND client handles (rpcb_clnt.c) */
+pthread_mutex_t	rpcbhandle_lock = PTHREAD_MUTEX_INITIALIZER;
+
 /* protects authdes cache (svcauth_des.c) */
 pthread_mutex_t	authdes_lock = PTHREAD_MUTEX_INITIALIZER;
 
@@ -75,18 +78,25 @@ pthread_mutex_t svcauth_cb_lock = PTHREAD_MUTEX_INITIALIZER;
 /* serialize updates to AUTH ref count */
 pthread_mutex_t auth_ref_lock = PTHREAD_MUTEX_INITIALIZER;
 
-/* protects RPCSEC GSS cache */
+/* protects the client RPCSEC GSS context cache (auth_gss.c) */
+pthread_mutex_t authgss_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* protects RPCSEC GSS context number allocation (svc_auth_gss.c) */
 pthread_mutex_t svcauth_gss_cache_lock = PTHREAD_MUTEX_INITIALIZER;
 
+/* protects the RPCSEC GSS context establishment throttle (svc_auth_gss.c) */
+pthread_mutex_t svcauth_gss_estab_lock = PTHREAD_MUTEX_INITIALIZER;
+
 /* Library global tsd keys */
 thread_key_t clnt_broadcast_key = KEY_INITIALIZER;
 thread_key_t rpc_call_key = KEY_INITIALIZER;
-thread_key_t tcp_key = KEY_INITIALIZER;
-thread_key_t udp_key = KEY_INITIALIZER;
 thread_key_t nc_key = KEY_INITIALIZER;
 thread_key_t rce_key = KEY_INITIALIZER;
 thread_key_t rg_key = KEY_INITIALIZER;
 thread_key_t key_call_key = KEY_INITIALIZER;
+thread_key_t rpcb_batch_key = KEY_INITIALIZER;
+thread_key_t xdr_arena_key = KEY_INITIALIZER;
+thread_key_t authgss_call_key = KEY_INITIALIZER;
 
 /* xprtlist (svc_generic.c) */
 pthread_mutex_t	xprtlist_lock = PTHREAD_MUTEX_INITIALIZER;
@@ -94,9 +104,18 @@ pthread_mutex_t	xprtlist_lock = PTHREAD_MUTEX_INITIALIZER;
 /* serializes calls to public key routines */
 pthread_mutex_t serialize_pkey = PTHREAD_MUTEX_INITIALIZER;
 
-/* protects global variables ni and nc_file (getnetconfig.c) */
+/* protects the current netconfig snapshot and its pins (getnetconfig.c) */
 pthread_mutex_t nc_db_lock = PTHREAD_MUTEX_INITIALIZER;
 
+/* protects the parsed NETPATH cache (getnetpath.c) */
+pthread_mutex_t np_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* protects the /etc/rpc index (getrpcent.c) */
+pthread_rwlock_t rpcdb_lock = PTHREAD_RWLOCK_INITIALIZER;
+
+/* protects the /etc/publickey and /etc/netid indexes (keyfile.c) */
+pthread_mutex_t keyfile_lock = PTHREAD_MUTEX_INITIALIZER;
+
 /* protects static port and startport (bindresvport.c) */
 pthread_mutex_t port_lock = PTHREAD_MUTEX_INITIALIZER;
 
@@ -138,16 +157,18 @@ void tsd_key_delete(void)
 		pthread_key_delete(clnt_broadcast_key);
 	if (rpc_call_key != KEY_INITIALIZER)
 		pthread_key_delete(rpc_call_key);
-	if (tcp_key != KEY_INITIALIZER)
-		pthread_key_delete(tcp_key);
-	if (udp_key != KEY_INITIALIZER)
-		pthread_key_delete(udp_key);
 	if (nc_key != KEY_INITIALIZER)
 		pthread_key_delete(nc_key);
 	if (rce_key != KEY_INITIALIZER)
 		pthread_key_delete(rce_key);
 	if (rg_key != KEY_INITIALIZER)
 		pthread_key_delete(rce_key);
+	if (rpcb_batch_key != KEY_INITIALIZER)
+		pthread_key_delete(rpcb_batch_key);
+	if (xdr_arena_key != KEY_INITIALIZER)
+		pthread_key_delete(xdr_arena_key);
+	if (authgss_call_key != KEY_INITIALIZER)
+		pthread_key_delete(authgss_call_key);
 	return;
 }
 
@@ -33,7 +33,9 @@
  * architecture.
  */
 #include <sys/param.h>
+#include <sys/queue.h>
 #include <rpc/rpc.h>
+#include <reentrant.h>
 #include "rpc_com.h"
 #ifdef YP
 #include <rpcsvc/yp_prot.h>
@@ -44,7 +46,10 @@
 #include <grp.h>
 #include <pwd.h>
 #include <string.h>
+#include <stdint.h>
 #include <stdlib.h>
+#include <time.h>
+#include <errno.h>
 #include <unistd.h>
 
 #include "debug.h"
@@ -54,14 +59,374 @@ static char    *OPSYS = "unix";
 static char    *NETID = "netid.byname";
 #endif
 static char    *NETIDFILE = "/etc/netid";
+static struct __rpc_keyfile netidfile = { "/etc/netid", NULL };
 
 static int getnetid( char *, char * );
-static int _getgroups( char *, gid_t * );
 
 #ifndef NGROUPS
 #define NGROUPS 16
 #endif
 
+/*
+ * uid -> primary gid and supplementary groups, as uid2groups() hands
+ * them out.  Directory-backed group databases can take milliseconds
+ * per lookup, so answers are kept for groups_ttl seconds (unknown
+ * users for groups_negttl).  An entry used in the last quarter of its
+ * life is queued for a single refresher thread, which looks it up
+ * again while callers go on using the old answer; the thread runs only
+ * while there is work queued.  Entries are spread over shards by uid,
+ * each with its own lock and least recently used list.
+ */
+#define GROUPS_SHARDS		16
+#define GROUPS_BUCKETS		64	/* per shard */
+#define GROUPS_SHARD_MAX	256	/* entries per shard */
+#define GROUPS_REFRESH_MAX	64	/* refreshes queued at once */
+
+struct groups_entry {
+	LIST_ENTRY(groups_entry) ge_link;	/* hash chain */
+	TAILQ_ENTRY(groups_entry) ge_lru;
+	uid_t		ge_uid;
+	bool_t		ge_found;	/* FALSE: no such user */
+	bool_t		ge_refreshing;
+	time_t		ge_expires;
+	gid_t		ge_gid;
+	int		ge_ngroups;
+	gid_t		*ge_groups;
+};
+
+struct groups_shard {
+	mutex_t		gs_lock;
+	int		gs_count;
+	LIST_HEAD(, groups_entry) gs_hash[GROUPS_BUCKETS];
+	TAILQ_HEAD(groups_lru, groups_entry) gs_lru;	/* most recent first */
+};
+
+static struct groups_shard groups_shards[GROUPS_SHARDS];
+static once_t groups_once = ONCE_INITIALIZER;
+
+/* Refresh queue; taken after a shard lock, never before. */
+static mutex_t groups_refresh_lock = PTHREAD_MUTEX_INITIALIZER;
+static uid_t groups_refresh_queue[GROUPS_REFRESH_MAX];
+static int groups_refresh_head, groups_refresh_count;
+static bool_t groups_refresh_running;
+
+static int groups_ttl = 300;		/* RPC_GROUPS_CACHETTL_SET */
+static int groups_negttl = 30;		/* RPC_GROUPS_NEGCACHETTL_SET */
+
+static void
+groups_init(void)
+{
+	struct groups_shard *gs;
+	int i, j;
+
+	for (i = 0; i < GROUPS_SHARDS; i++) {
+		gs = &groups_shards[i];
+		mutex_init(&gs->gs_lock, NULL);
+		for (j = 0; j < GROUPS_BUCKETS; j++)
+			LIST_INIT(&gs->gs_hash[j]);
+		TAILQ_INIT(&gs->gs_lru);
+	}
+}
+
+static time_t
+groups_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (ts.tv_sec);
+}
+
+static struct groups_shard *
+groups_shard(uid_t uid, int *bucket)
+{
+	u_int32_t h = (u_int32_t)uid * 2654435761U;
+
+	*bucket = (h >> 4) % GROUPS_BUCKETS;
+	return (&groups_shards[h % GROUPS_SHARDS]);
+}
+
+/*
+ * Ask the databases.  Returns 1 with the groups (primary first, as
+ * getgrouplist() gives them) in a malloc'd *groupsp, 0 if there is no
+ * such user and -1 if the lookup itself failed.
+ */
+static int
+groups_fetch(uid_t uid, gid_t *gidp, int *ngroupsp, gid_t **groupsp)
+{
+	struct passwd pwd, *pw;
+	gid_t *groups, *ng;
+	char *buf, *nb;
+	long buflen;
+	int err, n;
+
+	buflen = sysconf(_SC_GETPW_R_SIZE_MAX);
+	if (buflen <= 0)
+		buflen = 1024;
+	if ((buf = malloc((size_t)buflen)) == NULL)
+		return (-1);
+	while ((err = getpwuid_r(uid, &pwd, buf, buflen, &pw)) == ERANGE) {
+		buflen *= 2;
+		if ((nb = realloc(buf, (size_t)buflen)) == NULL) {
+			free(buf);
+			return (-1);
+		}
+		buf = nb;
+	}
+	if (pw == NULL) {
+		free(buf);
+		return (err == 0 || err == ENOENT ? 0 : -1);
+	}
+
+	n = NGROUPS;
+	if ((groups = malloc(n * sizeof (gid_t))) == NULL) {
+		free(buf);
+		return (-1);
+	}
+	while (getgrouplist(pw->pw_name, pw->pw_gid, groups, &n) == -1) {
+		if ((ng = realloc(groups, n * sizeof (gid_t))) == NULL) {
+			free(groups);
+			free(buf);
+			return (-1);
+		}
+		groups = ng;
+	}
+	*gidp = pw->pw_gid;
+	*ngroupsp = n;
+	*groupsp = groups;
+	free(buf);
+	return (1);
+}
+
+static struct groups_entry *
+groups_find(struct groups_shard *gs, int bucket, uid_t uid)
+{
+	struct groups_entry *ge;
+
+	LIST_FOREACH(ge, &gs->gs_hash[bucket], ge_link)
+		if (ge->ge_uid == uid)
+			return (ge);
+	return (NULL);
+}
+
+static void
+groups_unlink(struct groups_shard *gs, struct groups_entry *ge)
+{
+	LIST_REMOVE(ge, ge_link);
+	TAILQ_REMOVE(&gs->gs_lru, ge, ge_lru);
+	gs->gs_count--;
+	free(ge->ge_groups);
+	free(ge);
+}
+
+/*
+ * Record the outcome of groups_fetch() for uid; the entry takes over
+ * groups.  Called with the shard locked.
+ */
+static void
+groups_store(struct groups_shard *gs, int bucket, uid_t uid, int found,
+    gid_t gid, int ngroups, gid_t *groups, time_t now)
+{
+	struct groups_entry *ge;
+
+	if ((ge = groups_find(gs, bucket, uid)) == NULL) {
+		if (gs->gs_count >= GROUPS_SHARD_MAX)
+			groups_unlink(gs, TAILQ_LAST(&gs->gs_lru, groups_lru));
+		if ((ge = calloc(1, sizeof (*ge))) == NULL) {
+			free(groups);
+			return;
+		}
+		ge->ge_uid = uid;
+		LIST_INSERT_HEAD(&gs->gs_hash[bucket], ge, ge_link);
+		TAILQ_INSERT_HEAD(&gs->gs_lru, ge, ge_lru);
+		gs->gs_count++;
+	}
+	free(ge->ge_groups);
+	ge->ge_found = found;
+	ge->ge_gid = gid;
+	ge->ge_ngroups = ngroups;
+	ge->ge_groups = groups;
+	ge->ge_expires = now + (found ? groups_ttl : groups_negttl);
+	ge->ge_refreshing = FALSE;
+}
+
+static void
+groups_refresh(uid_t uid)
+{
+	struct groups_shard *gs;
+	struct groups_entry *ge;
+	gid_t gid, *groups = NULL;
+	int bucket, ngroups = 0, found;
+
+	found = groups_fetch(uid, &gid, &ngroups, &groups);
+	gs = groups_shard(uid, &bucket);
+	mutex_lock(&gs->gs_lock);
+	if (found >= 0)
+		groups_store(gs, bucket, uid, found, gid, ngroups, groups,
+		    groups_now());
+	else if ((ge = groups_find(gs, bucket, uid)) != NULL)
+		ge->ge_refreshing = FALSE;	/* keep the old answer */
+	mutex_unlock(&gs->gs_lock);
+}
+
+/* The refresher: works through the queue and exits once it is empty. */
+static void *
+groups_refresher(void *arg)
+{
+	uid_t uid;
+
+	mutex_lock(&groups_refresh_lock);
+	while (groups_refresh_count > 0) {
+		uid = groups_refresh_queue[groups_refresh_head];
+		groups_refresh_head = (groups_refresh_head + 1) %
+		    GROUPS_REFRESH_MAX;
+		groups_refresh_count--;
+		mutex_unlock(&groups_refresh_lock);
+		groups_refresh(uid);
+		mutex_lock(&groups_refresh_lock);
+	}
+	groups_refresh_running = FALSE;
+	mutex_unlock(&groups_refresh_lock);
+	return (NULL);
+}
+
+/*
+ * Queue a refresh of uid's entry, starting the refresher if it is not
+ * running; called with the shard locked.  When the queue is full the
+ * entry is left alone and tried again on its next use.
+ */
+static void
+groups_refresh_start(struct groups_entry *ge)
+{
+	pthread_attr_t attr;
+	pthread_t tid;
+
+	mutex_lock(&groups_refresh_lock);
+	if (groups_refresh_count == GROUPS_REFRESH_MAX)
+		goto out;
+	if (!groups_refresh_running) {
+		pthread_attr_init(&attr);
+		pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+		if (pthread_create(&tid, &attr, groups_refresher, NULL) == 0)
+			groups_refresh_running = TRUE;
+		pthread_attr_destroy(&attr);
+		if (!groups_refresh_running)
+			goto out;
+	}
+	groups_refresh_queue[(groups_refresh_head + groups_refresh_count) %
+	    GROUPS_REFRESH_MAX] = ge->ge_uid;
+	groups_refresh_count++;
+	ge->ge_refreshing = TRUE;
+out:
+	mutex_unlock(&groups_refresh_lock);
+}
+
+/*
+ * Hand out uid's primary gid and up to *gidlenp of its supplementary
+ * groups; *gidlenp is set to how many it has, which may be more.
+ */
+static void
+groups_copy(gid_t gid, int ngroups, const gid_t *groups,
+    gid_t *gidp, int *gidlenp, gid_t *gidlist)
+{
+	int i, n = 0;
+
+	*gidp = gid;
+	for (i = 0; i < ngroups; i++) {
+		/* getgrouplist() puts the primary group first */
+		if (i == 0 && groups[i] == gid)
+			continue;
+		if (n < *gidlenp)
+			gidlist[n] = groups[i];
+		n++;
+	}
+	*gidlenp = n;
+}
+
+/*
+ * Look up the groups of a local user, through the cache.  *gidlenp
+ * holds the room in gidlist on entry and the number of supplementary
+ * groups on return; only the first ones are stored if there are more.
+ * Returns 1 if the user is known and 0 otherwise.
+ */
+int
+uid2groups(uid, gidp, gidlenp, gidlist)
+	uid_t		uid;
+	gid_t		*gidp;
+	int		*gidlenp;
+	gid_t		*gidlist;
+{
+	struct groups_shard *gs;
+	struct groups_entry *ge;
+	gid_t gid, *groups = NULL;
+	int bucket, ngroups = 0, found;
+	time_t now;
+
+	if (*gidlenp < 0)
+		return (0);
+	thr_once(&groups_once, groups_init);
+	gs = groups_shard(uid, &bucket);
+	now = groups_now();
+
+	mutex_lock(&gs->gs_lock);
+	ge = groups_find(gs, bucket, uid);
+	if (ge != NULL && ge->ge_expires > now) {
+		TAILQ_REMOVE(&gs->gs_lru, ge, ge_lru);
+		TAILQ_INSERT_HEAD(&gs->gs_lru, ge, ge_lru);
+		if (ge->ge_found && !ge->ge_refreshing &&
+		    ge->ge_expires - now <= groups_ttl / 4)
+			groups_refresh_start(ge);
+		found = ge->ge_found;
+		if (found)
+			groups_copy(ge->ge_gid, ge->ge_ngroups, ge->ge_groups,
+			    gidp, gidlenp, gidlist);
+		mutex_unlock(&gs->gs_lock);
+		return (found);
+	}
+	mutex_unlock(&gs->gs_lock);
+
+	found = groups_fetch(uid, &gid, &ngroups, &groups);
+	if (found < 0)
+		return (0);
+	if (found)
+		groups_copy(gid, ngroups, groups, gidp, gidlenp, gidlist);
+	if ((found ? groups_ttl : groups_negttl) > 0) {
+		mutex_lock(&gs->gs_lock);
+		groups_store(gs, bucket, uid, found, gid, ngroups, groups, now);
+		mutex_unlock(&gs->gs_lock);
+	} else
+		free(groups);
+	return (found);
+}
+
+bool_t
+__rpc_groups_control(request, info)
+	int	request;
+	void	*info;
+{
+	switch (request) {
+	case RPC_GROUPS_CACHETTL_SET:
+		if (*(int *)info < 0)
+			return (FALSE);
+		groups_ttl = *(int *)info;
+		break;
+	case RPC_GROUPS_CACHETTL_GET:
+		*(int *)info = groups_ttl;
+		break;
+	case RPC_GROUPS_NEGCACHETTL_SET:
+		if (*(int *)info < 0)
+			return (FALSE);
+		groups_negttl = *(int *)info;
+		break;
+	case RPC_GROUPS_NEGCACHETTL_GET:
+		*(int *)info = groups_negttl;
+		break;
+	default:
+		return (FALSE);
+	}
+	return (TRUE);
+}
+
 /*
  * Convert network-name into unix credential
  */
@@ -77,7 +442,6 @@ netname2user(netname, uidp, gidp, gidlenp, gidlist)
 	int             gidlen;
 	uid_t           uid;
 	long		luid;
-	struct passwd  *pwd;
 	char            val[1024];
 	char           *val1, *val2;
 	char           *domain;
@@ -133,54 +497,17 @@ netname2user(netname, uidp, gidp, gidlenp, gidlist)
 		return (0);
 	uid = luid;
 
-	/* use initgroups method */
-	pwd = getpwuid(uid);
-	if (pwd == NULL)
+	*uidp = uid;
+	gidlen = NGROUPS;
+	if (!uid2groups(uid, gidp, &gidlen, gidlist))
 		return (0);
-	*uidp = pwd->pw_uid;
-	*gidp = pwd->pw_gid;
-	*gidlenp = _getgroups(pwd->pw_name, gidlist);
-	return (1);
-}
-
-/*
- * initgroups
- */
-
-static int
-_getgroups(uname, groups)
-	char           *uname;
-	gid_t          groups[NGROUPS];
-{
-	gid_t           ngroups = 0;
-	struct group *grp;
-	int    i;
-	int    j;
-	int             filter;
-
-	setgrent();
-	while ((grp = getgrent())) {
-		for (i = 0; grp->gr_mem[i]; i++)
-			if (!strcmp(grp->gr_mem[i], uname)) {
-				if (ngroups == NGROUPS) {
-					LIBTIRPC_DEBUG(1,
-				("_getgroups: %s is in too many groups\n", uname));
-					goto toomany;
-				}
-				/* filter out duplicate group entries */
-				filter = 0;
-				for (j = 0; j < ngroups; j++)
-					if (groups[j] == grp->gr_gid) {
-						filter++;
-						break;
-					}
-				if (!filter)
-					groups[ngroups++] = grp->gr_gid;
-			}
+	if (gidlen > NGROUPS) {
+		LIBTIRPC_DEBUG(1,
+			("netname2user: %s is in too many groups\n", netname));
+		gidlen = NGROUPS;
 	}
-toomany:
-	endgrent();
-	return (ngroups);
+	*gidlenp = gidlen;
+	return (1);
 }
 
 /*
@@ -232,18 +559,15 @@ netname2host(netname, hostname, hostlen)
 }
 
 /*
- * reads the file /etc/netid looking for a + to optionally go to the
- * network information service.
+ * looks the key up in /etc/netid, going to the network information
+ * service where the file has a + ahead of it or there is no file.
  */
 static int
 getnetid(key, ret)
 	char           *key, *ret;
 {
-	char            buf[1024];	/* big enough */
-	char           *res;
-	char           *mkey;
-	char           *mval;
-	FILE           *fd;
+	bool_t          plus;
+	int             found;
 #ifdef YP
 	char           *domain;
 	int             err;
@@ -251,72 +575,36 @@ getnetid(key, ret)
 	int             len;
 #endif
 
-	fd = fopen(NETIDFILE, "r");
-	if (fd == NULL) {
+	found = __rpc_keyfile_lookup(&netidfile, key, ret, 1024, &plus);
+	if (found < 0) {
 #ifdef YP
-		res = "+";
-		goto getnetidyp;
+		found = 0;
+		plus = TRUE;
 #else
 		return (0);
 #endif
 	}
-	for (;;) {
-		if (fd == NULL)
-			return (0);	/* getnetidyp brings us here */
-		res = fgets(buf, sizeof(buf), fd);
-		if (res == NULL) {
-			fclose(fd);
-			return (0);
-		}
-		if (res[0] == '#')
-			continue;
-		else if (res[0] == '+') {
+	if (plus) {
 #ifdef YP
-	getnetidyp:
-			err = yp_get_default_domain(&domain);
-			if (err) {
-				continue;
-			}
-			lookup = NULL;
-			err = yp_match(domain, NETID, key,
-				strlen(key), &lookup, &len);
-			if (err) {
-				LIBTIRPC_DEBUG(1, ("getnetid: match failed error %d", err));
-				continue;
-			}
-			lookup[len] = 0;
-			strcpy(ret, lookup);
-			free(lookup);
-			if (fd != NULL)
-				fclose(fd);
-			return (2);
+		err = yp_get_default_domain(&domain);
+		if (err)
+			return (found);
+		lookup = NULL;
+		err = yp_match(domain, NETID, key,
+			strlen(key), &lookup, &len);
+		if (err) {
+			LIBTIRPC_DEBUG(1, ("getnetid: match failed error %d", err));
+			return (found);
+		}
+		lookup[len] = 0;
+		strcpy(ret, lookup);
+		free(lookup);
+		return (2);
 #else	/* YP */
-			LIBTIRPC_DEBUG(1,
+		LIBTIRPC_DEBUG(1,
 ("Bad record in %s '+' -- NIS not supported in this library copy\n",
-				NETIDFILE));
-			continue;
+			NETIDFILE));
 #endif	/* YP */
-		} else {
-			mkey = strsep(&res, "\t ");
-			if (mkey == NULL) {
-				fprintf(stderr,
-		"Bad record in %s -- %s", NETIDFILE, buf);
-				continue;
-			}
-			do {
-				mval = strsep(&res, " \t#\n");
-			} while (mval != NULL && !*mval);
-			if (mval == NULL) {
-				fprintf(stderr,
-		"Bad record in %s val problem - %s", NETIDFILE, buf);
-				continue;
-			}
-			if (strcmp(mkey, key) == 0) {
-				strcpy(ret, mval);
-				fclose(fd);
-				return (1);
-
-			}
-		}
 	}
+	return (found);
 }
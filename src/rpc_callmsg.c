@@ -42,6 +42,8 @@
 
 #include <sys/select.h>
 
+#include "rpc_com.h"
+
 /*
  * XDR a call message
  */
@@ -123,7 +125,7 @@ xdr_callmsg(xdrs, cmsg)
 				}
 				if (oa->oa_base == NULL) {
 					oa->oa_base = (caddr_t)
-					    mem_alloc(oa->oa_length);
+					    __xdr_alloc(xdrs, oa->oa_length);
 					if (oa->oa_base == NULL)
 						return (FALSE);
 				}
@@ -159,7 +161,7 @@ xdr_callmsg(xdrs, cmsg)
 				}
 				if (oa->oa_base == NULL) {
 					oa->oa_base = (caddr_t)
-					    mem_alloc(oa->oa_length);
+					    __xdr_alloc(xdrs, oa->oa_length);
 					if (oa->oa_base == NULL)
 						return (FALSE);
 				}
@@ -50,13 +50,60 @@ struct netbuf *__rpc_set_netbuf(struct netbuf *, const void *, size_t);
 
 struct netbuf *__rpcb_findaddr_timed(rpcprog_t, rpcvers_t,
     const struct netconfig *, const char *host, CLIENT **clpp,
-    struct timeval *tp);
+    struct timeval *tp, bool_t *cachedp);
+bool_t __rpcb_invalidate(rpcprog_t, rpcvers_t, const struct netconfig *,
+    const char *host);
 
 bool_t __rpc_control(int,void *);
+void __authgss_call_done(AUTH *, struct rpc_err *);
+void __svcauth_gss_done(struct svc_req *);
+#ifdef _TIRPC_AUTH_GSS_H
+bool_t __xdr_rpc_gss_data(XDR *, xdrproc_t, caddr_t, gss_ctx_id_t,
+    pthread_mutex_t *, gss_qop_t, rpc_gss_svc_t, u_int);
+#endif
+bool_t __rpc_groups_control(int, void *);
+bool_t __svcauth_des_control(int, void *);
+
+/* An index of a "name value" file such as /etc/publickey (keyfile.c) */
+struct __rpc_keyfile {
+	const char *kf_path;
+	struct keyfile_index *kf_index;	/* keyfile_lock */
+};
+int __rpc_keyfile_lookup(struct __rpc_keyfile *, const char *, char *,
+    size_t, bool_t *);
+
+struct netconfig *__nc_getconfip(const char *);
+void *__nc_setnettype(int);
+int __nc_matchtype(const struct netconfig *, int);
+
+/* The calling thread's decode arena (xdr_arena.c) */
+struct xdr_arena_binding {
+	XDR	*ab_xdrs;		/* stream bound, NULL for all */
+	xdr_arena_t *ab_arena;
+	XDR	*ab_borrow;		/* stream lent by xdr_arena_borrow() */
+	XDR	*ab_skim;		/* stream skimmed by xdr_skip() */
+	xdr_arena_t *ab_scratch;	/* xdr_skip()'s arena */
+};
+struct xdr_arena_binding *__xdr_arena_binding(bool_t);
+xdr_arena_t *__xdr_arena(XDR *);
+bool_t __xdr_borrowing(XDR *);
+bool_t __xdr_skimming(XDR *);
+bool_t __xdr_sizing(XDR *);
+void *__xdr_alloc(XDR *, u_int);
+void __xdr_free(XDR *, void *, u_int);
 
 bool_t __svc_clean_idle(fd_set *, int, bool_t);
 bool_t __xdrrec_setnonblock(XDR *, int);
 bool_t __xdrrec_getrec(XDR *, enum xprt_stat *, bool_t);
+int __xdrrec_getchunk(XDR *, char **, u_int);
+void __xdrrec_setsendfile(XDR *, bool_t (*)(void *, int, off_t *, size_t));
+int __xdrrec_putfile(XDR *, int, off_t, u_int);
+bool_t __xdrrec_setzerocopy(XDR *, int, bool_t);
+int __xdrrec_zcreap(XDR *);
+bool_t __xdrrec_hold(XDR *);
+bool_t __xdrrec_unhold(XDR *, u_long *);
+bool_t __xdrrec_counting(XDR *);
+bool_t __xdrrec_setreclen(XDR *, u_long);
 void __xprt_unregister_unlocked(SVCXPRT *);
 void __xprt_set_raddr(SVCXPRT *, const struct sockaddr_storage *);
 
@@ -68,6 +115,13 @@ void __xprt_set_raddr(SVCXPRT *, const struct sockaddr_storage *);
 			+ 1 + strlen((ptr)->sun_path + 1))
 
 extern int __svc_maxrec;
+extern int __svc_arena;
+extern int __svc_gsswin;
+extern int __svc_gssestab;
+extern int __svc_gssqueue;
+bool_t __svc_getargs(SVCXPRT *, XDR *, xdrproc_t, void *, bool_t);
+bool_t __svc_freeargs(SVCXPRT *, XDR *, xdrproc_t, void *);
+u_long __svc_replysize(SVCXPRT *, struct rpc_msg *, xdrproc_t, void *);
 
 extern int __svc_mtmode;
 extern int __svc_thrmax;
@@ -221,65 +221,11 @@ struct netconfig *
 __rpc_getconfip(nettype)
 	const char *nettype;
 {
-	char *netid;
-	char *netid_tcp = (char *) NULL;
-	char *netid_udp = (char *) NULL;
-	struct netconfig *dummy;
-	extern thread_key_t tcp_key, udp_key;
-	extern mutex_t tsd_lock;
-
-	if (tcp_key == KEY_INITIALIZER) {
-		mutex_lock(&tsd_lock);
-		if (tcp_key == KEY_INITIALIZER)
-			thr_keycreate(&tcp_key, free);
-		mutex_unlock(&tsd_lock);
-	}
-	netid_tcp = (char *)thr_getspecific(tcp_key);
-	if (udp_key == KEY_INITIALIZER) {
-		mutex_lock(&tsd_lock);
-		if (udp_key == KEY_INITIALIZER)
-			thr_keycreate(&udp_key, free);
-		mutex_unlock(&tsd_lock);
-	}
-	netid_udp = (char *)thr_getspecific(udp_key);
-	if (!netid_udp && !netid_tcp) {
-		struct netconfig *nconf;
-		void *confighandle;
-
-		if (!(confighandle = setnetconfig())) {
-			syslog (LOG_ERR, "rpc: failed to open " NETCONFIG);
-			return (NULL);
-		}
-		while ((nconf = getnetconfig(confighandle)) != NULL) {
-			if (strcmp(nconf->nc_protofmly, NC_INET) == 0) {
-				if (strcmp(nconf->nc_proto, NC_TCP) == 0 &&
-						netid_tcp == NULL) {
-					netid_tcp = strdup(nconf->nc_netid);
-					thr_setspecific(tcp_key,
-							(void *) netid_tcp);
-				} else
-				if (strcmp(nconf->nc_proto, NC_UDP) == 0 &&
-						netid_udp == NULL) {
-					netid_udp = strdup(nconf->nc_netid);
-					thr_setspecific(udp_key,
-						(void *) netid_udp);
-				}
-			}
-		}
-		endnetconfig(confighandle);
-	}
 	if (strcmp(nettype, "udp") == 0)
-		netid = netid_udp;
+		return (__nc_getconfip(NC_UDP));
 	else if (strcmp(nettype, "tcp") == 0)
-		netid = netid_tcp;
-	else {
-		return (NULL);
-	}
-	if ((netid == NULL) || (netid[0] == 0)) {
-		return (NULL);
-	}
-	dummy = getnetconfigent(netid);
-	return (dummy);
+		return (__nc_getconfip(NC_TCP));
+	return (NULL);
 }
 
 /*
@@ -311,7 +257,7 @@ __rpc_setconf(nettype)
 	case _RPC_DATAGRAM_V:
 	case _RPC_TCP:
 	case _RPC_UDP:
-		if (!(handle->nhandle = setnetconfig())) {
+		if (!(handle->nhandle = __nc_setnettype(handle->nettype))) {
 		        syslog (LOG_ERR, "rpc: failed to open " NETCONFIG);
 			free(handle);
 			return (NULL);
@@ -346,63 +292,8 @@ __rpc_getconf(vhandle)
 			nconf = getnetpath(handle->nhandle);
 		else
 			nconf = getnetconfig(handle->nhandle);
-		if (nconf == NULL)
+		if (nconf == NULL || __nc_matchtype(nconf, handle->nettype))
 			break;
-		if ((nconf->nc_semantics != NC_TPI_CLTS) &&
-			(nconf->nc_semantics != NC_TPI_COTS) &&
-			(nconf->nc_semantics != NC_TPI_COTS_ORD))
-			continue;
-		switch (handle->nettype) {
-		case _RPC_VISIBLE:
-			if (!(nconf->nc_flag & NC_VISIBLE))
-				continue;
-			/* FALLTHROUGH */
-		case _RPC_NETPATH:	/* Be happy */
-			break;
-		case _RPC_CIRCUIT_V:
-			if (!(nconf->nc_flag & NC_VISIBLE))
-				continue;
-			/* FALLTHROUGH */
-		case _RPC_CIRCUIT_N:
-			if ((nconf->nc_semantics != NC_TPI_COTS) &&
-				(nconf->nc_semantics != NC_TPI_COTS_ORD))
-				continue;
-			break;
-		case _RPC_DATAGRAM_V:
-			if (!(nconf->nc_flag & NC_VISIBLE))
-				continue;
-			/* FALLTHROUGH */
-		case _RPC_DATAGRAM_N:
-			if (nconf->nc_semantics != NC_TPI_CLTS)
-				continue;
-			break;
-		case _RPC_TCP:
-			if (((nconf->nc_semantics != NC_TPI_COTS) &&
-				(nconf->nc_semantics != NC_TPI_COTS_ORD)) ||
-				(strcmp(nconf->nc_protofmly, NC_INET)
-#ifdef INET6
-				 && strcmp(nconf->nc_protofmly, NC_INET6))
-#else
-				)
-#endif
-				||
-				strcmp(nconf->nc_proto, NC_TCP))
-				continue;
-			break;
-		case _RPC_UDP:
-			if ((nconf->nc_semantics != NC_TPI_CLTS) ||
-				(strcmp(nconf->nc_protofmly, NC_INET)
-#ifdef INET6
-				&& strcmp(nconf->nc_protofmly, NC_INET6))
-#else
-				)
-#endif
-				||
-				strcmp(nconf->nc_proto, NC_UDP))
-				continue;
-			break;
-		}
-		break;
 	}
 	return (nconf);
 }
@@ -52,6 +52,10 @@
 #include <netdb.h>
 #include <syslog.h>
 #include <assert.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/param.h>
+#include <sys/time.h>
 
 #include "rpc_com.h"
 #include "debug.h"
@@ -79,6 +83,90 @@ struct address_cache {
 static struct address_cache *front;
 static int cachesize;
 
+/*
+ * Cache of rpcbind lookups: (host, prog, vers, netid) -> server address.
+ * Entries that are being resolved are kept in the table in the
+ * LOOKUP_PENDING state, so that concurrent lookups of the same service
+ * wait for the answer of the first one instead of asking rpcbind again.
+ */
+#define	LOOKUP_HASHSIZE	64
+#define	LOOKUP_CACHESIZE 256
+
+#define	LOOKUP_PENDING	0
+#define	LOOKUP_DONE	1
+
+struct lookup_cache {
+	struct lookup_cache *lc_next;
+	u_int32_t lc_hash;
+	rpcprog_t lc_prog;
+	rpcvers_t lc_vers;
+	char *lc_host;
+	char *lc_netid;
+	int lc_state;
+	int lc_waiters;		/* threads waiting for a pending lookup */
+	bool_t lc_unlinked;	/* freed by the last waiter */
+	time_t lc_expires;
+	struct netbuf *lc_addr;	/* NULL for failed lookups */
+	enum clnt_stat lc_stat;	/* rpc_createerr of a failed lookup */
+	struct rpc_err lc_error;
+};
+
+static struct lookup_cache *lookup_table[LOOKUP_HASHSIZE];
+static int lookup_cachesize;
+static pthread_cond_t lookup_cv = PTHREAD_COND_INITIALIZER;
+
+static int lookup_ttl = 30;		/* RPC_RPCB_CACHETTL_SET */
+static int lookup_negttl = 3;		/* RPC_RPCB_NEGCACHETTL_SET */
+
+/*
+ * Idle client handles to rpcbind instances, reused across rpcb_* calls.
+ * A handle is owned by one caller at a time between rpcb_handle_get()
+ * and rpcb_handle_put().
+ */
+#define	RPCB_HANDLES_MAX	8
+#define	RPCB_HANDLE_IDLE	20	/* rpcbind drops idle connections */
+
+struct rpcb_handle {
+	struct rpcb_handle *rh_next;
+	CLIENT *rh_clnt;
+	char *rh_host;		/* NULL for the local rpcbind */
+	char *rh_netid;		/* NULL for the local rpcbind */
+	char *rh_uaddr;		/* universal address of rpcbind, or NULL */
+	rpcvers_t rh_vers;	/* version the handle was created with */
+	bool_t rh_reused;	/* came out of the pool */
+	time_t rh_idle;		/* when it was put back */
+};
+
+static struct rpcb_handle *rpcb_handles;
+static int rpcb_nhandles;
+static pid_t rpcb_handles_pid;
+
+/*
+ * Registrations queued between rpcb_batch_begin() and rpcb_batch_end()
+ * on the calling thread.
+ */
+#define	RPCB_BATCH_WINDOW	64	/* calls in flight before reading replies */
+
+struct rpcb_batch_op {
+	rpcproc_t rb_proc;	/* RPCBPROC_SET or RPCBPROC_UNSET */
+	rpcprog_t rb_prog;
+	rpcvers_t rb_vers;
+	char *rb_netid;
+	char *rb_addr;
+	bool_t rb_done;		/* rpcbind said yes */
+};
+
+struct rpcb_batch {
+	struct rpcb_batch_op *rb_ops;
+	int rb_nops;
+	int rb_maxops;
+};
+
+struct rpcb_batch_conn {
+	int bc_fd;
+	int bc_timeout;		/* milliseconds */
+};
+
 #define	CLCR_GET_RPCB_TIMEOUT	1
 #define	CLCR_SET_RPCB_TIMEOUT	2
 
@@ -90,6 +178,15 @@ static void delete_cache(struct netbuf *);
 static void add_cache(const char *, const char *, struct netbuf *, char *);
 static CLIENT *getclnthandle(const char *, const struct netconfig *, char **);
 static CLIENT *local_rpcb(char **targaddr);
+static struct rpcb_handle *rpcb_handle_get(const char *,
+    const struct netconfig *);
+static struct rpcb_handle *rpcb_local_handle(void);
+static void rpcb_handle_put(struct rpcb_handle *, enum clnt_stat);
+static enum clnt_stat rpcb_clnt_call(struct rpcb_handle *, rpcproc_t,
+    xdrproc_t, void *, xdrproc_t, void *, struct timeval);
+static struct rpcb_batch *rpcb_batch_current(void);
+static bool_t rpcb_batch_add(struct rpcb_batch *, rpcproc_t, rpcprog_t,
+    rpcvers_t, const char *, const char *);
 #ifdef NOTUSED
 static struct netbuf *got_entry(rpcb_entry_list_ptr, const struct netconfig *);
 #endif
@@ -205,12 +302,37 @@ __rpc_control(request, info)
 	case CLCR_GET_LOWVERS:
 		*(int *)info = __rpc_lowvers;
 		break;
+	case RPC_RPCB_CACHETTL_SET:
+		if (*(int *)info < 0)
+			return (FALSE);
+		lookup_ttl = *(int *)info;
+		break;
+	case RPC_RPCB_CACHETTL_GET:
+		*(int *)info = lookup_ttl;
+		break;
+	case RPC_RPCB_NEGCACHETTL_SET:
+		if (*(int *)info < 0)
+			return (FALSE);
+		lookup_negttl = *(int *)info;
+		break;
+	case RPC_RPCB_NEGCACHETTL_GET:
+		*(int *)info = lookup_negttl;
+		break;
 	default:
 		return (FALSE);
 	}
 	return (TRUE);
 }
 
+static time_t
+rpcb_now()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (ts.tv_sec);
+}
+
 /*
  * Protect against concurrent access to the address cache and modifications
  * (esp. deletions) of cache entries.
@@ -494,15 +616,14 @@ out_err:
 }
 
 /*
- * Create a PMAP client handle.
+ * Get a PMAP client handle.
  */
-static CLIENT *
-getpmaphandle(nconf, hostname, tgtaddr)
+static struct rpcb_handle *
+getpmaphandle(nconf, hostname)
 	const struct netconfig *nconf;
 	const char *hostname;
-	char **tgtaddr;
 {
-	CLIENT *client = NULL;
+	struct rpcb_handle *rh = NULL;
 	rpcvers_t pmapvers = 2;
 
 	if (nconf == NULL) {
@@ -512,20 +633,20 @@ getpmaphandle(nconf, hostname, tgtaddr)
 			rpc_createerr.cf_stat = RPC_UNKNOWNPROTO;
 			return NULL;
 		}
-		client = getclnthandle(hostname, newnconf, tgtaddr);
+		rh = rpcb_handle_get(hostname, newnconf);
 		freenetconfigent(newnconf);
 	} else if (strcmp(nconf->nc_proto, NC_UDP) == 0 ||
 	    strcmp(nconf->nc_proto, NC_TCP) == 0) {
 		if (strcmp(nconf->nc_protofmly, NC_INET) != 0)
 			return NULL;
-		client = getclnthandle(hostname, nconf, tgtaddr);
+		rh = rpcb_handle_get(hostname, nconf);
 	}
 
 	/* Set version */
-	if (client != NULL)
-		CLNT_CONTROL(client, CLSET_VERS, (char *)&pmapvers);
+	if (rh != NULL)
+		CLNT_CONTROL(rh->rh_clnt, CLSET_VERS, (char *)&pmapvers);
 
-	return client;
+	return rh;
 }
 
 /* XXX */
@@ -649,6 +770,292 @@ try_nconf:
 	return (client);
 }
 
+/*
+ * The routines rpcb_handle_get(), rpcb_local_handle() and
+ * rpcb_handle_put() manage the pool of rpcbind client handles.
+ */
+extern mutex_t rpcbhandle_lock;
+
+static void
+rpcb_handle_destroy(rh)
+	struct rpcb_handle *rh;
+{
+	if (rh->rh_clnt != NULL)
+		CLNT_DESTROY(rh->rh_clnt);
+	free(rh->rh_host);
+	free(rh->rh_netid);
+	free(rh->rh_uaddr);
+	free(rh);
+}
+
+/*
+ * Creates a new client handle to the rpcbind on host, or to the local
+ * rpcbind if nconf is NULL.
+ */
+static struct rpcb_handle *
+rpcb_handle_create(host, nconf)
+	const char *host;
+	const struct netconfig *nconf;
+{
+	struct rpcb_handle *rh;
+
+	rh = calloc(1, sizeof (struct rpcb_handle));
+	if (rh == NULL) {
+		rpc_createerr.cf_stat = RPC_SYSTEMERROR;
+		return (NULL);
+	}
+	if (nconf == NULL)
+		rh->rh_clnt = local_rpcb(&rh->rh_uaddr);
+	else
+		rh->rh_clnt = getclnthandle(host, nconf, &rh->rh_uaddr);
+	if (rh->rh_clnt == NULL) {
+		free(rh);
+		return (NULL);
+	}
+	if ((host != NULL && (rh->rh_host = strdup(host)) == NULL) ||
+	    (nconf != NULL && (rh->rh_netid = strdup(nconf->nc_netid)) == NULL)) {
+		rpcb_handle_destroy(rh);
+		rpc_createerr.cf_stat = RPC_SYSTEMERROR;
+		return (NULL);
+	}
+	CLNT_CONTROL(rh->rh_clnt, CLGET_VERS, (char *)(void *)&rh->rh_vers);
+	return (rh);
+}
+
+/*
+ * Checks whether the peer has closed an idle connection-oriented handle.
+ * Nothing is expected on an idle connection, so anything readable means
+ * EOF or garbage.
+ */
+static bool_t
+rpcb_handle_dead(rh)
+	struct rpcb_handle *rh;
+{
+	struct __rpc_sockinfo si;
+	struct pollfd pfd;
+
+	if (!CLNT_CONTROL(rh->rh_clnt, CLGET_FD, (char *)(void *)&pfd.fd))
+		return (FALSE);
+	if (__rpc_fd2sockinfo(pfd.fd, &si) && si.si_socktype != SOCK_STREAM)
+		return (FALSE);
+	pfd.events = POLLIN;
+	pfd.revents = 0;
+	return (poll(&pfd, 1, 0) != 0);
+}
+
+/*
+ * Takes an idle handle for (host, netid) out of the pool, or creates
+ * a new one.  Handles idle for too long and handles inherited across
+ * fork() are discarded on the way.
+ */
+static struct rpcb_handle *
+rpcb_handle_take(host, nconf)
+	const char *host;
+	const struct netconfig *nconf;
+{
+	struct rpcb_handle *rh, **rhp, *stale = NULL;
+	const char *netid = nconf ? nconf->nc_netid : NULL;
+	time_t now = rpcb_now();
+
+	mutex_lock(&rpcbhandle_lock);
+	if (rpcb_handles_pid != getpid()) {
+		stale = rpcb_handles;
+		rpcb_handles = NULL;
+		rpcb_nhandles = 0;
+		rpcb_handles_pid = getpid();
+	}
+	for (rhp = &rpcb_handles; (rh = *rhp) != NULL; ) {
+		if (rh->rh_idle + RPCB_HANDLE_IDLE <= now) {
+			*rhp = rh->rh_next;
+			rpcb_nhandles--;
+			rh->rh_next = stale;
+			stale = rh;
+			continue;
+		}
+		if ((rh->rh_netid == NULL) == (netid == NULL) &&
+		    (netid == NULL || !strcmp(rh->rh_netid, netid)) &&
+		    (rh->rh_host == NULL) == (host == NULL) &&
+		    (host == NULL || !strcmp(rh->rh_host, host))) {
+			*rhp = rh->rh_next;
+			rpcb_nhandles--;
+			break;
+		}
+		rhp = &rh->rh_next;
+	}
+	mutex_unlock(&rpcbhandle_lock);
+
+	while (stale != NULL) {
+		struct rpcb_handle *next = stale->rh_next;
+
+		rpcb_handle_destroy(stale);
+		stale = next;
+	}
+
+	if (rh == NULL)
+		return (rpcb_handle_create(host, nconf));
+
+	/* Reconnect rather than writing into a connection rpcbind closed */
+	if (rpcb_handle_dead(rh)) {
+		rpcb_handle_destroy(rh);
+		return (rpcb_handle_create(host, nconf));
+	}
+
+	/* Undo whatever the previous user changed */
+	CLNT_CONTROL(rh->rh_clnt, CLSET_VERS, (char *)(void *)&rh->rh_vers);
+	CLNT_CONTROL(rh->rh_clnt, CLSET_RETRY_TIMEOUT, (char *)&rpcbrmttime);
+	rh->rh_next = NULL;
+	rh->rh_reused = TRUE;
+	return (rh);
+}
+
+/*
+ * Returns a handle to the rpcbind on host, using transport nconf.
+ * On error, returns NULL with rpc_createerr set.
+ */
+static struct rpcb_handle *
+rpcb_handle_get(host, nconf)
+	const char *host;
+	const struct netconfig *nconf;
+{
+	if (nconf == NULL) {
+		rpc_createerr.cf_stat = RPC_UNKNOWNPROTO;
+		return (NULL);
+	}
+	return (rpcb_handle_take(host, nconf));
+}
+
+/*
+ * Returns a handle to the local rpcbind.
+ */
+static struct rpcb_handle *
+rpcb_local_handle()
+{
+	return (rpcb_handle_take(NULL, NULL));
+}
+
+/*
+ * Gives a handle back to the pool.  Handles whose last call failed at
+ * the transport level are destroyed instead, so that the next user
+ * reconnects.
+ */
+static void
+rpcb_handle_put(rh, stat)
+	struct rpcb_handle *rh;
+	enum clnt_stat stat;
+{
+	struct rpcb_handle *victim = NULL, **rhp;
+
+	if (rh == NULL)
+		return;
+
+	switch (stat) {
+	case RPC_SUCCESS:
+	case RPC_PROGUNAVAIL:
+	case RPC_PROGVERSMISMATCH:
+	case RPC_PROCUNAVAIL:
+	case RPC_CANTDECODEARGS:
+		break;
+	default:
+		rpcb_handle_destroy(rh);
+		return;
+	}
+
+	mutex_lock(&rpcbhandle_lock);
+	if (rpcb_handles_pid != getpid()) {
+		mutex_unlock(&rpcbhandle_lock);
+		rpcb_handle_destroy(rh);
+		return;
+	}
+	rh->rh_idle = rpcb_now();
+	rh->rh_next = rpcb_handles;
+	rpcb_handles = rh;
+	if (++rpcb_nhandles > RPCB_HANDLES_MAX) {
+		/* Drop the least recently used one */
+		for (rhp = &rpcb_handles; (*rhp)->rh_next != NULL;
+		    rhp = &(*rhp)->rh_next)
+			;
+		victim = *rhp;
+		*rhp = NULL;
+		rpcb_nhandles--;
+	}
+	mutex_unlock(&rpcbhandle_lock);
+
+	if (victim != NULL)
+		rpcb_handle_destroy(victim);
+}
+
+/*
+ * Procedures that can safely run twice.  PMAPPROC_GETPORT has the same
+ * number as RPCBPROC_GETADDR and PMAPPROC_DUMP as RPCBPROC_DUMP.
+ */
+static bool_t
+rpcb_idempotent(proc)
+	rpcproc_t proc;
+{
+	switch (proc) {
+	case RPCBPROC_GETADDR:
+	case RPCBPROC_DUMP:
+	case RPCBPROC_GETTIME:
+	case RPCBPROC_UADDR2TADDR:
+	case RPCBPROC_TADDR2UADDR:
+		return (TRUE);
+	default:
+		return (FALSE);
+	}
+}
+
+/*
+ * Calls rpcbind through a handle.  If a pooled connection turns out to
+ * be dead (rpcbind closed it, or was restarted), the handle is
+ * reconnected and the call is tried once more.  A call whose request
+ * may already have reached rpcbind (RPC_CANTRECV) is only retried for
+ * lookups, never for SET, UNSET or CALLIT.
+ */
+static enum clnt_stat
+rpcb_clnt_call(rh, proc, xargs, argsp, xres, resp, tout)
+	struct rpcb_handle *rh;
+	rpcproc_t proc;
+	xdrproc_t xargs;
+	void *argsp;
+	xdrproc_t xres;
+	void *resp;
+	struct timeval tout;
+{
+	enum clnt_stat stat;
+	struct netconfig *nconf;
+	struct timeval retry;
+	rpcvers_t vers;
+	CLIENT *client;
+
+	stat = CLNT_CALL(rh->rh_clnt, proc, xargs, argsp, xres, resp, tout);
+	if (!rh->rh_reused)
+		return (stat);
+	if (stat != RPC_CANTSEND &&
+	    (stat != RPC_CANTRECV || !rpcb_idempotent(proc)))
+		return (stat);
+
+	LIBTIRPC_DEBUG(2, ("rpcb_clnt_call: reconnecting to rpcbind\n"));
+	rh->rh_reused = FALSE;
+	if (rh->rh_netid == NULL)
+		client = local_rpcb(NULL);
+	else if ((nconf = getnetconfigent(rh->rh_netid)) != NULL) {
+		client = getclnthandle(rh->rh_host, nconf, NULL);
+		freenetconfigent(nconf);
+	} else
+		client = NULL;
+	if (client == NULL)
+		return (stat);
+
+	if (CLNT_CONTROL(rh->rh_clnt, CLGET_VERS, (char *)(void *)&vers))
+		CLNT_CONTROL(client, CLSET_VERS, (char *)(void *)&vers);
+	if (CLNT_CONTROL(rh->rh_clnt, CLGET_RETRY_TIMEOUT, (char *)&retry))
+		CLNT_CONTROL(client, CLSET_RETRY_TIMEOUT, (char *)&retry);
+	CLNT_DESTROY(rh->rh_clnt);
+	rh->rh_clnt = client;
+
+	return (CLNT_CALL(rh->rh_clnt, proc, xargs, argsp, xres, resp, tout));
+}
+
 /*
  * Set a mapping between program, version and address.
  * Calls the rpcbind service to do the mapping.
@@ -660,7 +1067,9 @@ rpcb_set(program, version, nconf, address)
 	const struct netconfig *nconf;	/* Network structure of transport */
 	const struct netbuf *address;		/* Services netconfig address */
 {
-	CLIENT *client;
+	struct rpcb_handle *rh;
+	struct rpcb_batch *batch;
+	enum clnt_stat stat;
 	bool_t rslt = FALSE;
 	RPCB parms;
 	char uidbuf[32];
@@ -674,8 +1083,21 @@ rpcb_set(program, version, nconf, address)
 		rpc_createerr.cf_stat = RPC_UNKNOWNADDR;
 		return (FALSE);
 	}
-	client = local_rpcb(NULL);
-	if (! client) {
+	if ((batch = rpcb_batch_current()) != NULL) {
+		/*LINTED const castaway*/
+		parms.r_addr = taddr2uaddr((struct netconfig *) nconf,
+					   (struct netbuf *)address);
+		if (!parms.r_addr) {
+			rpc_createerr.cf_stat = RPC_N2AXLATEFAILURE;
+			return (FALSE);
+		}
+		rslt = rpcb_batch_add(batch, RPCBPROC_SET, program, version,
+		    nconf->nc_netid, parms.r_addr);
+		free(parms.r_addr);
+		return (rslt);
+	}
+	rh = rpcb_local_handle();
+	if (! rh) {
 		return (FALSE);
 	}
 
@@ -684,7 +1106,7 @@ rpcb_set(program, version, nconf, address)
 	parms.r_addr = taddr2uaddr((struct netconfig *) nconf,
 				   (struct netbuf *)address);
 	if (!parms.r_addr) {
-		CLNT_DESTROY(client);
+		rpcb_handle_put(rh, RPC_SUCCESS);
 		rpc_createerr.cf_stat = RPC_N2AXLATEFAILURE;
 		return (FALSE); /* no universal address */
 	}
@@ -699,11 +1121,11 @@ rpcb_set(program, version, nconf, address)
 	(void) snprintf(uidbuf, sizeof uidbuf, "%d", geteuid());
 	parms.r_owner = uidbuf;
 
-	CLNT_CALL(client, (rpcproc_t)RPCBPROC_SET, (xdrproc_t) xdr_rpcb,
+	stat = rpcb_clnt_call(rh, (rpcproc_t)RPCBPROC_SET, (xdrproc_t) xdr_rpcb,
 	    (char *)&parms, (xdrproc_t) xdr_bool,
 	    (char *)&rslt, tottimeout);
 
-	CLNT_DESTROY(client);
+	rpcb_handle_put(rh, stat);
 	free(parms.r_addr);
 	return (rslt);
 }
@@ -720,13 +1142,19 @@ rpcb_unset(program, version, nconf)
 	rpcvers_t version;
 	const struct netconfig *nconf;
 {
-	CLIENT *client;
+	struct rpcb_handle *rh;
+	struct rpcb_batch *batch;
+	enum clnt_stat stat;
 	bool_t rslt = FALSE;
 	RPCB parms;
 	char uidbuf[32];
 
-	client = local_rpcb(NULL);
-	if (! client) {
+	if ((batch = rpcb_batch_current()) != NULL)
+		return (rpcb_batch_add(batch, RPCBPROC_UNSET, program, version,
+		    nconf ? nconf->nc_netid : nullstring, nullstring));
+
+	rh = rpcb_local_handle();
+	if (! rh) {
 		return (FALSE);
 	}
 
@@ -743,14 +1171,348 @@ rpcb_unset(program, version, nconf)
 	(void) snprintf(uidbuf, sizeof uidbuf, "%d", geteuid());
 	parms.r_owner = uidbuf;
 
-	CLNT_CALL(client, (rpcproc_t)RPCBPROC_UNSET, (xdrproc_t) xdr_rpcb,
-	    (char *)(void *)&parms, (xdrproc_t) xdr_bool,
+	stat = rpcb_clnt_call(rh, (rpcproc_t)RPCBPROC_UNSET,
+	    (xdrproc_t) xdr_rpcb, (char *)(void *)&parms, (xdrproc_t) xdr_bool,
 	    (char *)(void *)&rslt, tottimeout);
 
-	CLNT_DESTROY(client);
+	rpcb_handle_put(rh, stat);
 	return (rslt);
 }
 
+/*
+ * The routines rpcb_batch_begin() and rpcb_batch_end() let a server
+ * register many services at startup without a round trip to rpcbind
+ * for each of them.  In between, rpcb_set() and rpcb_unset() on the
+ * calling thread (and thus svc_reg(), svc_create(), svc_tp_create(),
+ * pmap_set() and pmap_unset()) only queue the request and return TRUE.
+ * rpcb_batch_end() then sends the queued requests, in order, over a
+ * single connection to the local rpcbind, keeping up to
+ * RPCB_BATCH_WINDOW calls in flight.
+ */
+extern thread_key_t rpcb_batch_key;
+extern mutex_t tsd_lock;
+
+static void
+rpcb_batch_free(arg)
+	void *arg;
+{
+	struct rpcb_batch *batch = arg;
+	int i;
+
+	for (i = 0; i < batch->rb_nops; i++) {
+		free(batch->rb_ops[i].rb_netid);
+		free(batch->rb_ops[i].rb_addr);
+	}
+	free(batch->rb_ops);
+	free(batch);
+}
+
+static struct rpcb_batch *
+rpcb_batch_current()
+{
+	if (rpcb_batch_key == KEY_INITIALIZER)
+		return (NULL);
+	return ((struct rpcb_batch *)thr_getspecific(rpcb_batch_key));
+}
+
+static bool_t
+rpcb_batch_add(batch, proc, prog, vers, netid, addr)
+	struct rpcb_batch *batch;
+	rpcproc_t proc;
+	rpcprog_t prog;
+	rpcvers_t vers;
+	const char *netid, *addr;
+{
+	struct rpcb_batch_op *op;
+
+	if (batch->rb_nops == batch->rb_maxops) {
+		int maxops = batch->rb_maxops ? 2 * batch->rb_maxops : 32;
+
+		op = realloc(batch->rb_ops, maxops * sizeof (*op));
+		if (op == NULL) {
+			rpc_createerr.cf_stat = RPC_SYSTEMERROR;
+			return (FALSE);
+		}
+		batch->rb_ops = op;
+		batch->rb_maxops = maxops;
+	}
+	op = &batch->rb_ops[batch->rb_nops];
+	op->rb_netid = strdup(netid);
+	op->rb_addr = strdup(addr);
+	if (op->rb_netid == NULL || op->rb_addr == NULL) {
+		free(op->rb_netid);
+		free(op->rb_addr);
+		rpc_createerr.cf_stat = RPC_SYSTEMERROR;
+		return (FALSE);
+	}
+	op->rb_proc = proc;
+	op->rb_prog = prog;
+	op->rb_vers = vers;
+	op->rb_done = FALSE;
+	batch->rb_nops++;
+	return (TRUE);
+}
+
+static int
+rpcb_batch_read(handle, buf, len)
+	void *handle;
+	void *buf;
+	int len;
+{
+	struct rpcb_batch_conn *bc = handle;
+	struct pollfd pfd;
+
+	if (len == 0)
+		return (0);
+	pfd.fd = bc->bc_fd;
+	pfd.events = POLLIN;
+	for (;;) {
+		switch (poll(&pfd, 1, bc->bc_timeout)) {
+		case 0:
+			return (-1);
+		case -1:
+			if (errno == EINTR)
+				continue;
+			return (-1);
+		}
+		break;
+	}
+	len = read(bc->bc_fd, buf, (size_t)len);
+	return (len > 0 ? len : -1);
+}
+
+static int
+rpcb_batch_write(handle, buf, len)
+	void *handle;
+	void *buf;
+	int len;
+{
+	struct rpcb_batch_conn *bc = handle;
+	int i, cnt;
+
+	for (cnt = len; cnt > 0; cnt -= i, buf += i) {
+		if ((i = send(bc->bc_fd, buf, (size_t)cnt, MSG_NOSIGNAL)) == -1)
+			return (-1);
+	}
+	return (len);
+}
+
+/*
+ * Sends ops [first, last) without waiting for replies, then collects
+ * the replies.  Returns FALSE if the connection broke.
+ */
+static bool_t
+rpcb_batch_window(xdrs, batch, first, last, xid)
+	XDR *xdrs;
+	struct rpcb_batch *batch;
+	int first, last;
+	u_int32_t xid;
+{
+	struct rpcb_batch_op *op;
+	struct rpc_msg msg;
+	struct rpc_err err;
+	char uidbuf[32];
+	u_int32_t off;
+	bool_t rslt;
+	RPCB parms;
+	int i;
+
+	(void) snprintf(uidbuf, sizeof uidbuf, "%d", geteuid());
+	parms.r_owner = uidbuf;
+
+	xdrs->x_op = XDR_ENCODE;
+	for (i = first; i < last; i++) {
+		op = &batch->rb_ops[i];
+		msg.rm_xid = xid + i;
+		msg.rm_direction = CALL;
+		msg.rm_call.cb_rpcvers = RPC_MSG_VERSION;
+		msg.rm_call.cb_prog = RPCBPROG;
+		msg.rm_call.cb_vers = RPCBVERS;
+		msg.rm_call.cb_proc = op->rb_proc;
+		msg.rm_call.cb_cred = _null_auth;
+		msg.rm_call.cb_verf = _null_auth;
+		parms.r_prog = op->rb_prog;
+		parms.r_vers = op->rb_vers;
+		parms.r_netid = op->rb_netid;
+		parms.r_addr = op->rb_addr;
+		if (!xdr_callmsg(xdrs, &msg) || !xdr_rpcb(xdrs, &parms) ||
+		    !xdrrec_endofrecord(xdrs, i == last - 1))
+			return (FALSE);
+	}
+
+	xdrs->x_op = XDR_DECODE;
+	for (i = first; i < last; i++) {
+		rslt = FALSE;
+		msg.acpted_rply.ar_verf = _null_auth;
+		msg.acpted_rply.ar_results.where = (caddr_t)(void *)&rslt;
+		msg.acpted_rply.ar_results.proc = (xdrproc_t)xdr_bool;
+		if (!xdrrec_skiprecord(xdrs) || !xdr_replymsg(xdrs, &msg))
+			return (FALSE);
+		/* offset from the base xid, so a wrapped xid still matches */
+		off = (u_int32_t)(msg.rm_xid - xid);
+		if (off < (u_int32_t)first || off >= (u_int32_t)last)
+			continue;
+		_seterr_reply(&msg, &err);
+		if (err.re_status == RPC_SUCCESS)
+			batch->rb_ops[off].rb_done = rslt;
+		if (msg.acpted_rply.ar_verf.oa_base != NULL) {
+			xdrs->x_op = XDR_FREE;
+			(void)xdr_opaque_auth(xdrs, &msg.acpted_rply.ar_verf);
+			xdrs->x_op = XDR_DECODE;
+		}
+	}
+	return (TRUE);
+}
+
+/*
+ * Sends ops [first, rb_nops) one call at a time, for when no stream
+ * connection to rpcbind is available.  Ops already done are skipped.
+ */
+static void
+rpcb_batch_each(batch, first)
+	struct rpcb_batch *batch;
+	int first;
+{
+	struct rpcb_batch_op *op;
+	struct rpcb_handle *rh;
+	enum clnt_stat stat;
+	char uidbuf[32];
+	bool_t rslt;
+	RPCB parms;
+	int i;
+
+	(void) snprintf(uidbuf, sizeof uidbuf, "%d", geteuid());
+	parms.r_owner = uidbuf;
+
+	for (i = first; i < batch->rb_nops; i++) {
+		op = &batch->rb_ops[i];
+		if (op->rb_done)
+			continue;
+		if ((rh = rpcb_local_handle()) == NULL)
+			return;
+		parms.r_prog = op->rb_prog;
+		parms.r_vers = op->rb_vers;
+		parms.r_netid = op->rb_netid;
+		parms.r_addr = op->rb_addr;
+		rslt = FALSE;
+		stat = rpcb_clnt_call(rh, op->rb_proc, (xdrproc_t) xdr_rpcb,
+		    (char *)(void *)&parms, (xdrproc_t) xdr_bool,
+		    (char *)(void *)&rslt, tottimeout);
+		rpcb_handle_put(rh, stat);
+		if (stat == RPC_SUCCESS)
+			op->rb_done = rslt;
+	}
+}
+
+static void
+rpcb_batch_push(batch)
+	struct rpcb_batch *batch;
+{
+	struct rpcb_batch_conn bc;
+	struct __rpc_sockinfo si;
+	struct timeval now;
+	CLIENT *client;
+	u_int32_t xid;
+	XDR xdrs;
+	int i;
+
+	if (batch->rb_nops == 0)
+		return;
+
+	/*
+	 * A connection of our own: nothing else may read from it.
+	 * Without a stream to pipeline on, send the ops one by one.
+	 */
+	if ((client = local_rpcb(NULL)) == NULL) {
+		rpcb_batch_each(batch, 0);
+		return;
+	}
+	if (!CLNT_CONTROL(client, CLGET_FD, (char *)(void *)&bc.bc_fd) ||
+	    !__rpc_fd2sockinfo(bc.bc_fd, &si) ||
+	    si.si_socktype != SOCK_STREAM) {
+		CLNT_DESTROY(client);
+		rpcb_batch_each(batch, 0);
+		return;
+	}
+	bc.bc_timeout = tottimeout.tv_sec * 1000 + tottimeout.tv_usec / 1000;
+
+	(void) gettimeofday(&now, NULL);
+	xid = __RPC_GETXID(&now);
+
+	xdrrec_create(&xdrs, 0, 0, &bc, rpcb_batch_read, rpcb_batch_write);
+	for (i = 0; i < batch->rb_nops; i += RPCB_BATCH_WINDOW) {
+		if (!rpcb_batch_window(&xdrs, batch, i,
+		    MIN(i + RPCB_BATCH_WINDOW, batch->rb_nops), xid)) {
+			LIBTIRPC_DEBUG(1, ("rpcb_batch_end: lost rpcbind "
+			    "connection after %d of %d requests\n",
+			    i, batch->rb_nops));
+			break;
+		}
+	}
+	XDR_DESTROY(&xdrs);
+	CLNT_DESTROY(client);
+	if (i < batch->rb_nops)
+		rpcb_batch_each(batch, i);
+}
+
+/*
+ * Starts queueing rpcb_set()/rpcb_unset() requests on the calling thread.
+ * Returns FALSE if a batch is already open or no memory is available.
+ */
+bool_t
+rpcb_batch_begin()
+{
+	struct rpcb_batch *batch;
+
+	if (rpcb_batch_key == KEY_INITIALIZER) {
+		mutex_lock(&tsd_lock);
+		if (rpcb_batch_key == KEY_INITIALIZER)
+			thr_keycreate(&rpcb_batch_key, rpcb_batch_free);
+		mutex_unlock(&tsd_lock);
+	}
+	if (rpcb_batch_current() != NULL)
+		return (FALSE);
+	if ((batch = calloc(1, sizeof (struct rpcb_batch))) == NULL)
+		return (FALSE);
+	if (thr_setspecific(rpcb_batch_key, (void *) batch) != 0) {
+		free(batch);
+		return (FALSE);
+	}
+	return (TRUE);
+}
+
+/*
+ * Sends the requests queued since rpcb_batch_begin() to rpcbind.
+ * Returns the number of registrations (rpcb_set() requests) that
+ * rpcbind did not accept, or that could not be delivered.  Failed
+ * rpcb_unset() requests are not counted.
+ */
+int
+rpcb_batch_end()
+{
+	struct rpcb_batch *batch;
+	int i, failed = 0;
+
+	if ((batch = rpcb_batch_current()) == NULL)
+		return (0);
+	thr_setspecific(rpcb_batch_key, NULL);
+
+	rpcb_batch_push(batch);
+	for (i = 0; i < batch->rb_nops; i++) {
+		if (batch->rb_ops[i].rb_proc == RPCBPROC_SET &&
+		    !batch->rb_ops[i].rb_done) {
+			LIBTIRPC_DEBUG(1, ("rpcb_batch_end: could not register "
+			    "prog %lu vers %lu on %s\n",
+			    (u_long)batch->rb_ops[i].rb_prog,
+			    (u_long)batch->rb_ops[i].rb_vers,
+			    batch->rb_ops[i].rb_netid));
+			failed++;
+		}
+	}
+	rpcb_batch_free(batch);
+	return (failed);
+}
+
 #ifdef NOTUSED
 /*
  * From the merged list, find the appropriate entry
@@ -839,36 +1601,35 @@ __try_protocol_version_2(program, version, nconf, host, tp)
 	u_short port = 0;
 	struct netbuf remote;
 	struct pmap pmapparms;
-	CLIENT *client = NULL;
+	struct rpcb_handle *rh;
 	enum clnt_stat clnt_st;
 	struct netbuf *pmapaddress;
-	RPCB parms;
 
 	if (strcmp(nconf->nc_proto, NC_UDP) != 0
 	 && strcmp(nconf->nc_proto, NC_TCP) != 0)
 		return (NULL);
 
-	client = getpmaphandle(nconf, host, &parms.r_addr);
-	if (client == NULL)
-		goto error;
+	rh = getpmaphandle(nconf, host);
+	if (rh == NULL)
+		return (NULL);
 
 	/*
 	 * Set retry timeout.
 	 */
-	CLNT_CONTROL(client, CLSET_RETRY_TIMEOUT, (char *)&rpcbrmttime);
+	CLNT_CONTROL(rh->rh_clnt, CLSET_RETRY_TIMEOUT, (char *)&rpcbrmttime);
 
 	pmapparms.pm_prog = program;
 	pmapparms.pm_vers = version;
 	pmapparms.pm_prot = strcmp(nconf->nc_proto, NC_TCP) ?
 				IPPROTO_UDP : IPPROTO_TCP;
 	pmapparms.pm_port = 0;	/* not needed */
-	clnt_st = CLNT_CALL(client, (rpcproc_t)PMAPPROC_GETPORT,
+	clnt_st = rpcb_clnt_call(rh, (rpcproc_t)PMAPPROC_GETPORT,
 	    (xdrproc_t) xdr_pmap, (caddr_t)(void *)&pmapparms,
 	    (xdrproc_t) xdr_u_short, (caddr_t)(void *)&port,
 	    *tp);
 	if (clnt_st != RPC_SUCCESS) {
 		rpc_createerr.cf_stat = RPC_PMAPFAILURE;
-		clnt_geterr(client, &rpc_createerr.cf_error);
+		clnt_geterr(rh->rh_clnt, &rpc_createerr.cf_error);
 		goto error;
 	} else if (port == 0) {
 		pmapaddress = NULL;
@@ -876,13 +1637,13 @@ __try_protocol_version_2(program, version, nconf, host, tp)
 		goto error;
 	}
 	port = htons(port);
-	CLNT_CONTROL(client, CLGET_SVC_ADDR, (char *)&remote);
+	CLNT_CONTROL(rh->rh_clnt, CLGET_SVC_ADDR, (char *)&remote);
 	if (((pmapaddress = (struct netbuf *)
 		malloc(sizeof (struct netbuf))) == NULL) ||
 	    ((pmapaddress->buf = (char *)
 		malloc(remote.len)) == NULL)) {
 		rpc_createerr.cf_stat = RPC_SYSTEMERROR;
-		clnt_geterr(client, &rpc_createerr.cf_error);
+		clnt_geterr(rh->rh_clnt, &rpc_createerr.cf_error);
 		if (pmapaddress) {
 			free(pmapaddress);
 			pmapaddress = NULL;
@@ -894,31 +1655,18 @@ __try_protocol_version_2(program, version, nconf, host, tp)
 			(char *)(void *)&port, sizeof (short));
 	pmapaddress->len = pmapaddress->maxlen = remote.len;
 
-	CLNT_DESTROY(client);
-
-	if (parms.r_addr != NULL && parms.r_addr != nullstring)
-		free(parms.r_addr);
-
+	rpcb_handle_put(rh, clnt_st);
 	return pmapaddress;
 
 error:
-	if (client) {
-		CLNT_DESTROY(client);
-		client = NULL;
-
-	}
-
-	if (parms.r_addr != NULL && parms.r_addr != nullstring)
-		free(parms.r_addr);
-
+	rpcb_handle_put(rh, clnt_st);
 	return (NULL);
 
 }
 #endif
 
 /*
- * An internal function which optimizes rpcb_getaddr function.  It also
- * returns the client handle that it uses to contact the remote rpcbind.
+ * Does the actual rpcbind/portmap round trip for __rpcb_findaddr_timed().
  *
  * The algorithm used: If the transports is TCP or UDP, it first tries
  * version 4 (srv4), then 3 and then fall back to version 2 (portmap).
@@ -928,30 +1676,23 @@ error:
  *
  * For all other transports, the algorithm remains as 4 and then 3.
  *
- * XXX: Due to some problems with t_connect(), we do not reuse the same client
- * handle for COTS cases and hence in these cases we do not return the
- * client handle.  This code will change if t_connect() ever
- * starts working properly.  Also look under clnt_vc.c.
+ * The client handle used to contact rpcbind goes back to the handle
+ * pool; it is no longer handed to the caller for reuse.
  */
-struct netbuf *
-__rpcb_findaddr_timed(program, version, nconf, host, clpp, tp)
+static struct netbuf *
+rpcb_findaddr_remote(program, version, nconf, host, tp)
 	rpcprog_t program;
 	rpcvers_t version;
 	const struct netconfig *nconf;
 	const char *host;
-	CLIENT **clpp;
 	struct timeval *tp;
 {
-#ifdef NOTUSED
-	static bool_t check_rpcbind = TRUE;
-#endif
-
 #ifdef PORTMAP
 	static bool_t portmap_first = FALSE;
 #endif
-	CLIENT *client = NULL;
+	struct rpcb_handle *rh;
 	RPCB parms;
-	enum clnt_stat clnt_st;
+	enum clnt_stat clnt_st = RPC_SUCCESS;
 	char *ua = NULL;
 	rpcvers_t vers;
 	struct netbuf *address = NULL;
@@ -959,14 +1700,6 @@ __rpcb_findaddr_timed(program, version, nconf, host, clpp, tp)
 	struct netbuf servaddr;
 	struct rpc_err rpcerr;
 
-	/* parameter checking */
-	if (nconf == NULL) {
-		rpc_createerr.cf_stat = RPC_UNKNOWNPROTO;
-		return (NULL);
-	}
-
-	parms.r_addr = NULL;
-
 	/*
 	 * Use default total timeout if no timeout is specified.
 	 */
@@ -984,26 +1717,14 @@ __rpcb_findaddr_timed(program, version, nconf, host, clpp, tp)
 	 */
 	parms.r_owner = RPCB_OWNER_STRING;
 
-	/* Now the same transport is to be used to get the address */
-	if (client && ((nconf->nc_semantics == NC_TPI_COTS_ORD) ||
-			(nconf->nc_semantics == NC_TPI_COTS))) {
-		/* A CLTS type of client - destroy it */
-		CLNT_DESTROY(client);
-		client = NULL;
-		free(parms.r_addr);
-		parms.r_addr = NULL;
-	}
-
-	if (client == NULL) {
-		client = getclnthandle(host, nconf, &parms.r_addr);
-		if (client == NULL) {
-			goto error;
-		}
-	}
-	if (parms.r_addr == NULL) {
+	rh = rpcb_handle_get(host, nconf);
+	if (rh == NULL)
+		return (NULL);
+	if (rh->rh_uaddr != NULL)
+		parms.r_addr = rh->rh_uaddr;
+	else
 		/*LINTED const castaway*/
 		parms.r_addr = (char *) &nullstring[0];
-	}
 
 	/* First try from start_vers(4) and then version 3 (RPCBVERS), except
 	 * if env. var RPCB_V2FIRST is defined */
@@ -1017,11 +1738,11 @@ __rpcb_findaddr_timed(program, version, nconf, host, clpp, tp)
 #endif
 
 rpcbind:
-	CLNT_CONTROL(client, CLSET_RETRY_TIMEOUT, (char *) &rpcbrmttime);
+	CLNT_CONTROL(rh->rh_clnt, CLSET_RETRY_TIMEOUT, (char *) &rpcbrmttime);
 	for (vers = start_vers;  vers >= RPCBVERS; vers--) {
 		/* Set the version */
-		CLNT_CONTROL(client, CLSET_VERS, (char *)(void *)&vers);
-		clnt_st = CLNT_CALL(client, (rpcproc_t)RPCBPROC_GETADDR,
+		CLNT_CONTROL(rh->rh_clnt, CLSET_VERS, (char *)(void *)&vers);
+		clnt_st = rpcb_clnt_call(rh, (rpcproc_t)RPCBPROC_GETADDR,
 		    (xdrproc_t) xdr_rpcb, (char *)(void *)&parms,
 		    (xdrproc_t) xdr_wrapstring, (char *)(void *) &ua, *tp);
 		switch (clnt_st) {
@@ -1043,12 +1764,12 @@ rpcbind:
 				rpc_createerr.cf_stat = RPC_N2AXLATEFAILURE;
 				goto error;
 			}
-			CLNT_CONTROL(client, CLGET_SVC_ADDR,
+			CLNT_CONTROL(rh->rh_clnt, CLGET_SVC_ADDR,
 			    (char *)(void *)&servaddr);
 			__rpc_fixup_addr(address, &servaddr);
 			goto done;
 		case RPC_PROGVERSMISMATCH:
-			clnt_geterr(client, &rpcerr);
+			clnt_geterr(rh->rh_clnt, &rpcerr);
 			if (rpcerr.re_vers.low > RPCBVERS4)
 				goto error;  /* a new version, can't handle */
 			/* Try the next lower version */
@@ -1058,7 +1779,7 @@ rpcbind:
 		default:
 			/* Cant handle this error */
 			rpc_createerr.cf_stat = clnt_st;
-			clnt_geterr(client, &rpc_createerr.cf_error);
+			clnt_geterr(rh->rh_clnt, &rpc_createerr.cf_error);
 			goto error;
 		}
 	}
@@ -1080,32 +1801,316 @@ portmap:
 
 	if ((address == NULL) || (address->len == 0)) {
 	  rpc_createerr.cf_stat = RPC_PROGNOTREGISTERED;
-	  clnt_geterr(client, &rpc_createerr.cf_error);
+	  clnt_geterr(rh->rh_clnt, &rpc_createerr.cf_error);
 	}
 
 error:
-	if (client) {
-		CLNT_DESTROY(client);
-		client = NULL;
-	}
 done:
-	if (nconf->nc_semantics != NC_TPI_CLTS) {
-		/* This client is the connectionless one */
-		if (client) {
-			CLNT_DESTROY(client);
-			client = NULL;
+	rpcb_handle_put(rh, clnt_st);
+	return (address);
+}
+
+/*
+ * The routines lookup_find(), lookup_unlink() and lookup_expire() manage
+ * the cache of rpcbind lookups.  All of them are called with
+ * rpcbaddr_cache_lock held.
+ */
+static u_int32_t
+lookup_hash(host, netid, prog, vers)
+	const char *host, *netid;
+	rpcprog_t prog;
+	rpcvers_t vers;
+{
+	u_int32_t h = 2166136261U;	/* FNV-1a */
+	const char *cp;
+
+	for (cp = host; *cp; cp++)
+		h = (h ^ (u_char)*cp) * 16777619U;
+	h = (h ^ 0xff) * 16777619U;
+	for (cp = netid; *cp; cp++)
+		h = (h ^ (u_char)*cp) * 16777619U;
+	h = (h ^ (u_int32_t)prog) * 16777619U;
+	h = (h ^ (u_int32_t)vers) * 16777619U;
+	return (h);
+}
+
+static void
+lookup_free(lc)
+	struct lookup_cache *lc;
+{
+	if (lc->lc_addr != NULL) {
+		free(lc->lc_addr->buf);
+		free(lc->lc_addr);
+	}
+	free(lc->lc_host);
+	free(lc->lc_netid);
+	free(lc);
+}
+
+static struct lookup_cache *
+lookup_find(hash, host, netid, prog, vers)
+	u_int32_t hash;
+	const char *host, *netid;
+	rpcprog_t prog;
+	rpcvers_t vers;
+{
+	struct lookup_cache *lc;
+
+	for (lc = lookup_table[hash % LOOKUP_HASHSIZE]; lc != NULL;
+	    lc = lc->lc_next) {
+		if (lc->lc_hash == hash && lc->lc_prog == prog &&
+		    lc->lc_vers == vers && !strcmp(lc->lc_netid, netid) &&
+		    !strcmp(lc->lc_host, host))
+			return (lc);
+	}
+	return (NULL);
+}
+
+/*
+ * Takes an entry out of the table.  If threads are still waiting for
+ * its result, the last of them frees it.
+ */
+static void
+lookup_unlink(lc)
+	struct lookup_cache *lc;
+{
+	struct lookup_cache **lcp;
+
+	for (lcp = &lookup_table[lc->lc_hash % LOOKUP_HASHSIZE]; *lcp != NULL;
+	    lcp = &(*lcp)->lc_next) {
+		if (*lcp == lc) {
+			*lcp = lc->lc_next;
+			lookup_cachesize--;
+			break;
 		}
 	}
-	if (clpp) {
-		*clpp = client;
-	} else if (client) {
-		CLNT_DESTROY(client);
+	if (lc->lc_waiters > 0)
+		lc->lc_unlinked = TRUE;
+	else
+		lookup_free(lc);
+}
+
+/*
+ * Drops all resolved entries that have expired.  Only called when the
+ * table is full.
+ */
+static void
+lookup_expire(now)
+	time_t now;
+{
+	struct lookup_cache *lc, *next;
+	int i;
+
+	for (i = 0; i < LOOKUP_HASHSIZE; i++) {
+		for (lc = lookup_table[i]; lc != NULL; lc = next) {
+			next = lc->lc_next;
+			if (lc->lc_state == LOOKUP_DONE && lc->lc_expires <= now)
+				lookup_unlink(lc);
+		}
 	}
-	if (parms.r_addr != NULL && parms.r_addr != nullstring)
-		free(parms.r_addr);
+}
+
+static struct netbuf *
+lookup_copyaddr(addr)
+	const struct netbuf *addr;
+{
+	struct netbuf *copy;
+
+	if ((copy = malloc(sizeof (struct netbuf))) == NULL)
+		return (NULL);
+	if ((copy->buf = malloc(addr->len)) == NULL) {
+		free(copy);
+		return (NULL);
+	}
+	memcpy(copy->buf, addr->buf, addr->len);
+	copy->len = copy->maxlen = addr->len;
+	return (copy);
+}
+
+/*
+ * Returns the result of a resolved entry to the caller: a private copy of
+ * the address, or NULL with rpc_createerr set as the lookup left it.
+ */
+static struct netbuf *
+lookup_result(lc)
+	struct lookup_cache *lc;
+{
+	struct netbuf *address;
+
+	if (lc->lc_addr == NULL) {
+		rpc_createerr.cf_stat = lc->lc_stat;
+		rpc_createerr.cf_error = lc->lc_error;
+		return (NULL);
+	}
+	if ((address = lookup_copyaddr(lc->lc_addr)) == NULL)
+		rpc_createerr.cf_stat = RPC_SYSTEMERROR;
 	return (address);
 }
 
+/*
+ * An internal function which optimizes rpcb_getaddr function.  The
+ * handle used to contact rpcbind stays in the rpcbind handle pool, so
+ * *clpp is always set to NULL.
+ *
+ * Successful lookups are cached for lookup_ttl seconds and lookups that
+ * failed with RPC_PROGNOTREGISTERED for lookup_negttl seconds.  While one
+ * thread asks rpcbind, other threads looking up the same service wait
+ * for its answer rather than issuing their own GETADDR, each for no
+ * longer than its own timeout.  If cachedp is not NULL, *cachedp tells
+ * whether the answer came from the cache rather than from rpcbind.
+ */
+struct netbuf *
+__rpcb_findaddr_timed(program, version, nconf, host, clpp, tp, cachedp)
+	rpcprog_t program;
+	rpcvers_t version;
+	const struct netconfig *nconf;
+	const char *host;
+	CLIENT **clpp;
+	struct timeval *tp;
+	bool_t *cachedp;
+{
+	struct lookup_cache *lc;
+	struct netbuf *address;
+	struct timespec deadline;
+	struct timeval now_tv;
+	const char *key;
+	u_int32_t hash;
+	time_t now;
+	int ttl;
+
+	if (clpp)
+		*clpp = NULL;
+	if (cachedp)
+		*cachedp = FALSE;
+
+	/* parameter checking */
+	if (nconf == NULL) {
+		rpc_createerr.cf_stat = RPC_UNKNOWNPROTO;
+		return (NULL);
+	}
+
+	key = host ? host : "";
+	hash = lookup_hash(key, nconf->nc_netid, program, version);
+
+	mutex_lock(&rpcbaddr_cache_lock);
+	now = rpcb_now();
+	lc = lookup_find(hash, key, nconf->nc_netid, program, version);
+	if (lc != NULL && lc->lc_state == LOOKUP_PENDING) {
+		if (tp == NULL)
+			tp = &tottimeout;
+		gettimeofday(&now_tv, NULL);
+		deadline.tv_sec = now_tv.tv_sec + tp->tv_sec;
+		deadline.tv_nsec = (now_tv.tv_usec + tp->tv_usec) * 1000;
+		if (deadline.tv_nsec >= 1000000000) {
+			deadline.tv_sec++;
+			deadline.tv_nsec -= 1000000000;
+		}
+		lc->lc_waiters++;
+		while (lc->lc_state == LOOKUP_PENDING &&
+		       pthread_cond_timedwait(&lookup_cv, &rpcbaddr_cache_lock,
+					      &deadline) == 0)
+			continue;
+		lc->lc_waiters--;
+		if (lc->lc_state == LOOKUP_PENDING) {
+			rpc_createerr.cf_stat = RPC_TIMEDOUT;
+			address = NULL;
+		} else
+			address = lookup_result(lc);
+		if (lc->lc_unlinked && lc->lc_waiters == 0)
+			lookup_free(lc);
+		mutex_unlock(&rpcbaddr_cache_lock);
+		return (address);
+	}
+	if (lc != NULL && lc->lc_expires > now) {
+		LIBTIRPC_DEBUG(3, ("__rpcb_findaddr_timed: cached %s %s %lu/%lu\n",
+			key, nconf->nc_netid, (u_long)program, (u_long)version));
+		address = lookup_result(lc);
+		if (cachedp)
+			*cachedp = TRUE;
+		mutex_unlock(&rpcbaddr_cache_lock);
+		return (address);
+	}
+	if (lc != NULL)
+		lookup_unlink(lc);
+	if (lookup_cachesize >= LOOKUP_CACHESIZE)
+		lookup_expire(now);
+
+	/* Publish a pending entry, then ask rpcbind without the lock held */
+	lc = NULL;
+	if (lookup_cachesize < LOOKUP_CACHESIZE &&
+	    (lc = calloc(1, sizeof (struct lookup_cache))) != NULL) {
+		lc->lc_host = strdup(key);
+		lc->lc_netid = strdup(nconf->nc_netid);
+		if (lc->lc_host == NULL || lc->lc_netid == NULL) {
+			lookup_free(lc);
+			lc = NULL;
+		} else {
+			lc->lc_hash = hash;
+			lc->lc_prog = program;
+			lc->lc_vers = version;
+			lc->lc_state = LOOKUP_PENDING;
+			lc->lc_next = lookup_table[hash % LOOKUP_HASHSIZE];
+			lookup_table[hash % LOOKUP_HASHSIZE] = lc;
+			lookup_cachesize++;
+		}
+	}
+	mutex_unlock(&rpcbaddr_cache_lock);
+
+	address = rpcb_findaddr_remote(program, version, nconf, host, tp);
+	if (lc == NULL)
+		return (address);
+
+	mutex_lock(&rpcbaddr_cache_lock);
+	if (address != NULL) {
+		lc->lc_addr = lookup_copyaddr(address);
+		ttl = lc->lc_addr ? lookup_ttl : 0;
+	} else {
+		lc->lc_stat = rpc_createerr.cf_stat;
+		lc->lc_error = rpc_createerr.cf_error;
+		ttl = (rpc_createerr.cf_stat == RPC_PROGNOTREGISTERED) ?
+			lookup_negttl : 0;
+	}
+	if (lc->lc_addr == NULL && address != NULL)
+		lc->lc_stat = RPC_SYSTEMERROR;
+	lc->lc_expires = rpcb_now() + ttl;
+	lc->lc_state = LOOKUP_DONE;
+	if (ttl == 0)
+		lookup_unlink(lc);
+	cond_broadcast(&lookup_cv);
+	mutex_unlock(&rpcbaddr_cache_lock);
+	return (address);
+}
+
+/*
+ * Forgets the cached address of a service, e.g. because connecting to it
+ * failed.  Returns TRUE if there was an entry to drop.
+ */
+bool_t
+__rpcb_invalidate(program, version, nconf, host)
+	rpcprog_t program;
+	rpcvers_t version;
+	const struct netconfig *nconf;
+	const char *host;
+{
+	struct lookup_cache *lc;
+	const char *key;
+	u_int32_t hash;
+
+	if (nconf == NULL)
+		return (FALSE);
+
+	key = host ? host : "";
+	hash = lookup_hash(key, nconf->nc_netid, program, version);
+
+	mutex_lock(&rpcbaddr_cache_lock);
+	lc = lookup_find(hash, key, nconf->nc_netid, program, version);
+	if (lc != NULL && lc->lc_state == LOOKUP_DONE)
+		lookup_unlink(lc);
+	else
+		lc = NULL;
+	mutex_unlock(&rpcbaddr_cache_lock);
+	return (lc != NULL);
+}
 
 /*
  * Find the mapped address for program, version.
@@ -1127,7 +2132,7 @@ rpcb_getaddr(program, version, nconf, address, host)
 
 	if ((na = __rpcb_findaddr_timed(program, version,
 	    (struct netconfig *) nconf, (char *) host,
-	    (CLIENT **) NULL, (struct timeval *) NULL)) == NULL)
+	    (CLIENT **) NULL, (struct timeval *) NULL, NULL)) == NULL)
 		return (FALSE);
 
 	if (na->len > address->maxlen) {
@@ -1157,15 +2162,15 @@ rpcb_getmaps(nconf, host)
 	const char *host;
 {
 	rpcblist_ptr head = NULL;
-	CLIENT *client;
+	struct rpcb_handle *rh;
 	enum clnt_stat clnt_st;
 	rpcvers_t vers = 0;
 
-	client = getclnthandle(host, nconf, NULL);
-	if (client == NULL) {
+	rh = rpcb_handle_get(host, nconf);
+	if (rh == NULL) {
 		return (head);
 	}
-	clnt_st = CLNT_CALL(client, (rpcproc_t)RPCBPROC_DUMP,
+	clnt_st = rpcb_clnt_call(rh, (rpcproc_t)RPCBPROC_DUMP,
 	    (xdrproc_t) xdr_void, NULL, (xdrproc_t) xdr_rpcblist_ptr,
 	    (char *)(void *)&head, tottimeout);
 	if (clnt_st == RPC_SUCCESS)
@@ -1174,25 +2179,26 @@ rpcb_getmaps(nconf, host)
 	if ((clnt_st != RPC_PROGVERSMISMATCH) &&
 	    (clnt_st != RPC_PROGUNAVAIL)) {
 		rpc_createerr.cf_stat = RPC_RPCBFAILURE;
-		clnt_geterr(client, &rpc_createerr.cf_error);
+		clnt_geterr(rh->rh_clnt, &rpc_createerr.cf_error);
 		goto done;
 	}
 
 	/* fall back to earlier version */
-	CLNT_CONTROL(client, CLGET_VERS, (char *)(void *)&vers);
+	CLNT_CONTROL(rh->rh_clnt, CLGET_VERS, (char *)(void *)&vers);
 	if (vers == RPCBVERS4) {
 		vers = RPCBVERS;
-		CLNT_CONTROL(client, CLSET_VERS, (char *)(void *)&vers);
-		if (CLNT_CALL(client, (rpcproc_t)RPCBPROC_DUMP,
+		CLNT_CONTROL(rh->rh_clnt, CLSET_VERS, (char *)(void *)&vers);
+		clnt_st = rpcb_clnt_call(rh, (rpcproc_t)RPCBPROC_DUMP,
 		    (xdrproc_t) xdr_void, NULL, (xdrproc_t) xdr_rpcblist_ptr,
-		    (char *)(void *)&head, tottimeout) == RPC_SUCCESS)
+		    (char *)(void *)&head, tottimeout);
+		if (clnt_st == RPC_SUCCESS)
 			goto done;
 	}
 	rpc_createerr.cf_stat = RPC_RPCBFAILURE;
-	clnt_geterr(client, &rpc_createerr.cf_error);
+	clnt_geterr(rh->rh_clnt, &rpc_createerr.cf_error);
 
 done:
-	CLNT_DESTROY(client);
+	rpcb_handle_put(rh, clnt_st);
 	return (head);
 }
 
@@ -1216,19 +2222,20 @@ rpcb_rmtcall(nconf, host, prog, vers, proc, xdrargs, argsp,
 	struct timeval tout;		/* Timeout value for this call */
 	const struct netbuf *addr_ptr;	/* Preallocated netbuf address */
 {
-	CLIENT *client;
+	struct rpcb_handle *rh;
 	enum clnt_stat stat;
 	struct r_rpcb_rmtcallargs a;
 	struct r_rpcb_rmtcallres r;
 	rpcvers_t rpcb_vers;
 
 	stat = 0;
-	client = getclnthandle(host, nconf, NULL);
-	if (client == NULL) {
+	rh = rpcb_handle_get(host, nconf);
+	if (rh == NULL) {
 		return (RPC_FAILED);
 	}
 	/*LINTED const castaway*/
-	CLNT_CONTROL(client, CLSET_RETRY_TIMEOUT, (char *)(void *)&rmttimeout);
+	CLNT_CONTROL(rh->rh_clnt, CLSET_RETRY_TIMEOUT,
+	    (char *)(void *)&rmttimeout);
 	a.prog = prog;
 	a.vers = vers;
 	a.proc = proc;
@@ -1239,8 +2246,9 @@ rpcb_rmtcall(nconf, host, prog, vers, proc, xdrargs, argsp,
 	r.xdr_res = xdrres;
 
 	for (rpcb_vers = RPCBVERS4; rpcb_vers >= RPCBVERS; rpcb_vers--) {
-		CLNT_CONTROL(client, CLSET_VERS, (char *)(void *)&rpcb_vers);
-		stat = CLNT_CALL(client, (rpcproc_t)RPCBPROC_CALLIT,
+		CLNT_CONTROL(rh->rh_clnt, CLSET_VERS,
+		    (char *)(void *)&rpcb_vers);
+		stat = rpcb_clnt_call(rh, (rpcproc_t)RPCBPROC_CALLIT,
 		    (xdrproc_t) xdr_rpcb_rmtcallargs, (char *)(void *)&a,
 		    (xdrproc_t) xdr_rpcb_rmtcallres, (char *)(void *)&r, tout);
 		if ((stat == RPC_SUCCESS) && (addr_ptr != NULL)) {
@@ -1274,7 +2282,7 @@ rpcb_rmtcall(nconf, host, prog, vers, proc, xdrargs, argsp,
 		}
 	}
 error:
-	CLNT_DESTROY(client);
+	rpcb_handle_put(rh, stat);
 	if (r.addr)
 		xdr_free((xdrproc_t) xdr_wrapstring, (char *)(void *)&r.addr);
 	return (stat);
@@ -1289,7 +2297,7 @@ rpcb_gettime(host, timep)
 	const char *host;
 	time_t *timep;
 {
-	CLIENT *client = NULL;
+	struct rpcb_handle *rh = NULL;
 	void *handle;
 	struct netconfig *nconf;
 	rpcvers_t vers;
@@ -1305,38 +2313,39 @@ rpcb_gettime(host, timep)
 		return (FALSE);
 	}
 	rpc_createerr.cf_stat = RPC_SUCCESS;
-	while (client == NULL) {
+	while (rh == NULL) {
 		if ((nconf = __rpc_getconf(handle)) == NULL) {
 			if (rpc_createerr.cf_stat == RPC_SUCCESS)
 				rpc_createerr.cf_stat = RPC_UNKNOWNPROTO;
 			break;
 		}
-		client = getclnthandle(host, nconf, NULL);
-		if (client)
+		rh = rpcb_handle_get(host, nconf);
+		if (rh)
 			break;
 	}
 	__rpc_endconf(handle);
-	if (client == (CLIENT *) NULL) {
+	if (rh == NULL) {
 		return (FALSE);
 	}
 
-	st = CLNT_CALL(client, (rpcproc_t)RPCBPROC_GETTIME,
+	st = rpcb_clnt_call(rh, (rpcproc_t)RPCBPROC_GETTIME,
 		(xdrproc_t) xdr_void, NULL,
 		(xdrproc_t) xdr_int, (char *)(void *)timep, tottimeout);
 
 	if ((st == RPC_PROGVERSMISMATCH) || (st == RPC_PROGUNAVAIL)) {
-		CLNT_CONTROL(client, CLGET_VERS, (char *)(void *)&vers);
+		CLNT_CONTROL(rh->rh_clnt, CLGET_VERS, (char *)(void *)&vers);
 		if (vers == RPCBVERS4) {
 			/* fall back to earlier version */
 			vers = RPCBVERS;
-			CLNT_CONTROL(client, CLSET_VERS, (char *)(void *)&vers);
-			st = CLNT_CALL(client, (rpcproc_t)RPCBPROC_GETTIME,
+			CLNT_CONTROL(rh->rh_clnt, CLSET_VERS,
+			    (char *)(void *)&vers);
+			st = rpcb_clnt_call(rh, (rpcproc_t)RPCBPROC_GETTIME,
 				(xdrproc_t) xdr_void, NULL,
 				(xdrproc_t) xdr_int, (char *)(void *)timep,
 				tottimeout);
 		}
 	}
-	CLNT_DESTROY(client);
+	rpcb_handle_put(rh, st);
 	return (st == RPC_SUCCESS? TRUE: FALSE);
 }
 
@@ -1349,7 +2358,8 @@ rpcb_taddr2uaddr(nconf, taddr)
 	struct netconfig *nconf;
 	struct netbuf *taddr;
 {
-	CLIENT *client;
+	struct rpcb_handle *rh;
+	enum clnt_stat stat;
 	char *uaddr = NULL;
 
 
@@ -1362,15 +2372,15 @@ rpcb_taddr2uaddr(nconf, taddr)
 		rpc_createerr.cf_stat = RPC_UNKNOWNADDR;
 		return (NULL);
 	}
-	client = local_rpcb(NULL);
-	if (! client) {
+	rh = rpcb_local_handle();
+	if (! rh) {
 		return (NULL);
 	}
 
-	CLNT_CALL(client, (rpcproc_t)RPCBPROC_TADDR2UADDR,
+	stat = rpcb_clnt_call(rh, (rpcproc_t)RPCBPROC_TADDR2UADDR,
 	    (xdrproc_t) xdr_netbuf, (char *)(void *)taddr,
 	    (xdrproc_t) xdr_wrapstring, (char *)(void *)&uaddr, tottimeout);
-	CLNT_DESTROY(client);
+	rpcb_handle_put(rh, stat);
 	return (uaddr);
 }
 
@@ -1383,7 +2393,8 @@ rpcb_uaddr2taddr(nconf, uaddr)
 	struct netconfig *nconf;
 	char *uaddr;
 {
-	CLIENT *client;
+	struct rpcb_handle *rh;
+	enum clnt_stat stat;
 	struct netbuf *taddr;
 
 
@@ -1396,23 +2407,24 @@ rpcb_uaddr2taddr(nconf, uaddr)
 		rpc_createerr.cf_stat = RPC_UNKNOWNADDR;
 		return (NULL);
 	}
-	client = local_rpcb(NULL);
-	if (! client) {
+	rh = rpcb_local_handle();
+	if (! rh) {
 		return (NULL);
 	}
 
 	taddr = (struct netbuf *)calloc(1, sizeof (struct netbuf));
 	if (taddr == NULL) {
-		CLNT_DESTROY(client);
+		rpcb_handle_put(rh, RPC_SUCCESS);
 		return (NULL);
 	}
-	if (CLNT_CALL(client, (rpcproc_t)RPCBPROC_UADDR2TADDR,
+	stat = rpcb_clnt_call(rh, (rpcproc_t)RPCBPROC_UADDR2TADDR,
 	    (xdrproc_t) xdr_wrapstring, (char *)(void *)&uaddr,
 	    (xdrproc_t) xdr_netbuf, (char *)(void *)taddr,
-	    tottimeout) != RPC_SUCCESS) {
+	    tottimeout);
+	if (stat != RPC_SUCCESS) {
 		free(taddr);
 		taddr = NULL;
 	}
-	CLNT_DESTROY(client);
+	rpcb_handle_put(rh, stat);
 	return (taddr);
 }
@@ -59,6 +59,10 @@
 
 SVCXPRT **__svc_xports;
 int __svc_maxrec;
+int __svc_arena;
+int __svc_gsswin = 128;
+int __svc_gssestab = 4;
+int __svc_gssqueue = 64;
 
 /*
  * The services list
@@ -669,6 +673,20 @@ svc_getreqset (readfds)
     }
 }
 
+/*
+ * The request has been answered, or never will be: lets go of what
+ * authenticating it took hold of.  Doesn't touch the transport, which
+ * the dispatch routine may have destroyed.
+ */
+static void
+svc_req_done (r)
+     struct svc_req *r;
+{
+#ifdef HAVE_RPCSEC_GSS
+  __svcauth_gss_done (r);
+#endif
+}
+
 void
 svc_getreq_common (fd)
      int fd;
@@ -713,10 +731,14 @@ svc_getreq_common (fd)
 	  if (why != AUTH_OK)
 	    {
 	      svcerr_auth (xprt, why);
+	      svc_req_done (&r);
 	      goto call_done;
 	    }
 	  if (no_dispatch)
-	    goto call_done;
+	    {
+	      svc_req_done (&r);
+	      goto call_done;
+	    }
 	  /* now match message with a registered service */
 	  prog_found = FALSE;
 	  low_vers = (rpcvers_t) - 1L;
@@ -728,6 +750,7 @@ svc_getreq_common (fd)
 		  if (s->sc_vers == r.rq_vers)
 		    {
 		      (*s->sc_dispatch) (&r, xprt);
+		      svc_req_done (&r);
 		      goto call_done;
 		    }		/* found correct version */
 		  prog_found = TRUE;
@@ -745,6 +768,7 @@ svc_getreq_common (fd)
 	    svcerr_progvers (xprt, low_vers, high_vers);
 	  else
 	    svcerr_noprog (xprt);
+	  svc_req_done (&r);
 	  /* Fall through to ... */
 	}
       /*
@@ -823,12 +847,145 @@ rpc_control (int what, void *arg)
        printf("get mode = %d\n", __svc_mtmode);
        *(int *) arg = __svc_mtmode;
        return TRUE;
+    case RPC_SVC_ARENA_SET:
+      val = *(int *) arg;
+      if (val < RPC_SVC_ARENA_NONE || val > RPC_SVC_ARENA_BORROW)
+	return FALSE;
+      __svc_arena = val;
+      return TRUE;
+    case RPC_SVC_ARENA_GET:
+      *(int *) arg = __svc_arena;
+      return TRUE;
+    case RPC_SVC_GSSWIN_SET:
+      val = *(int *) arg;
+      if (val < 32 || val > 4096)
+	return FALSE;
+      /* the replay bitmap is kept in whole words */
+      __svc_gsswin = (val + 31) & ~31;
+      return TRUE;
+    case RPC_SVC_GSSWIN_GET:
+      *(int *) arg = __svc_gsswin;
+      return TRUE;
+    case RPC_SVC_GSSESTAB_SET:
+      val = *(int *) arg;
+      if (val < 1)
+	return FALSE;
+      __svc_gssestab = val;
+      return TRUE;
+    case RPC_SVC_GSSESTAB_GET:
+      *(int *) arg = __svc_gssestab;
+      return TRUE;
+    case RPC_SVC_GSSQUEUE_SET:
+      val = *(int *) arg;
+      if (val < 0)
+	return FALSE;
+      __svc_gssqueue = val;
+      return TRUE;
+    case RPC_SVC_GSSQUEUE_GET:
+      *(int *) arg = __svc_gssqueue;
+      return TRUE;
+    case RPC_RPCB_CACHETTL_SET:
+    case RPC_RPCB_CACHETTL_GET:
+    case RPC_RPCB_NEGCACHETTL_SET:
+    case RPC_RPCB_NEGCACHETTL_GET:
+      return __rpc_control (what, arg);
+    case RPC_GROUPS_CACHETTL_SET:
+    case RPC_GROUPS_CACHETTL_GET:
+    case RPC_GROUPS_NEGCACHETTL_SET:
+    case RPC_GROUPS_NEGCACHETTL_GET:
+      return __rpc_groups_control (what, arg);
+#ifdef AUTHDES_SUPPORT
+    case RPC_SVC_DESCACHE_SET:
+    case RPC_SVC_DESCACHE_GET:
+    case RPC_SVC_DESSTATS_GET:
+      return __svcauth_des_control (what, arg);
+#endif
     default:
       break;
     }
   return FALSE;
 }
 
+/*
+ * Argument decoding for the connection-oriented and datagram
+ * transports.  With RPC_SVC_ARENA_SET the arguments are decoded into
+ * an arena kept with the transport, which svc_freeargs() simply resets.
+ * borrow says whether xdrs holds the whole request until the reply and
+ * the reply is encoded elsewhere.
+ */
+bool_t
+__svc_getargs (SVCXPRT *xprt, XDR *xdrs, xdrproc_t xdr_args, void *args_ptr,
+	       bool_t borrow)
+{
+  SVCXPRT_EXT *ext = SVCEXT (xprt);
+  bool_t stat;
+
+  if (!__svc_arena)
+    return SVCAUTH_UNWRAP (&ext->xp_auth, xdrs, xdr_args, args_ptr);
+  if (ext->xp_arena == NULL
+      && (ext->xp_arena = xdr_arena_create (0)) == NULL)
+    return SVCAUTH_UNWRAP (&ext->xp_auth, xdrs, xdr_args, args_ptr);
+
+  xdr_arena_reset (ext->xp_arena);
+  /* authentication flavors may unwrap through streams of their own */
+  xdr_arena_bind (NULL, ext->xp_arena);
+  if (__svc_arena == RPC_SVC_ARENA_BORROW && borrow)
+    xdr_arena_borrow (xdrs);
+  stat = SVCAUTH_UNWRAP (&ext->xp_auth, xdrs, xdr_args, args_ptr);
+  xdr_arena_bind (NULL, NULL);
+  return stat;
+}
+
+bool_t
+__svc_freeargs (SVCXPRT *xprt, XDR *xdrs, xdrproc_t xdr_args, void *args_ptr)
+{
+  SVCXPRT_EXT *ext = SVCEXT (xprt);
+
+  if (ext->xp_arena != NULL)
+    {
+      xdr_arena_reset (ext->xp_arena);
+      return TRUE;
+    }
+  xdrs->x_op = XDR_FREE;
+  return (*xdr_args) (xdrs, args_ptr);
+}
+
+struct replysize_args
+{
+  struct rpc_msg *msg;
+  xdrproc_t xdr_results;
+  void *xdr_location;
+};
+
+static bool_t
+xdr_replysize (XDR *xdrs, struct replysize_args *ra)
+{
+  return (xdr_replymsg (xdrs, ra->msg)
+	  && (ra->xdr_results == NULL
+	      || (*ra->xdr_results) (xdrs, ra->xdr_location)));
+}
+
+/*
+ * The encoded size of a reply whose results (if xdr_results is not
+ * NULL) follow msg, or 0 if it cannot be known without encoding it:
+ * flavors that wrap the results (RPCSEC_GSS) are not sized.
+ */
+u_long
+__svc_replysize (SVCXPRT *xprt, struct rpc_msg *msg, xdrproc_t xdr_results,
+		 void *xdr_location)
+{
+  extern SVCAUTH svc_auth_none;
+  struct replysize_args ra;
+
+  if (xdr_results != NULL
+      && SVC_XP_AUTH (xprt).svc_ah_ops != svc_auth_none.svc_ah_ops)
+    return 0;
+  ra.msg = msg;
+  ra.xdr_results = xdr_results;
+  ra.xdr_location = xdr_location;
+  return xdr_sizeof ((xdrproc_t) xdr_replysize, &ra);
+}
+
 SVCXPRT *get_svc_xprt(int sock) 
 {
   assert (__svc_xports != NULL);
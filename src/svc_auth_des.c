@@ -60,6 +60,7 @@
 #include <rpc/svc.h>
 #include <rpc/rpc_msg.h>
 #include <rpc/svc_auth.h>
+#include "rpc_com.h"
 #if defined(__FreeBSD__) || defined(__NetBSD__)
 #include <libc_private.h>
 #endif
@@ -72,33 +73,59 @@ extern int key_decryptsession_pk(const char *, netobj *, des_block *);
 #define BEFORE(t1, t2) timercmp(t1, t2, <)
 
 /*
- * LRU cache of conversation keys and some other useful items.
+ * LRU cache of conversation keys and some other useful items, indexed
+ * by the nickname handed out to the client.  The cache is split into
+ * AUTHDES_STRIPES stripes with a lock, an LRU list and counters each;
+ * nickname n belongs to stripe n % AUTHDES_STRIPES, and a client's
+ * full-name credentials are always looked for in the stripe its name
+ * hashes to.  Within a stripe, entries are hashed by client name and
+ * the conversation key as the client encrypted it, so a client that
+ * sends the same full-name credential again is recognized without a
+ * round trip to keyserv.
  */
-#define AUTHDES_CACHESZ 64
+#define AUTHDES_CACHESZ 1024		/* RPC_SVC_DESCACHE_SET */
+#define AUTHDES_CACHEMAX 65536
+#define AUTHDES_STRIPES 16
+#define AUTHDES_NONE (-1)		/* end of a hash chain or LRU list */
+
 struct cache_entry {
 	des_block key;		/* conversation key */
+	des_block xkey;		/* conversation key, as sent */
 	char *rname;		/* client's name */
 	u_int window;		/* credential lifetime window */
 	struct timeval laststamp;	/* detect replays of creds */
 	char *localcred;	/* generic local credential */
+	int hnext;		/* hash chain */
+	int lprev, lnext;	/* LRU list, most recent first */
+};
+
+struct cache_stripe {
+	mutex_t lock;
+	int nbuckets;
+	int *hash;		/* [nbuckets] */
+	int lru_head, lru_tail;
+	struct svcauthdes_stats stats;
 };
-static struct cache_entry *authdes_cache/* [AUTHDES_CACHESZ] */;
-static short *authdes_lru/* [AUTHDES_CACHESZ] */;
+
+static struct cache_entry *authdes_cache/* [authdes_cachesz] */;
+static struct cache_stripe authdes_stripes[AUTHDES_STRIPES];
+static int authdes_cachesz = AUTHDES_CACHESZ;
+static once_t authdes_cache_once = ONCE_INITIALIZER;
 
 static void cache_init();	/* initialize the cache */
-static short cache_spot(des_block *key, char *name, struct timeval *timestamp);  /* find an entry in the cache */
-static void cache_ref(short sid);	/* note that sid was ref'd */
+static struct cache_stripe *cache_stripe(char *name, des_block *xkey,
+    int *bucket);		/* where a full-name credential lives */
+static int cache_find(struct cache_stripe *st, int bucket, char *name,
+    des_block *xkey);		/* find an entry in the cache */
+static int cache_spot(struct cache_stripe *st, int bucket, char *name,
+    des_block *xkey, des_block *key, struct timeval *timestamp);
+static void cache_enter(struct cache_stripe *st, int bucket, int sid,
+    char *name, des_block *xkey);
+static void cache_ref(struct cache_stripe *st, int sid);	/* note that sid was ref'd */
 
 static void invalidate(char *cred);	/* invalidate entry in cache */
 
-/*
- * cache statistics
- */
-static struct {
-	u_long ncachehits;	/* times cache hit, and is not replay */
-	u_long ncachereplays;	/* times cache hit, and is replay */
-	u_long ncachemisses;	/* times cache missed */
-} svcauthdes_stats;
+#define	SID_STRIPE(sid)	(&authdes_stripes[(sid) % AUTHDES_STRIPES])
 
 /*
  * Service side authenticator for AUTH_DES
@@ -115,19 +142,25 @@ _svcauth_des(rqst, msg)
 	struct authdes_verf verf;
 	int status;
 	struct cache_entry *entry;
-	short sid = 0;
-	des_block *sessionkey;
+	struct cache_stripe *st;
+	int sid = 0;
+	int bucket = 0;
+	des_block sessionkey;
+	des_block xkey;
 	des_block ivec;
-	u_int window;
+	u_int window = 0;
 	struct timeval timestamp;
+	struct timeval laststamp = { 0, 0 };
 	u_long namelen;
 	struct area {
 		struct authdes_cred area_cred;
 		char area_netname[MAXNETNAMELEN+1];
 	} *area;
 
+	thr_once(&authdes_cache_once, cache_init);
 	if (authdes_cache == NULL) {
-		cache_init();
+		LIBTIRPC_DEBUG(1, ("_svcauth_des: out of memory"));
+		return (AUTH_FAILED);
 	}
 
 	area = (struct area *)rqst->rq_clntcred;
@@ -176,25 +209,52 @@ _svcauth_des(rqst, msg)
 		netobj pkey;
 		char pkey_data[1024];
 
-		sessionkey = &cred->adc_fullname.key;
-		if (! getpublickey(cred->adc_fullname.name, pkey_data)) {
-			LIBTIRPC_DEBUG(1, ("_svcauth_des: getpublickey failed"));
-			return(AUTH_BADCRED);
-		}
-		pkey.n_bytes = pkey_data;
-		pkey.n_len = strlen(pkey_data) + 1;
-		if (key_decryptsession_pk(cred->adc_fullname.name, &pkey,
-				       sessionkey) < 0) {
-			LIBTIRPC_DEBUG(1, ("_svcauth_des: key_decryptsessionkey failed"));
-			return (AUTH_BADCRED); /* key not found */
+		xkey = cred->adc_fullname.key;
+		st = cache_stripe(cred->adc_fullname.name, &xkey, &bucket);
+		mutex_lock(&st->lock);
+		sid = cache_find(st, bucket, cred->adc_fullname.name, &xkey);
+		if (sid != AUTHDES_NONE) {
+			st->stats.nkeyhits++;
+			sessionkey = authdes_cache[sid].key;
+		} else
+			st->stats.nkeymisses++;
+		mutex_unlock(&st->lock);
+
+		if (sid == AUTHDES_NONE) {
+			if (! getpublickey(cred->adc_fullname.name, pkey_data)) {
+				LIBTIRPC_DEBUG(1, ("_svcauth_des: getpublickey failed"));
+				return(AUTH_BADCRED);
+			}
+			pkey.n_bytes = pkey_data;
+			pkey.n_len = strlen(pkey_data) + 1;
+			sessionkey = xkey;
+			if (key_decryptsession_pk(cred->adc_fullname.name,
+					&pkey, &sessionkey) < 0) {
+				LIBTIRPC_DEBUG(1, ("_svcauth_des: key_decryptsessionkey failed"));
+				return (AUTH_BADCRED); /* key not found */
+			}
 		}
 	} else { /* ADN_NICKNAME */	
-		sid = (short)cred->adc_nickname;
-		if (sid < 0 || sid >= AUTHDES_CACHESZ) {
+		if (cred->adc_nickname >= (u_long)authdes_cachesz) {
 			LIBTIRPC_DEBUG(1, ("_svcauth_des: bad nickname"));
 			return (AUTH_BADCRED);	/* garbled credential */
 		}
-		sessionkey = &authdes_cache[sid].key;
+		sid = (int)cred->adc_nickname;
+		st = SID_STRIPE(sid);
+		entry = &authdes_cache[sid];
+		mutex_lock(&st->lock);
+		if (entry->rname == NULL) {
+			st->stats.ncachemisses++;
+			mutex_unlock(&st->lock);
+			LIBTIRPC_DEBUG(1, ("_svcauth_des: nickname not in use"));
+			return (AUTH_REJECTEDVERF);
+		}
+		sessionkey = entry->key;
+		window = entry->window;
+		laststamp = entry->laststamp;
+		/* the entry may be reused once we let go of it */
+		strcpy(area->area_netname, entry->rname);
+		mutex_unlock(&st->lock);
 	}
 
 
@@ -206,11 +266,11 @@ _svcauth_des(rqst, msg)
 		cryptbuf[1].key.high = cred->adc_fullname.window;
 		cryptbuf[1].key.low = verf.adv_winverf;
 		ivec.key.high = ivec.key.low = 0;	
-		status = cbc_crypt((char *)sessionkey, (char *)cryptbuf,
+		status = cbc_crypt((char *)&sessionkey, (char *)cryptbuf,
 			2*sizeof(des_block), DES_DECRYPT | DES_HW, 
 			(char *)&ivec);
 	} else {
-		status = ecb_crypt((char *)sessionkey, (char *)cryptbuf,
+		status = ecb_crypt((char *)&sessionkey, (char *)cryptbuf,
 			sizeof(des_block), DES_DECRYPT | DES_HW);
 	}
 	if (DES_FAILED(status)) {
@@ -243,15 +303,8 @@ _svcauth_des(rqst, msg)
 				LIBTIRPC_DEBUG(1, ("_svcauth_des: window verifier mismatch"));
 				return (AUTH_BADCRED);	/* garbled credential */
 			}
-			sid = cache_spot(sessionkey, cred->adc_fullname.name, 
-			    &timestamp);
-			if (sid < 0) {
-				LIBTIRPC_DEBUG(1, ("_svcauth_des: replayed credential"));
-				return (AUTH_REJECTEDCRED);	/* replay */
-			}
 			nick = 0;
 		} else {	/* ADN_NICKNAME */
-			window = authdes_cache[sid].window;
 			nick = 1;
 		}
 
@@ -260,9 +313,11 @@ _svcauth_des(rqst, msg)
 			/* cached out (bad key), or garbled verifier */
 			return (nick ? AUTH_REJECTEDVERF : AUTH_BADVERF);
 		}
-		if (nick && BEFORE(&timestamp, 
-				   &authdes_cache[sid].laststamp)) {
+		if (nick && BEFORE(&timestamp, &laststamp)) {
 			LIBTIRPC_DEBUG(1, ("_svcauth_des: timestamp before last seen"));
+			mutex_lock(&st->lock);
+			st->stats.ncachereplays++;
+			mutex_unlock(&st->lock);
 			return (AUTH_REJECTEDVERF);	/* replay */
 		}
 		(void) gettimeofday(&current, (struct timezone *)NULL);
@@ -274,6 +329,33 @@ _svcauth_des(rqst, msg)
 		}
 	}
 
+	/*
+	 * Find the credential its place in the cache; this also
+	 * catches replays of full-name credentials.  The stripe stays
+	 * locked until the entry is brought up to date.
+	 */
+	mutex_lock(&st->lock);
+	if (cred->adc_namekind == ADN_FULLNAME) {
+		sid = cache_spot(st, bucket, cred->adc_fullname.name, &xkey,
+		    &sessionkey, &timestamp);
+		if (sid == AUTHDES_NONE) {
+			mutex_unlock(&st->lock);
+			LIBTIRPC_DEBUG(1, ("_svcauth_des: replayed credential"));
+			return (AUTH_REJECTEDCRED);	/* replay */
+		}
+	} else {
+		entry = &authdes_cache[sid];
+		if (entry->rname == NULL ||
+		    memcmp(&entry->key, &sessionkey, sizeof (des_block)) != 0 ||
+		    BEFORE(&timestamp, &entry->laststamp)) {
+			/* reused or replayed while we were at it */
+			st->stats.ncachereplays++;
+			mutex_unlock(&st->lock);
+			return (AUTH_REJECTEDVERF);
+		}
+		st->stats.ncachehits++;
+	}
+
 	/*
 	 * Set up the reply verifier
 	 */
@@ -289,9 +371,10 @@ _svcauth_des(rqst, msg)
 	/*	 
 	 * encrypt the timestamp
 	 */
-	status = ecb_crypt((char *)sessionkey, (char *)cryptbuf,
+	status = ecb_crypt((char *)&sessionkey, (char *)cryptbuf,
 	    sizeof(des_block), DES_ENCRYPT | DES_HW);
 	if (DES_FAILED(status)) {
+		mutex_unlock(&st->lock);
 		LIBTIRPC_DEBUG(1, ("_svcauth_des: encryption failure"));
 		return (AUTH_FAILED);	/* system error */
 	}
@@ -316,21 +399,17 @@ _svcauth_des(rqst, msg)
 	 */
 	entry = &authdes_cache[sid];
 	entry->laststamp = timestamp;
-	cache_ref(sid);
+	cache_ref(st, sid);
 	if (cred->adc_namekind == ADN_FULLNAME) {
+		cred->adc_fullname.key = sessionkey;
 		cred->adc_fullname.window = window;
 		cred->adc_nickname = (u_long)sid;	/* save nickname */
-		if (entry->rname != NULL) {
-			mem_free(entry->rname, strlen(entry->rname) + 1);
-		}
-		entry->rname = (char *)mem_alloc((u_int)strlen(cred->adc_fullname.name)
-					 + 1);
-		if (entry->rname != NULL) {
-			(void) strcpy(entry->rname, cred->adc_fullname.name);
-		} else {
-			LIBTIRPC_DEBUG(1, ("_svcauth_des: out of memory"));
-		}
-		entry->key = *sessionkey;
+		if (entry->rname == NULL ||
+		    strcmp(entry->rname, cred->adc_fullname.name) != 0 ||
+		    memcmp(&entry->xkey, &xkey, sizeof (des_block)) != 0)
+			cache_enter(st, bucket, sid, cred->adc_fullname.name,
+			    &xkey);
+		entry->key = sessionkey;
 		entry->window = window;
 		invalidate(entry->localcred); /* mark any cached cred invalid */
 	} else { /* ADN_NICKNAME */
@@ -338,10 +417,11 @@ _svcauth_des(rqst, msg)
 		 * nicknames are cooked into fullnames
 		 */	
 		cred->adc_namekind = ADN_FULLNAME;
-		cred->adc_fullname.name = entry->rname;
-		cred->adc_fullname.key = entry->key;
-		cred->adc_fullname.window = entry->window;
+		cred->adc_fullname.name = area->area_netname;
+		cred->adc_fullname.key = sessionkey;
+		cred->adc_fullname.window = window;
 	}
+	mutex_unlock(&st->lock);
 	return (AUTH_OK);	/* we made it!*/
 }
 
@@ -352,84 +432,237 @@ _svcauth_des(rqst, msg)
 static void
 cache_init()
 {
-	int i;
+	struct cache_stripe *st;
+	struct cache_entry *cp;
+	int i, s, prev;
 
 	authdes_cache = (struct cache_entry *)
-		mem_alloc(sizeof(struct cache_entry) * AUTHDES_CACHESZ);	
+		mem_alloc(sizeof(struct cache_entry) * authdes_cachesz);	
+	if (authdes_cache == NULL)
+		return;
 	memset(authdes_cache, 0,
-		sizeof(struct cache_entry) * AUTHDES_CACHESZ);
+		sizeof(struct cache_entry) * authdes_cachesz);
+
+	for (s = 0; s < AUTHDES_STRIPES; s++) {
+		st = &authdes_stripes[s];
+		mutex_init(&st->lock, NULL);
+		st->nbuckets = authdes_cachesz / AUTHDES_STRIPES;
+		st->hash = (int *)mem_alloc(sizeof(int) * st->nbuckets);
+		if (st->hash == NULL) {
+			mem_free(authdes_cache,
+			    sizeof(struct cache_entry) * authdes_cachesz);
+			authdes_cache = NULL;
+			return;
+		}
+		for (i = 0; i < st->nbuckets; i++)
+			st->hash[i] = AUTHDES_NONE;
 
-	authdes_lru = (short *)mem_alloc(sizeof(short) * AUTHDES_CACHESZ);
-	/*
-	 * Initialize the lru list
-	 */
-	for (i = 0; i < AUTHDES_CACHESZ; i++) {
-		authdes_lru[i] = i;
+		/*
+		 * Initialize the lru list
+		 */
+		prev = AUTHDES_NONE;
+		for (i = s; i < authdes_cachesz; i += AUTHDES_STRIPES) {
+			cp = &authdes_cache[i];
+			cp->hnext = AUTHDES_NONE;
+			cp->lprev = prev;
+			cp->lnext = AUTHDES_NONE;
+			if (prev == AUTHDES_NONE)
+				st->lru_head = i;
+			else
+				authdes_cache[prev].lnext = i;
+			prev = i;
+		}
+		st->lru_tail = prev;
+	}
+}
+
+
+/*
+ * Pick the stripe for a full-name credential, and its hash
+ * bucket there
+ */
+static struct cache_stripe *
+cache_stripe(name, xkey, bucket)
+	char *name;
+	des_block *xkey;
+	int *bucket;
+{
+	u_int32_t h = 2166136261U;	/* FNV-1a */
+
+	while (*name != '\0') {
+		h ^= (u_char)*name++;
+		h *= 16777619U;
 	}
+	*bucket = (int)(((h / AUTHDES_STRIPES) ^ xkey->key.high ^
+	    xkey->key.low) % (u_int32_t)authdes_stripes[0].nbuckets);
+	return (&authdes_stripes[h % AUTHDES_STRIPES]);
 }
 
 
 /*
- * Find the lru victim
+ * Find the entry of a full-name credential, or AUTHDES_NONE
  */
-static short
-cache_victim()
+static int
+cache_find(st, bucket, name, xkey)
+	struct cache_stripe *st;
+	int bucket;
+	char *name;
+	des_block *xkey;
 {
-	return (authdes_lru[AUTHDES_CACHESZ-1]);
+	struct cache_entry *cp;
+	int sid;
+
+	for (sid = st->hash[bucket]; sid != AUTHDES_NONE; sid = cp->hnext) {
+		cp = &authdes_cache[sid];
+		if (cp->xkey.key.high == xkey->key.high &&
+		    cp->xkey.key.low == xkey->key.low &&
+		    strcmp(cp->rname, name) == 0)
+			return (sid);
+	}
+	return (AUTHDES_NONE);
 }
 
+
 /*
  * Note that sid was referenced
  */
 static void
-cache_ref(sid)
-	short sid;
+cache_ref(st, sid)
+	struct cache_stripe *st;
+	int sid;
 {
-	int i;
-	short curr;
-	short prev;
-
-	prev = authdes_lru[0];
-	authdes_lru[0] = sid;
-	for (i = 1; prev != sid; i++) {
-		curr = authdes_lru[i];
-		authdes_lru[i] = prev;
-		prev = curr;
-	}
+	struct cache_entry *cp = &authdes_cache[sid];
+
+	if (st->lru_head == sid)
+		return;
+	/* unlink; sid is not the head, so it has a predecessor */
+	authdes_cache[cp->lprev].lnext = cp->lnext;
+	if (cp->lnext != AUTHDES_NONE)
+		authdes_cache[cp->lnext].lprev = cp->lprev;
+	else
+		st->lru_tail = cp->lprev;
+	cp->lprev = AUTHDES_NONE;
+	cp->lnext = st->lru_head;
+	authdes_cache[st->lru_head].lprev = sid;
+	st->lru_head = sid;
 }
 
 
 /*
  * Find a spot in the cache for a credential containing
- * the items given.  Return -1 if a replay is detected, otherwise
- * return the spot in the cache.
+ * the items given.  Return AUTHDES_NONE if a replay is detected,
+ * otherwise return the spot in the cache.
  */
-static short
-cache_spot(key, name, timestamp)
-	des_block *key;
+static int
+cache_spot(st, bucket, name, xkey, key, timestamp)
+	struct cache_stripe *st;
+	int bucket;
 	char *name;
+	des_block *xkey;
+	des_block *key;
 	struct timeval *timestamp;
 {
 	struct cache_entry *cp;
-	int i;
-	u_long hi;
-
-	hi = key->key.high;
-	for (cp = authdes_cache, i = 0; i < AUTHDES_CACHESZ; i++, cp++) {
-		if (cp->key.key.high == hi && 
-		    cp->key.key.low == key->key.low &&
-		    cp->rname != NULL &&
-		    memcmp(cp->rname, name, strlen(name) + 1) == 0) {
+	int sid;
+
+	sid = cache_find(st, bucket, name, xkey);
+	if (sid != AUTHDES_NONE) {
+		cp = &authdes_cache[sid];
+		if (cp->key.key.high == key->key.high &&
+		    cp->key.key.low == key->key.low) {
 			if (BEFORE(timestamp, &cp->laststamp)) {
-				svcauthdes_stats.ncachereplays++;
-				return (-1); /* replay */
+				st->stats.ncachereplays++;
+				return (AUTHDES_NONE); /* replay */
 			}
-			svcauthdes_stats.ncachehits++;
-			return (i);	/* refresh */
+			st->stats.ncachehits++;
+			return (sid);	/* refresh */
 		}
 	}
-	svcauthdes_stats.ncachemisses++;
-	return (cache_victim());	/* new credential */
+	st->stats.ncachemisses++;
+	return (sid != AUTHDES_NONE ? sid : st->lru_tail); /* new credential */
+}
+
+
+/*
+ * Hash a new credential in at sid, pushing out what was there
+ */
+static void
+cache_enter(st, bucket, sid, name, xkey)
+	struct cache_stripe *st;
+	int bucket;
+	int sid;
+	char *name;
+	des_block *xkey;
+{
+	struct cache_entry *cp = &authdes_cache[sid];
+	int *pp, old;
+
+	if (cp->rname != NULL) {
+		(void) cache_stripe(cp->rname, &cp->xkey, &old);
+		for (pp = &st->hash[old]; *pp != AUTHDES_NONE;
+		    pp = &authdes_cache[*pp].hnext)
+			if (*pp == sid) {
+				*pp = cp->hnext;
+				break;
+			}
+		mem_free(cp->rname, strlen(cp->rname) + 1);
+	}
+	cp->rname = (char *)mem_alloc((u_int)strlen(name) + 1);
+	if (cp->rname == NULL) {
+		LIBTIRPC_DEBUG(1, ("_svcauth_des: out of memory"));
+		return;
+	}
+	(void) strcpy(cp->rname, name);
+	cp->xkey = *xkey;
+	cp->hnext = st->hash[bucket];
+	st->hash[bucket] = sid;
+}
+
+
+/*
+ * Settings and counters for rpc_control()
+ */
+bool_t
+__svcauth_des_control(request, info)
+	int request;
+	void *info;
+{
+	struct svcauthdes_stats *sp;
+	struct cache_stripe *st;
+	int s, val;
+
+	switch (request) {
+	case RPC_SVC_DESCACHE_SET:
+		val = *(int *)info;
+		if (authdes_cache != NULL || val < AUTHDES_STRIPES ||
+		    val > AUTHDES_CACHEMAX)
+			return (FALSE);	/* too late, or out of range */
+		authdes_cachesz = (val + AUTHDES_STRIPES - 1) &
+		    ~(AUTHDES_STRIPES - 1);
+		break;
+	case RPC_SVC_DESCACHE_GET:
+		*(int *)info = authdes_cachesz;
+		break;
+	case RPC_SVC_DESSTATS_GET:
+		sp = (struct svcauthdes_stats *)info;
+		memset(sp, 0, sizeof (*sp));
+		if (authdes_cache == NULL)
+			break;
+		for (s = 0; s < AUTHDES_STRIPES; s++) {
+			st = &authdes_stripes[s];
+			mutex_lock(&st->lock);
+			sp->ncachehits += st->stats.ncachehits;
+			sp->ncachereplays += st->stats.ncachereplays;
+			sp->ncachemisses += st->stats.ncachemisses;
+			sp->nkeyhits += st->stats.nkeyhits;
+			sp->nkeymisses += st->stats.nkeymisses;
+			mutex_unlock(&st->lock);
+		}
+		break;
+	default:
+		return (FALSE);
+	}
+	return (TRUE);
 }
 
 
@@ -468,41 +701,65 @@ authdes_getucred(adc, uid, gid, grouplen, groups)
 	gid_t i_gid;
 	int i_grouplen;
 	struct bsdcred *cred;
+	struct cache_entry *entry;
+	struct cache_stripe *st;
 
 	sid = adc->adc_nickname;
-	if (sid >= AUTHDES_CACHESZ) {
+	if (authdes_cache == NULL || sid >= (unsigned)authdes_cachesz) {
 		LIBTIRPC_DEBUG(1, ("authdes_getucred: invalid nickname"));
 		return (0);
 	}
-	cred = (struct bsdcred *)authdes_cache[sid].localcred;
+	entry = &authdes_cache[sid];
+	st = SID_STRIPE(sid);
+	mutex_lock(&st->lock);
+	cred = (struct bsdcred *)entry->localcred;
 	if (cred == NULL) {
 		cred = (struct bsdcred *)mem_alloc(sizeof(struct bsdcred));
-		authdes_cache[sid].localcred = (char *)cred;
+		if (cred == NULL) {
+			mutex_unlock(&st->lock);
+			return (0);
+		}
+		entry->localcred = (char *)cred;
 		cred->grouplen = INVALID;
 	}
 	if (cred->grouplen == INVALID) {
 		/*
-		 * not in cache: lookup
+		 * not in cache: lookup, without holding up the stripe
 		 */
+		mutex_unlock(&st->lock);
 		if (!netname2user(adc->adc_fullname.name, &i_uid, &i_gid, 
 			&i_grouplen, groups))
 		{
 			LIBTIRPC_DEBUG(1, ("authdes_getucred: unknown netname"));
-			cred->grouplen = UNKNOWN;	/* mark as lookup up, but not found */
+			mutex_lock(&st->lock);
+			if (entry->rname != NULL &&
+			    strcmp(entry->rname, adc->adc_fullname.name) == 0)
+				cred->grouplen = UNKNOWN;	/* mark as lookup up, but not found */
+			mutex_unlock(&st->lock);
 			return (0);
 		}
 		LIBTIRPC_DEBUG(1, ("authdes_getucred: missed ucred cache"));
-		*uid = cred->uid = i_uid;
-		*gid = cred->gid = i_gid;
-		*grouplen = cred->grouplen = i_grouplen;
-		for (i = i_grouplen - 1; i >= 0; i--) {
-			cred->groups[i] = groups[i]; /* int to short */
+		*uid = i_uid;
+		*gid = i_gid;
+		*grouplen = i_grouplen;
+		mutex_lock(&st->lock);
+		/* keep it only if the nickname still names this client */
+		if (entry->rname != NULL &&
+		    strcmp(entry->rname, adc->adc_fullname.name) == 0) {
+			cred->uid = i_uid;
+			cred->gid = i_gid;
+			cred->grouplen = i_grouplen;
+			for (i = i_grouplen - 1; i >= 0; i--) {
+				cred->groups[i] = groups[i]; /* int to short */
+			}
 		}
+		mutex_unlock(&st->lock);
 		return (1);
 	} else if (cred->grouplen == UNKNOWN) {
 		/*
 		 * Already lookup up, but no match found
 		 */	
+		mutex_unlock(&st->lock);
 		return (0);
 	}
 
@@ -515,6 +772,7 @@ authdes_getucred(adc, uid, gid, grouplen, groups)
 	for (i = cred->grouplen - 1; i >= 0; i--) {
 		groups[i] = cred->groups[i];	/* short to int */
 	}
+	mutex_unlock(&st->lock);
 	return (1);
 }
 
@@ -35,6 +35,7 @@
  */
 
 #include <sys/types.h>
+#include <sys/queue.h>
 
 #include <unistd.h>
 #include <stdio.h>
@@ -57,6 +58,7 @@
 #endif
 
 #include <reentrant.h>
+#include "rpc_com.h"
 
 #define UNUSED(x) UNUSED_ ## x __attribute__((unused))
 
@@ -66,15 +68,6 @@ extern SVCAUTH svc_auth_none;
 bool_t rpc_gss_oid_to_mech(rpc_gss_OID, char **);
 bool_t rpc_gss_num_to_qop(char *, u_int, char **);
 
-/*
- * from mit-krb5-1.2.1 mechglue/mglueP.h:
- * Array of context IDs typed by mechanism OID
- */
-typedef struct gss_union_ctx_id_t {
-  gss_OID     mech_type;
-  gss_ctx_id_t    internal_ctx_id;
-} gss_union_ctx_id_desc, *gss_union_ctx_id_t;
-
 
 
 static bool_t	svcauth_gss_wrap(SVCAUTH *, XDR *, xdrproc_t, caddr_t);
@@ -87,15 +80,79 @@ static struct svc_auth_ops svc_auth_gss_ops = {
 	svcauth_gss_destroy
 };
 
+/*
+ * Contexts are found by the handle the client echoes in gc_ctx, so a
+ * connection may carry several and a context may move between
+ * connections.  The handle is the cache epoch and a context number;
+ * the number picks a shard and a hash bucket within it.  Idle
+ * contexts are aged out by a timer wheel per shard: an entry sits in
+ * the slot of its expiry time as of insertion, and is moved on when
+ * that slot comes due if it has been used since.
+ *
+ * Every RPCSEC_GSS_INIT sets up a context, so the cache is capped:
+ * a full shard makes room by dropping its least recently used context,
+ * and turns the INIT away if even that one is in recent use.
+ *
+ * Each request holds a reference on its context from lookup until
+ * the request ends (__svcauth_gss_done()), and the cache holds one
+ * while the context is linked in.  RPCSEC_GSS_DESTROY, eviction and
+ * expiry only unlink the entry; it is freed with its last reference.
+ */
+#define GSS_CACHE_SHARDS	16
+#define GSS_CACHE_BUCKETS	64	/* per shard */
+#define GSS_CACHE_MAX		8192	/* contexts, over all shards */
+#define GSS_CACHE_TTL		300	/* 5 minutes idle */
+#define GSS_CACHE_MINIDLE	30	/* don't evict one used since */
+#define GSS_WHEEL_TICK		10	/* seconds per slot */
+#define GSS_WHEEL_SLOTS		32	/* must cover GSS_CACHE_TTL + tick */
+
+struct svcauth_gss_handle {
+	u_int64_t		epoch;		/* time the cache was set up */
+	u_int64_t		id;		/* context number */
+};
+
 struct svcauth_gss_cache_entry {
-	SVCXPRT *xprt;
+	LIST_ENTRY(svcauth_gss_cache_entry) link;	/* hash chain */
+	LIST_ENTRY(svcauth_gss_cache_entry) slot;	/* wheel slot */
+	TAILQ_ENTRY(svcauth_gss_cache_entry) lru;	/* least recent first */
+	u_int64_t		id;
 	struct svc_rpc_gss_data	*gd;
-	time_t time_to_die;
-	struct svcauth_gss_cache_entry *next;
+	time_t			time_to_die;
+	int			refs;		/* sh->lock */
+	bool_t			dead;		/* unlinked; sh->lock */
 };
 
-extern pthread_mutex_t			svcauth_gss_cache_lock;
-static struct svcauth_gss_cache_entry	*svcauth_gss_cache = NULL;
+LIST_HEAD(svcauth_gss_cache_list, svcauth_gss_cache_entry);
+
+struct svcauth_gss_shard {
+	mutex_t			lock;
+	time_t			tick;		/* next wheel slot to expire */
+	int			count;		/* contexts in the shard */
+	struct svcauth_gss_cache_list hash[GSS_CACHE_BUCKETS];
+	struct svcauth_gss_cache_list wheel[GSS_WHEEL_SLOTS];
+	TAILQ_HEAD(, svcauth_gss_cache_entry) lru;
+};
+
+extern pthread_mutex_t		svcauth_gss_cache_lock;
+static struct svcauth_gss_shard	svcauth_gss_shards[GSS_CACHE_SHARDS];
+static once_t			svcauth_gss_cache_once = ONCE_INITIALIZER;
+static u_int64_t		svcauth_gss_epoch;
+static u_int64_t		svcauth_gss_nextid;	/* svcauth_gss_cache_lock */
+
+/*
+ * Context establishment is throttled apart from data traffic: at most
+ * __svc_gssestab INIT/CONTINUE_INIT calls run gss_accept_sec_context
+ * at once, and at most __svc_gssqueue more wait for a turn, for no
+ * longer than GSS_ESTAB_WAIT seconds.  Anything beyond that is dropped
+ * unanswered and left to the client to retransmit, so a burst of
+ * handshakes cannot hold every worker thread.
+ */
+#define GSS_ESTAB_WAIT		5	/* seconds */
+
+extern pthread_mutex_t		svcauth_gss_estab_lock;
+static cond_t			svcauth_gss_estab_cond = PTHREAD_COND_INITIALIZER;
+static int			svcauth_gss_estab_active;	/* svcauth_gss_estab_lock */
+static int			svcauth_gss_estab_waiting;	/* svcauth_gss_estab_lock */
 
 struct svc_rpc_gss_callback {
 	struct svc_rpc_gss_callback	*cb_next;
@@ -105,28 +162,54 @@ struct svc_rpc_gss_callback {
 extern pthread_mutex_t		svcauth_cb_lock;
 static struct svc_rpc_gss_callback *_svcauth_callbacks = NULL;
 
+/*
+ * A context.  Requests on it may be served concurrently from several
+ * connections.  What the handshake sets up (ctx, names, sec.mech,
+ * sec.svc, win) is fixed once it is established; the fields marked
+ * (lock) change with the requests after that.
+ */
 struct svc_rpc_gss_data {
-	bool_t			established;	/* context established */
-	bool_t			locked;		/* service/qop unchanging */
+	mutex_t			lock;		/* see above */
+	mutex_t			ctxlock;	/* held over per-message calls
+						 * on ctx once established */
+	bool_t			established;	/* context established (lock) */
+	bool_t			locked;		/* service/qop unchanging (lock) */
 	gss_ctx_id_t		ctx;		/* context id */
-	gss_cred_id_t		deleg;		/* delegated creds */
-	struct rpc_gss_sec	sec;		/* security triple */
+	gss_cred_id_t		deleg;		/* delegated creds (lock) */
+	struct rpc_gss_sec	sec;		/* security triple (qop: lock) */
 	gss_buffer_desc		cname;		/* GSS client name */
-	u_int			seq;		/* sequence number */
 	u_int			win;		/* sequence window */
+	mutex_t			seqlock;	/* protects seqlast, seqmask */
 	u_int			seqlast;	/* last sequence number */
-	u_int32_t		seqmask;	/* bitmask of seqnums */
+	u_int32_t		*seqmask;	/* win bits, seq n at n % win */
 	gss_name_t		client_name;	/* unparsed name string */
-	rpc_gss_rawcred_t	rcred;		/* internal raw credential */
+	rpc_gss_rawcred_t	rcred;		/* internal raw credential (lock) */
+	bool_t			callback_done;	/* TRUE after callback (lock) */
+	void *			cookie;		/* callback cookie (lock) */
+	struct svcauth_gss_cache_entry *ce;	/* our cache entry */
+};
+
+/*
+ * What a request keeps in rq_clntcred.  Requests on one context may be
+ * served concurrently, so each wraps and unwraps with its own sequence
+ * number and a copy of the context's state as of its arrival, and
+ * hands rpc_gss_getcred() callers credentials of its own.
+ */
+struct svc_rpc_gss_req {
+	struct rpc_gss_cred	cred;		/* decoded credential */
+	struct svc_rpc_gss_data	*gd;		/* its context, referenced */
+	u_int			seq;		/* its sequence number */
+	bool_t			established;	/* gd->established */
+	gss_qop_t		qop;		/* gd->sec.qop */
 	rpc_gss_rawcred_t	scratch;	/* copy exposed to user */
 	rpc_gss_ucred_t		ucred;		/* cooked credential */
 	gid_t			gids[NGRPS];	/* list of groups */
-	bool_t			callback_done;	/* TRUE after callback */
-	void *			cookie;		/* callback cookie */
 };
 
+#define SVCAUTH_REQ(auth) \
+	((struct svc_rpc_gss_req *)(auth)->svc_ah_private)
 #define SVCAUTH_PRIVATE(auth) \
-	((struct svc_rpc_gss_data *)(auth)->svc_ah_private)
+	(SVCAUTH_REQ(auth)->gd)
 
 /* Global server credentials. */
 static u_int		_svcauth_req_time = 0;
@@ -273,6 +356,7 @@ svcauth_gss_accept_sec_context(struct svc_req *rqst,
 {
 	struct svc_rpc_gss_data	*gd;
 	struct rpc_gss_cred	*gc;
+	struct svcauth_gss_handle handle;
 	gss_buffer_desc		 recv_tok, seqbuf, checksum;
 	gss_OID			 mech;
 	OM_uint32		 maj_stat = 0, min_stat = 0, ret_flags, seq;
@@ -312,26 +396,31 @@ svcauth_gss_accept_sec_context(struct svc_req *rqst,
 		gss_release_buffer(&min_stat, &gr->gr_token);
 		return (FALSE);
 	}
-	/* ANDROS: krb5 mechglue returns ctx of size 8 - two pointers,
-	 * one to the mechanism oid, one to the internal_ctx_id */
-	if ((gr->gr_ctx.value = mem_alloc(sizeof(gss_union_ctx_id_desc))) == NULL) {
+	/* The client names the context by its cache handle. */
+	if ((gr->gr_ctx.value = mem_alloc(sizeof(struct svcauth_gss_handle))) == NULL) {
 		fprintf(stderr, "svcauth_gss_accept_context: out of memory\n");
 		return (FALSE);
 	}
-	memcpy(gr->gr_ctx.value, gd->ctx, sizeof(gss_union_ctx_id_desc));
-	gr->gr_ctx.length = sizeof(gss_union_ctx_id_desc);
-
-	/* ANDROS: change for debugging linux kernel version...
-	gr->gr_win = sizeof(gd->seqmask) * 8;
-	*/
-	gr->gr_win = 0x00000005;
+	handle.epoch = svcauth_gss_epoch;
+	handle.id = gd->ce->id;
+	memcpy(gr->gr_ctx.value, &handle, sizeof(handle));
+	gr->gr_ctx.length = sizeof(handle);
+
+	/* The window is fixed once the replay bitmap exists. */
+	if (gd->seqmask == NULL) {
+		gd->seqmask = calloc(__svc_gsswin / 32, sizeof(u_int32_t));
+		if (gd->seqmask == NULL) {
+			fprintf(stderr, "svcauth_gss_accept_context: out of memory\n");
+			return (FALSE);
+		}
+		gd->win = __svc_gsswin;
+	}
+	gr->gr_win = gd->win;
 
 	/* Save client info. */
 	gd->sec.mech = mech;
 	gd->sec.qop = GSS_C_QOP_DEFAULT;
 	gd->sec.svc = gc->gc_svc;
-	gd->seq = gc->gc_seq;
-	gd->win = gr->gr_win;
 	gd->callback_done = FALSE;
 
 	if (gr->gr_major == GSS_S_COMPLETE) {
@@ -406,8 +495,10 @@ svcauth_gss_validate(struct svc_rpc_gss_data *gd, struct rpc_msg *msg,
 	checksum.value = msg->rm_call.cb_verf.oa_base;
 	checksum.length = msg->rm_call.cb_verf.oa_length;
 
+	mutex_lock(&gd->ctxlock);
 	maj_stat = gss_verify_mic(&min_stat, gd->ctx, &rpcbuf, &checksum,
 				  &qop_state);
+	mutex_unlock(&gd->ctxlock);
 
 	free(rpchdr);
 
@@ -420,12 +511,52 @@ svcauth_gss_validate(struct svc_rpc_gss_data *gd, struct rpc_msg *msg,
 	return (TRUE);
 }
 
+/*
+ * Replay detection: accepts each sequence number once, as long as it
+ * is within gd->win of the highest one seen.  Workers may check
+ * numbers of the same context concurrently.
+ */
+static bool_t
+svcauth_gss_seqcheck(struct svc_rpc_gss_data *gd, u_int seq)
+{
+	u_int	n, bit;
+	bool_t	result = TRUE;
+
+	mutex_lock(&gd->seqlock);
+	if (seq > gd->seqlast) {
+		/* slide the window, forgetting the numbers it passes */
+		if (seq - gd->seqlast >= gd->win)
+			memset(gd->seqmask, 0, gd->win / 8);
+		else {
+			for (n = gd->seqlast + 1; n != seq + 1; n++) {
+				bit = n % gd->win;
+				gd->seqmask[bit / 32] &= ~(1U << (bit % 32));
+			}
+		}
+		gd->seqlast = seq;
+	}
+	else if (gd->seqlast - seq >= gd->win)
+		result = FALSE;
+
+	if (result) {
+		bit = seq % gd->win;
+		if (gd->seqmask[bit / 32] & (1U << (bit % 32)))
+			result = FALSE;
+		else {
+			gd->seqmask[bit / 32] |= 1U << (bit % 32);
+		}
+	}
+	mutex_unlock(&gd->seqlock);
+	return (result);
+}
+
 static bool_t
 svcauth_gss_nextverf(struct svc_req *rqst, u_int num)
 {
 	struct svc_rpc_gss_data	*gd;
 	gss_buffer_desc		 signbuf, checksum;
 	OM_uint32		 maj_stat, min_stat;
+	gss_qop_t		 qop;
 
 	gss_log_debug("in svcauth_gss_nextverf()");
 
@@ -434,8 +565,13 @@ svcauth_gss_nextverf(struct svc_req *rqst, u_int num)
 	signbuf.value = &num;
 	signbuf.length = sizeof(num);
 
-	maj_stat = gss_get_mic(&min_stat, gd->ctx, gd->sec.qop,
+	mutex_lock(&gd->lock);
+	qop = gd->sec.qop;
+	mutex_unlock(&gd->lock);
+	mutex_lock(&gd->ctxlock);
+	maj_stat = gss_get_mic(&min_stat, gd->ctx, qop,
 			       &signbuf, &checksum);
+	mutex_unlock(&gd->ctxlock);
 
 	if (maj_stat != GSS_S_COMPLETE) {
 		gss_log_status("svcauth_gss_nextverf: gss_get_mic", 
@@ -508,63 +644,262 @@ destroy_gd(struct svc_rpc_gss_data *gd)
 		gss_release_name(&min_stat, &gd->client_name);
 	if (gd->rcred.client_principal != NULL)
 		free(gd->rcred.client_principal);
+	free(gd->seqmask);
+	mutex_destroy(&gd->seqlock);
+	mutex_destroy(&gd->ctxlock);
+	mutex_destroy(&gd->lock);
 
 	mem_free(gd, sizeof(*gd));
 }
 
-/* call with svcauth_gss_cache_lock */
-static struct svcauth_gss_cache_entry **
-lookup_cache_entry(struct svc_req *rqst)
+static void
+free_cache_entry(struct svcauth_gss_cache_entry *ce)
 {
-	struct svcauth_gss_cache_entry **ce;
-
-	/*
-	 * for now, only one set of gss data per xprt, which is borked,
-	 * but that gss data will at least survive if there are
-	 * interleaved calls with another cred flavor on the same xprt
-	 */
-	for (ce = &svcauth_gss_cache; *ce; ce = &(*ce)->next) {
-		if ((*ce)->xprt == rqst->rq_xprt)
-			break;
+	destroy_gd(ce->gd);
+	mem_free(ce, sizeof(*ce));
+}
+
+static void
+svcauth_gss_cache_init(void)
+{
+	int	i, j;
+
+	for (i = 0; i < GSS_CACHE_SHARDS; i++) {
+		mutex_init(&svcauth_gss_shards[i].lock, NULL);
+		for (j = 0; j < GSS_CACHE_BUCKETS; j++)
+			LIST_INIT(&svcauth_gss_shards[i].hash[j]);
+		for (j = 0; j < GSS_WHEEL_SLOTS; j++)
+			LIST_INIT(&svcauth_gss_shards[i].wheel[j]);
+		TAILQ_INIT(&svcauth_gss_shards[i].lru);
 	}
+	svcauth_gss_epoch = time(NULL);
+}
 
-	return (ce);
+static struct svcauth_gss_shard *
+cache_shard(u_int64_t id, struct svcauth_gss_cache_list **bucket)
+{
+	struct svcauth_gss_shard *sh;
+	u_int64_t	h;
+
+	h = id * 0x9e3779b97f4a7c15ULL;
+	sh = &svcauth_gss_shards[h >> 60];
+	*bucket = &sh->hash[(h >> 32) % GSS_CACHE_BUCKETS];
+	return (sh);
+}
+
+static struct svcauth_gss_cache_list *
+wheel_slot(struct svcauth_gss_shard *sh, time_t when)
+{
+	return (&sh->wheel[(when / GSS_WHEEL_TICK) % GSS_WHEEL_SLOTS]);
+}
+
+/*
+ * Takes ce out of the hash chain and LRU list, and drops the cache's
+ * reference; the caller has taken it off the wheel.  call with sh->lock
+ */
+static void
+unlink_cache_entry(struct svcauth_gss_shard *sh,
+		   struct svcauth_gss_cache_entry *ce)
+{
+	LIST_REMOVE(ce, link);
+	TAILQ_REMOVE(&sh->lru, ce, lru);
+	sh->count--;
+	ce->dead = TRUE;
+	if (--ce->refs == 0)
+		free_cache_entry(ce);
 }
 
-/* call with svcauth_gss_cache_lock */
+/* Drops a request's reference on ce. */
 static void
-use_cache_entry(struct svcauth_gss_cache_entry **ce, time_t now)
+release_cache_entry(struct svcauth_gss_cache_entry *ce)
 {
-	struct svcauth_gss_cache_entry *ce_new_head;
+	struct svcauth_gss_cache_list *bucket;
+	struct svcauth_gss_shard *sh;
+	bool_t		last;
+
+	sh = cache_shard(ce->id, &bucket);
+	mutex_lock(&sh->lock);
+	last = (--ce->refs == 0);
+	mutex_unlock(&sh->lock);
+	if (last)
+		free_cache_entry(ce);
+}
 
-	(*ce)->time_to_die = now + 300; /* 5 minutes */
+/* call with sh->lock */
+static void
+expire_cache_entries(struct svcauth_gss_shard *sh, time_t now)
+{
+	struct svcauth_gss_cache_entry *ce, *ce_next;
+	time_t		tick = now / GSS_WHEEL_TICK;
+
+	if (sh->tick == 0)
+		sh->tick = tick;
+	else if (tick - sh->tick > GSS_WHEEL_SLOTS)
+		sh->tick = tick - GSS_WHEEL_SLOTS;
+
+	/* slots before the current one are due */
+	while (sh->tick < tick) {
+		ce = LIST_FIRST(&sh->wheel[sh->tick % GSS_WHEEL_SLOTS]);
+		LIST_INIT(&sh->wheel[sh->tick % GSS_WHEEL_SLOTS]);
+		sh->tick++;
+		for (; ce != NULL; ce = ce_next) {
+			ce_next = LIST_NEXT(ce, slot);
+			if (ce->time_to_die >= now) {
+				LIST_INSERT_HEAD(wheel_slot(sh, ce->time_to_die),
+						 ce, slot);
+				continue;
+			}
+			unlink_cache_entry(sh, ce);
+		}
+	}
+}
 
-	if (ce == &svcauth_gss_cache)
-		return; /* ce already at the head */
+/*
+ * Makes room in a full shard by dropping its least recently used
+ * context, unless that one was used in the last GSS_CACHE_MINIDLE
+ * seconds: a busy server would rather turn a new client away than
+ * throw out a context in use.  Requests still holding the context
+ * finish with it.  call with sh->lock
+ */
+static bool_t
+evict_cache_entry(struct svcauth_gss_shard *sh, time_t now)
+{
+	struct svcauth_gss_cache_entry *ce;
 
-	ce_new_head = *ce;
-	*ce = (*ce)->next;
-	ce_new_head->next = svcauth_gss_cache;
-	svcauth_gss_cache = ce_new_head;
+	ce = TAILQ_FIRST(&sh->lru);
+	if (ce == NULL ||
+	    ce->time_to_die - GSS_CACHE_TTL > now - GSS_CACHE_MINIDLE)
+		return (FALSE);
+	LIST_REMOVE(ce, slot);
+	unlink_cache_entry(sh, ce);
+	return (TRUE);
 }
 
-/* call with svcauth_gss_cache_lock */
-static void
-destroy_cold_cache_entries(time_t now)
+/*
+ * Finds the context named by the client's handle, or for
+ * RPCSEC_GSS_INIT sets up a new one, and takes a reference on it for
+ * the request.  Returns NULL if the handle names no context, the
+ * cache is full or memory is short.
+ */
+static struct svc_rpc_gss_data *
+lookup_cache_entry(struct rpc_gss_cred *gc, time_t now)
 {
-	struct svcauth_gss_cache_entry **ce;
+	struct svcauth_gss_cache_list *bucket;
+	struct svcauth_gss_cache_entry *ce;
+	struct svcauth_gss_shard *sh;
+	struct svcauth_gss_handle handle;
+	struct svc_rpc_gss_data	*gd;
+
+	thr_once(&svcauth_gss_cache_once, svcauth_gss_cache_init);
 
-	for (ce = &svcauth_gss_cache; *ce; ce = &(*ce)->next) {
-		if (now > (*ce)->time_to_die)
+	if (gc->gc_proc == RPCSEC_GSS_INIT) {
+		if ((ce = calloc(sizeof(*ce), 1)) == NULL) {
+			fprintf(stderr, "svcauth_gss: out_of_memory\n");
+			return (NULL);
+		}
+		if ((gd = calloc(sizeof(*gd), 1)) == NULL) {
+			free(ce);
+			fprintf(stderr, "svcauth_gss: out_of_memory\n");
+			return (NULL);
+		}
+		gd->locked = FALSE;
+		mutex_init(&gd->lock, NULL);
+		mutex_init(&gd->ctxlock, NULL);
+		mutex_init(&gd->seqlock, NULL);
+		gd->ce = ce;
+		ce->gd = gd;
+		ce->time_to_die = now + GSS_CACHE_TTL;
+		ce->refs = 2;			/* the cache's and ours */
+
+		mutex_lock(&svcauth_gss_cache_lock);
+		ce->id = ++svcauth_gss_nextid;
+		mutex_unlock(&svcauth_gss_cache_lock);
+
+		sh = cache_shard(ce->id, &bucket);
+		mutex_lock(&sh->lock);
+		expire_cache_entries(sh, now);
+		if (sh->count >= GSS_CACHE_MAX / GSS_CACHE_SHARDS &&
+		    !evict_cache_entry(sh, now)) {
+			mutex_unlock(&sh->lock);
+			gss_log_debug("svcauth_gss: context cache full");
+			destroy_gd(gd);
+			mem_free(ce, sizeof(*ce));
+			return (NULL);
+		}
+		LIST_INSERT_HEAD(bucket, ce, link);
+		LIST_INSERT_HEAD(wheel_slot(sh, ce->time_to_die), ce, slot);
+		TAILQ_INSERT_TAIL(&sh->lru, ce, lru);
+		sh->count++;
+		mutex_unlock(&sh->lock);
+		return (gd);
+	}
+
+	if (gc->gc_ctx.length != sizeof(handle))
+		return (NULL);
+	memcpy(&handle, gc->gc_ctx.value, sizeof(handle));
+	if (handle.epoch != svcauth_gss_epoch)
+		return (NULL);
+
+	gd = NULL;
+	sh = cache_shard(handle.id, &bucket);
+	mutex_lock(&sh->lock);
+	LIST_FOREACH(ce, bucket, link) {
+		if (ce->id == handle.id) {
+			ce->time_to_die = now + GSS_CACHE_TTL;
+			TAILQ_REMOVE(&sh->lru, ce, lru);
+			TAILQ_INSERT_TAIL(&sh->lru, ce, lru);
+			ce->refs++;
+			gd = ce->gd;
 			break;
+		}
 	}
+	expire_cache_entries(sh, now);
+	mutex_unlock(&sh->lock);
+	return (gd);
+}
 
-	while (*ce) {
-		struct svcauth_gss_cache_entry *ce_next = (*ce)->next;
-		destroy_gd((*ce)->gd);
-		mem_free(*ce, sizeof(**ce));
-		*ce = ce_next;
+/*
+ * Take an establishment slot, queueing for one if all are busy.
+ * Returns FALSE if the queue is full or the wait ran out.
+ */
+static bool_t
+svcauth_gss_estab_enter(void)
+{
+	struct timeval	now;
+	struct timespec	deadline;
+	bool_t		ok;
+
+	mutex_lock(&svcauth_gss_estab_lock);
+	if (svcauth_gss_estab_active >= __svc_gssestab) {
+		if (svcauth_gss_estab_waiting >= __svc_gssqueue) {
+			mutex_unlock(&svcauth_gss_estab_lock);
+			return (FALSE);
+		}
+		gettimeofday(&now, NULL);
+		deadline.tv_sec = now.tv_sec + GSS_ESTAB_WAIT;
+		deadline.tv_nsec = now.tv_usec * 1000;
+		svcauth_gss_estab_waiting++;
+		while (svcauth_gss_estab_active >= __svc_gssestab &&
+		       pthread_cond_timedwait(&svcauth_gss_estab_cond,
+					      &svcauth_gss_estab_lock,
+					      &deadline) == 0)
+			continue;
+		svcauth_gss_estab_waiting--;
 	}
+	ok = svcauth_gss_estab_active < __svc_gssestab;
+	if (ok)
+		svcauth_gss_estab_active++;
+	mutex_unlock(&svcauth_gss_estab_lock);
+	return (ok);
+}
+
+static void
+svcauth_gss_estab_leave(void)
+{
+	mutex_lock(&svcauth_gss_estab_lock);
+	svcauth_gss_estab_active--;
+	cond_signal(&svcauth_gss_estab_cond);
+	mutex_unlock(&svcauth_gss_estab_lock);
 }
 
 enum auth_stat
@@ -572,57 +907,29 @@ _svcauth_gss(struct svc_req *rqst, struct rpc_msg *msg, bool_t *no_dispatch)
 {
 	XDR	 		 xdrs;
 	struct svc_rpc_gss_data	*gd;
+	struct svc_rpc_gss_req	*req;
 	struct rpc_gss_cred	*gc;
 	struct rpc_gss_init_res	 gr;
-	int			 call_stat, offset;
+	int			 call_stat;
 	gss_qop_t		 qop;
-	struct svcauth_gss_cache_entry **ce;
 	time_t			 now;
 	enum auth_stat		 result = AUTH_OK;
 	OM_uint32		 min_stat;
+	bool_t			 estab = FALSE;
 
 	gss_log_debug("in svcauth_gss()");
 
 	/* Initialize reply. */
 	rqst->rq_xprt->xp_verf = _null_auth;
 
-	now = time(NULL);
-	mutex_lock(&svcauth_gss_cache_lock);
-	ce = lookup_cache_entry(rqst);
-	if (!*ce) {
-		/* no cache entry for this xprt, allocate and set it up */
-		if ((*ce = calloc(sizeof(**ce), 1)) == NULL) {
-			fprintf(stderr, "svcauth_gss: out_of_memory\n");
-			mutex_unlock(&svcauth_gss_cache_lock);
-			return (AUTH_FAILED);
-		}
-		if ((gd = calloc(sizeof(*gd), 1)) == NULL) {
-			free(*ce);
-			fprintf(stderr, "svcauth_gss: out_of_memory\n");
-			mutex_unlock(&svcauth_gss_cache_lock);
-			return (AUTH_FAILED);
-		}
-		gd->locked = FALSE;
-		(*ce)->xprt = rqst->rq_xprt;
-		(*ce)->gd = gd;
-		(*ce)->next = NULL;
-	}
-	else
-		gd = (*ce)->gd;
-	use_cache_entry(ce, now);
-	destroy_cold_cache_entries(now);
-	mutex_unlock(&svcauth_gss_cache_lock);
-
-	SVC_XP_AUTH(rqst->rq_xprt).svc_ah_ops = &svc_auth_gss_ops;
-	SVC_XP_AUTH(rqst->rq_xprt).svc_ah_private = (caddr_t) gd;
+	req = (struct svc_rpc_gss_req *)rqst->rq_clntcred;
+	memset(req, 0, sizeof(*req));
+	gc = &req->cred;
 
 	/* Deserialize client credentials. */
 	if (rqst->rq_cred.oa_length <= 0)
 		return (AUTH_BADCRED);
 
-	gc = (struct rpc_gss_cred *)rqst->rq_clntcred;
-	memset(gc, 0, sizeof(*gc));
-
 	xdrmem_create(&xdrs, rqst->rq_cred.oa_base,
 		      rqst->rq_cred.oa_length, XDR_DECODE);
 
@@ -646,29 +953,57 @@ _svcauth_gss(struct svc_req *rqst, struct rpc_msg *msg, bool_t *no_dispatch)
 		goto out;
 	}
 
+	/* Hold handshakes to their own share of the workers. */
+	if (gc->gc_proc == RPCSEC_GSS_INIT ||
+	    gc->gc_proc == RPCSEC_GSS_CONTINUE_INIT) {
+		if (!svcauth_gss_estab_enter()) {
+			gss_log_debug("svcauth_gss: establishment queue full");
+			*no_dispatch = TRUE;
+			goto out;
+		}
+		estab = TRUE;
+	}
+
+	/* Find the context named by the credential. */
+	now = time(NULL);
+	if ((gd = lookup_cache_entry(gc, now)) == NULL) {
+		result = gc->gc_proc == RPCSEC_GSS_INIT ?
+			AUTH_FAILED : RPCSEC_GSS_CREDPROBLEM;
+		goto out;
+	}
+	req->gd = gd;
+	req->seq = gc->gc_seq;
+	SVC_XP_AUTH(rqst->rq_xprt).svc_ah_ops = &svc_auth_gss_ops;
+	SVC_XP_AUTH(rqst->rq_xprt).svc_ah_private = (caddr_t) req;
+
+	mutex_lock(&gd->lock);
+	req->established = gd->established;
+	req->qop = gd->sec.qop;
+	mutex_unlock(&gd->lock);
+
+	/* Handshakes only before, data and DESTROY only after. */
+	if (req->established != (gc->gc_proc != RPCSEC_GSS_INIT &&
+				 gc->gc_proc != RPCSEC_GSS_CONTINUE_INIT)) {
+		result = req->established ? AUTH_REJECTEDCRED :
+			RPCSEC_GSS_CREDPROBLEM;
+		goto out;
+	}
+
 	/* Check sequence number. */
-	if (gd->established) {
+	if (req->established) {
 		if (gc->gc_seq > MAXSEQ) {
 			result = RPCSEC_GSS_CTXPROBLEM;
 			goto out;
 		}
 
-		if ((offset = gd->seqlast - gc->gc_seq) < 0) {
-			gd->seqlast = gc->gc_seq;
-			offset = 0 - offset;
-			gd->seqmask <<= offset;
-			offset = 0;
-		}
-		else if (offset >= gd->win || (gd->seqmask & (1 << offset))) {
+		if (!svcauth_gss_seqcheck(gd, gc->gc_seq)) {
 			*no_dispatch = 1;
 			result = RPCSEC_GSS_CTXPROBLEM;
 			goto out;
 		}
-		gd->seq = gc->gc_seq;
-		gd->seqmask |= (1 << offset);
 	}
 
-	if (gd->established) {
+	if (req->established) {
 		rqst->rq_clntname = (char *)gd->client_name;
 		rqst->rq_svcname = (char *)gd->ctx;
 	}
@@ -697,11 +1032,23 @@ _svcauth_gss(struct svc_req *rqst, struct rpc_msg *msg, bool_t *no_dispatch)
 			break;
 		}
 
+		/* one handshake step at a time on a context */
+		mutex_lock(&gd->lock);
 		if (!svcauth_gss_accept_sec_context(rqst, &gr)) {
+			mutex_unlock(&gd->lock);
+			/* don't keep a context that never got going */
+			if (gc->gc_proc == RPCSEC_GSS_INIT) {
+				SVCAUTH_DESTROY(&SVC_XP_AUTH(rqst->rq_xprt));
+				SVC_XP_AUTH(rqst->rq_xprt).svc_ah_ops =
+					svc_auth_none.svc_ah_ops;
+				SVC_XP_AUTH(rqst->rq_xprt).svc_ah_private = NULL;
+			}
 			result = AUTH_REJECTEDCRED;
 			break;
 		}
 
+		mutex_unlock(&gd->lock);
+
 		if (!svcauth_gss_nextverf(rqst, htonl(gr.gr_win))) {
 			result = AUTH_FAILED;
 			break;
@@ -720,8 +1067,11 @@ _svcauth_gss(struct svc_req *rqst, struct rpc_msg *msg, bool_t *no_dispatch)
 			break;
 		}
 
-		if (gr.gr_major == GSS_S_COMPLETE)
+		if (gr.gr_major == GSS_S_COMPLETE) {
+			mutex_lock(&gd->lock);
 			gd->established = TRUE;
+			mutex_unlock(&gd->lock);
+		}
 
 		break;
 
@@ -736,12 +1086,14 @@ _svcauth_gss(struct svc_req *rqst, struct rpc_msg *msg, bool_t *no_dispatch)
 			break;
 		}
 
+		mutex_lock(&gd->lock);
 		if (!gd->callback_done) {
 			gd->callback_done = TRUE;
 			gd->sec.qop = qop;
 			(void)rpc_gss_num_to_qop(gd->rcred.mechanism,
 						gd->sec.qop, &gd->rcred.qop);
 			if (!svcauth_gss_callback(rqst, gd)) {
+				mutex_unlock(&gd->lock);
 				result = AUTH_REJECTEDCRED;
 				break;
 			}
@@ -750,10 +1102,12 @@ _svcauth_gss(struct svc_req *rqst, struct rpc_msg *msg, bool_t *no_dispatch)
 		if (gd->locked) {
 			if (gd->rcred.service !=
 					_rpc_gss_svc_to_service(gc->gc_svc)) {
+				mutex_unlock(&gd->lock);
 				result = AUTH_FAILED;
 				break;
 			}
 			if (gd->sec.qop != qop) {
+				mutex_unlock(&gd->lock);
 				result = AUTH_BADVERF;
 				break;
 			}
@@ -766,6 +1120,8 @@ _svcauth_gss(struct svc_req *rqst, struct rpc_msg *msg, bool_t *no_dispatch)
 		}
 
 		gd->rcred.service = _rpc_gss_svc_to_service(gc->gc_svc);
+		mutex_unlock(&gd->lock);
+		req->qop = qop;
 
 		break;
 
@@ -801,68 +1157,100 @@ _svcauth_gss(struct svc_req *rqst, struct rpc_msg *msg, bool_t *no_dispatch)
 		break;
 	}
 out:
+	if (estab)
+		svcauth_gss_estab_leave();
 	xdr_free((xdrproc_t)xdr_rpc_gss_cred, (caddr_t)gc);
 	return result;
 }
 
+/*
+ * Drops the request's context from the cache, unless another request
+ * beat us to it, and releases the request's reference.
+ */
 static bool_t
 svcauth_gss_destroy(SVCAUTH *auth)
 {
-	struct svc_rpc_gss_data	*gd;
-	struct svcauth_gss_cache_entry **ce;
+	struct svc_rpc_gss_req	*req;
+	struct svcauth_gss_cache_entry *ce;
+	struct svcauth_gss_cache_list *bucket;
+	struct svcauth_gss_shard *sh;
 
 	gss_log_debug("in svcauth_gss_destroy()");
 
-	gd = SVCAUTH_PRIVATE(auth);
+	req = SVCAUTH_REQ(auth);
+	ce = req->gd->ce;
 
-	mutex_lock(&svcauth_gss_cache_lock);
-	for (ce = &svcauth_gss_cache; *ce; ce = &(*ce)->next) {
-		if ((*ce)->gd == gd) {
-			struct svcauth_gss_cache_entry *ce_destroy = *ce;
-			*ce = (*ce)->next;
-			mem_free(ce_destroy, sizeof(*ce_destroy));
-			break;
-		}
+	sh = cache_shard(ce->id, &bucket);
+	mutex_lock(&sh->lock);
+	if (!ce->dead) {
+		LIST_REMOVE(ce, slot);
+		unlink_cache_entry(sh, ce);
 	}
-	mutex_unlock(&svcauth_gss_cache_lock);
+	mutex_unlock(&sh->lock);
 
-	destroy_gd(gd);
+	req->gd = NULL;
+	release_cache_entry(ce);
 
 	return (TRUE);
 }
 
+/*
+ * The request is over: releases its reference on its context, if it
+ * still holds one.  The SVCAUTH may be gone with its transport, so
+ * this goes by the request alone.
+ */
+void
+__svcauth_gss_done(struct svc_req *rqst)
+{
+	struct svc_rpc_gss_req	*req;
+	struct svcauth_gss_cache_entry *ce;
+
+	if (rqst->rq_cred.oa_flavor != RPCSEC_GSS)
+		return;
+	req = (struct svc_rpc_gss_req *)rqst->rq_clntcred;
+	if (req->gd == NULL)
+		return;
+	ce = req->gd->ce;
+	req->gd = NULL;
+	release_cache_entry(ce);
+}
+
 static bool_t
 svcauth_gss_wrap(SVCAUTH *auth, XDR *xdrs, xdrproc_t xdr_func, caddr_t xdr_ptr)
 {
+	struct svc_rpc_gss_req	*req;
 	struct svc_rpc_gss_data	*gd;
 
 	gss_log_debug("in svcauth_gss_wrap()");
 
-	gd = SVCAUTH_PRIVATE(auth);
+	req = SVCAUTH_REQ(auth);
+	gd = req->gd;
 
-	if (!gd->established || gd->sec.svc == RPCSEC_GSS_SVC_NONE) {
+	if (!req->established || gd->sec.svc == RPCSEC_GSS_SVC_NONE) {
 		return ((*xdr_func)(xdrs, xdr_ptr));
 	}
-	return (xdr_rpc_gss_data(xdrs, xdr_func, xdr_ptr,
-				 gd->ctx, gd->sec.qop,
-				 gd->sec.svc, gd->seq));
+	return (__xdr_rpc_gss_data(xdrs, xdr_func, xdr_ptr,
+				   gd->ctx, &gd->ctxlock, req->qop,
+				   gd->sec.svc, req->seq));
 }
 
 static bool_t
 svcauth_gss_unwrap(SVCAUTH *auth, XDR *xdrs, xdrproc_t xdr_func, caddr_t xdr_ptr)
 {
+	struct svc_rpc_gss_req	*req;
 	struct svc_rpc_gss_data	*gd;
 
 	gss_log_debug("in svcauth_gss_unwrap()");
 
-	gd = SVCAUTH_PRIVATE(auth);
+	req = SVCAUTH_REQ(auth);
+	gd = req->gd;
 
-	if (!gd->established || gd->sec.svc == RPCSEC_GSS_SVC_NONE) {
+	if (!req->established || gd->sec.svc == RPCSEC_GSS_SVC_NONE) {
 		return ((*xdr_func)(xdrs, xdr_ptr));
 	}
-	return (xdr_rpc_gss_data(xdrs, xdr_func, xdr_ptr,
-				 gd->ctx, gd->sec.qop,
-				 gd->sec.svc, gd->seq));
+	return (__xdr_rpc_gss_data(xdrs, xdr_func, xdr_ptr,
+				   gd->ctx, &gd->ctxlock, req->qop,
+				   gd->sec.svc, req->seq));
 }
 
 char *
@@ -899,6 +1287,7 @@ int
 rpc_gss_svc_max_data_length(struct svc_req *rqst, int maxlen)
 {
 	OM_uint32 max_input_size, maj_stat, min_stat;
+	struct svc_rpc_gss_req	*req;
 	struct svc_rpc_gss_data	*gd;
 	int conf_req_flag;
 	int result;
@@ -906,9 +1295,10 @@ rpc_gss_svc_max_data_length(struct svc_req *rqst, int maxlen)
 	if (!rqst)
 		return 0;
 
-	gd = SVCAUTH_PRIVATE(&SVC_XP_AUTH(rqst->rq_xprt));
+	req = SVCAUTH_REQ(&SVC_XP_AUTH(rqst->rq_xprt));
+	gd = req->gd;
 
-	switch (gd->rcred.service) {
+	switch (_rpc_gss_svc_to_service(req->cred.gc_svc)) {
 	case rpcsec_gss_svc_none:
 		return maxlen;
 	case rpcsec_gss_svc_default:
@@ -924,7 +1314,7 @@ rpc_gss_svc_max_data_length(struct svc_req *rqst, int maxlen)
 
 	result = 0;
 	maj_stat = gss_wrap_size_limit(&min_stat, gd->ctx, conf_req_flag,
-					gd->sec.qop, maxlen, &max_input_size);
+					req->qop, maxlen, &max_input_size);
 	if (maj_stat == GSS_S_COMPLETE)
 		if ((int)max_input_size > 0)
 			result = (int)max_input_size;
@@ -974,47 +1364,35 @@ out_err:
 }
 
 static void
-_rpc_gss_fill_in_ucreds(struct svc_rpc_gss_data *gd)
+_rpc_gss_fill_in_ucreds(struct svc_rpc_gss_req *req)
 {
-	rpc_gss_ucred_t *ucred = &gd->ucred;
+	struct svc_rpc_gss_data *gd = req->gd;
+	rpc_gss_ucred_t *ucred = &req->ucred;
 	OM_uint32 maj_stat, min_stat;
-	struct passwd pwd, *pw;
-	long buflen;
 	uid_t uid;
-	char *buf;
+	gid_t gid;
 	int len;
 
 	/* default: "nfsnobody" */
 	ucred->uid = 65534;
 	ucred->gid = 65534;
 	ucred->gidlen = 0;
-	ucred->gidlist = gd->gids;
+	ucred->gidlist = req->gids;
 
 	maj_stat = gss_pname_to_uid(&min_stat, gd->client_name,
 						gd->sec.mech, &uid);
 	if (maj_stat != GSS_S_COMPLETE)
 		return;
 
-	buflen = sysconf(_SC_GETPW_R_SIZE_MAX);
-	if (buflen == -1)
-		return;
-	buf = malloc((size_t)buflen);
-	if (buf == NULL)
+	/* the list starts with the primary group, as getgrouplist(3) */
+	len = NGRPS - 1;
+	if (!uid2groups(uid, &gid, &len, &ucred->gidlist[1]))
 		return;
 
-	(void)getpwuid_r(uid, &pwd, buf, buflen, &pw);
-	if (pw == NULL) {
-		free(buf);
-		return;
-	}
-
-	ucred->uid = pw->pw_uid;
-	ucred->gid = pw->pw_gid;
-	len = NGRPS;
-	(void)getgrouplist(pw->pw_name, pw->pw_gid, ucred->gidlist, &len);
-	ucred->gidlen = len;
-
-	free(buf);
+	ucred->uid = uid;
+	ucred->gid = gid;
+	ucred->gidlist[0] = gid;
+	ucred->gidlen = 1 + (len < NGRPS - 1 ? len : NGRPS - 1);
 }
 
 /*
@@ -1033,6 +1411,7 @@ bool_t
 rpc_gss_getcred(struct svc_req *rqst, rpc_gss_rawcred_t **rcred,
 		rpc_gss_ucred_t **ucred, void **cookie)
 {
+	struct svc_rpc_gss_req	*req;
 	struct svc_rpc_gss_data	*gd;
 
 	if (rqst == NULL)
@@ -1041,23 +1420,29 @@ rpc_gss_getcred(struct svc_req *rqst, rpc_gss_rawcred_t **rcred,
 	if (rqst->rq_xprt->xp_verf.oa_flavor != RPCSEC_GSS)
 		return FALSE;
 
-	gd = SVCAUTH_PRIVATE(&SVC_XP_AUTH(rqst->rq_xprt));
+	req = SVCAUTH_REQ(&SVC_XP_AUTH(rqst->rq_xprt));
+	gd = req->gd;
 
 	if (rcred != NULL) {
-		gd->scratch = gd->rcred;
-		gd->scratch.service = _rpc_gss_svc_to_service(gd->sec.svc);
-		(void)rpc_gss_num_to_qop(gd->scratch.mechanism, gd->sec.qop,
-						&gd->scratch.qop);
-		*rcred = &gd->scratch;
+		mutex_lock(&gd->lock);
+		req->scratch = gd->rcred;
+		mutex_unlock(&gd->lock);
+		req->scratch.service = _rpc_gss_svc_to_service(gd->sec.svc);
+		(void)rpc_gss_num_to_qop(req->scratch.mechanism, req->qop,
+						&req->scratch.qop);
+		*rcred = &req->scratch;
 	}
 
 	if (ucred != NULL) {
-		_rpc_gss_fill_in_ucreds(gd);
-		*ucred = &gd->ucred;
+		_rpc_gss_fill_in_ucreds(req);
+		*ucred = &req->ucred;
 	}
 
-	if (cookie != NULL)
+	if (cookie != NULL) {
+		mutex_lock(&gd->lock);
 		*cookie = gd->cookie;
+		mutex_unlock(&gd->lock);
+	}
 
 	return TRUE;
 }
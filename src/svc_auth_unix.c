@@ -39,12 +39,95 @@
 #include <pthread.h>
 #include <assert.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include <rpc/rpc.h>
 
 extern SVCAUTH svc_auth_none;
 
+/* The decoded credentials, as laid out in rq_clntcred. */
+struct area {
+	struct authunix_parms area_aup;
+	char area_machname[MAX_MACHINE_NAME+1];
+	gid_t area_gids[NGRPS];
+};
+
+/*
+ * A connection carries one client, which nearly always sends the same
+ * credential body, so connections keep the last few bodies they decoded
+ * and hand back the decoded form when the bytes match again.  Only the
+ * thread serving the connection touches its cache.
+ */
+#define AUTHSYS_CACHE_SLOTS	4
+
+struct __rpc_authsys_cache {
+	u_int		ac_next;		/* slot to replace next */
+	struct authsys_cache_entry {
+		u_int		ce_len;		/* 0 if empty */
+		u_int32_t	ce_hash;
+		char		ce_cred[MAX_AUTH_BYTES];
+		struct area	ce_area;
+	} ac_ent[AUTHSYS_CACHE_SLOTS];
+};
+
+/* FNV-1a */
+static u_int32_t
+authsys_hash(const char *cred, u_int len)
+{
+	u_int32_t h = 2166136261U;
+
+	while (len-- > 0) {
+		h ^= (u_char)*cred++;
+		h *= 16777619U;
+	}
+	return (h);
+}
+
+static void
+authsys_copy(struct area *to, const struct area *from)
+{
+	const struct authunix_parms *aup = &from->area_aup;
+
+	to->area_aup.aup_time = aup->aup_time;
+	to->area_aup.aup_uid = aup->aup_uid;
+	to->area_aup.aup_gid = aup->aup_gid;
+	to->area_aup.aup_len = aup->aup_len;
+	strcpy(to->area_machname, from->area_machname);
+	memcpy(to->area_gids, from->area_gids,
+	    aup->aup_len * sizeof (gid_t));
+}
+
+static struct area *
+authsys_cache_lookup(struct __rpc_authsys_cache *ac, const char *cred,
+    u_int len, u_int32_t hash)
+{
+	struct authsys_cache_entry *ce;
+	int i;
+
+	for (i = 0; i < AUTHSYS_CACHE_SLOTS; i++) {
+		ce = &ac->ac_ent[i];
+		if (ce->ce_len == len && ce->ce_hash == hash &&
+		    memcmp(ce->ce_cred, cred, len) == 0)
+			return (&ce->ce_area);
+	}
+	return (NULL);
+}
+
+static void
+authsys_cache_enter(struct __rpc_authsys_cache *ac, const char *cred,
+    u_int len, u_int32_t hash, const struct area *area)
+{
+	struct authsys_cache_entry *ce;
+
+	ce = &ac->ac_ent[ac->ac_next];
+	ac->ac_next = (ac->ac_next + 1) % AUTHSYS_CACHE_SLOTS;
+	ce->ce_len = len;
+	ce->ce_hash = hash;
+	memcpy(ce->ce_cred, cred, len);
+	authsys_copy(&ce->ce_area, area);
+}
+
 /*
  * Unix longhand authenticator
  */
@@ -57,11 +140,10 @@ _svcauth_unix(rqst, msg)
 	XDR xdrs;
 	struct authunix_parms *aup;
 	int32_t *buf;
-	struct area {
-		struct authunix_parms area_aup;
-		char area_machname[MAX_MACHINE_NAME+1];
-		gid_t area_gids[NGRPS];
-	} *area;
+	struct area *area, *hit;
+	struct __rpc_authsys_cache *ac = NULL;
+	SVCXPRT_EXT *ext;
+	u_int32_t hash = 0;
 	u_int auth_len;
 	size_t str_len, gid_len;
 	u_int i;
@@ -74,6 +156,24 @@ _svcauth_unix(rqst, msg)
 	aup->aup_machname = area->area_machname;
 	aup->aup_gids = area->area_gids;
 	auth_len = (u_int)msg->rm_call.cb_cred.oa_length;
+
+	ext = SVCEXT(rqst->rq_xprt);
+	if (ext != NULL && (ext->flags & SVC_CONNECTED) &&
+	    auth_len > 0 && auth_len <= MAX_AUTH_BYTES) {
+		if (ext->xp_authsys == NULL)
+			ext->xp_authsys = calloc(1, sizeof (*ext->xp_authsys));
+		ac = ext->xp_authsys;
+	}
+	if (ac != NULL) {
+		hash = authsys_hash(msg->rm_call.cb_cred.oa_base, auth_len);
+		hit = authsys_cache_lookup(ac, msg->rm_call.cb_cred.oa_base,
+		    auth_len, hash);
+		if (hit != NULL) {
+			authsys_copy(area, hit);
+			goto verf;
+		}
+	}
+
 	xdrmem_create(&xdrs, msg->rm_call.cb_cred.oa_base, auth_len,XDR_DECODE);
 	buf = XDR_INLINE(&xdrs, auth_len);
 	if (buf != NULL) {
@@ -114,7 +214,12 @@ _svcauth_unix(rqst, msg)
 		stat = AUTH_BADCRED;
 		goto done;
 	}
+	XDR_DESTROY(&xdrs);
+	if (ac != NULL)
+		authsys_cache_enter(ac, msg->rm_call.cb_cred.oa_base,
+		    auth_len, hash, area);
 
+verf:
        /* get the verifier */
 	if ((u_int)msg->rm_call.cb_verf.oa_length) {
 		rqst->rq_xprt->xp_verf.oa_flavor =
@@ -127,7 +232,7 @@ _svcauth_unix(rqst, msg)
 		rqst->rq_xprt->xp_verf.oa_flavor = AUTH_NULL;
 		rqst->rq_xprt->xp_verf.oa_length = 0;
 	}
-	stat = AUTH_OK;
+	return (AUTH_OK);
 done:
 	XDR_DESTROY(&xdrs);
 	return (stat);
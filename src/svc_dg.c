@@ -61,10 +61,17 @@
 #define	MAX(a, b)	(((a) > (b)) ? (a) : (b))
 #endif
 
+/* the largest UDP payloads: 65535 less the IP and UDP headers */
+#define	DG_MAXREPLY_INET	(65535 - 20 - 8)
+#define	DG_MAXREPLY_INET6	(65535 - 8)
+
 static void svc_dg_ops(SVCXPRT *);
 static enum xprt_stat svc_dg_stat(SVCXPRT *);
 static bool_t svc_dg_recv(SVCXPRT *, struct rpc_msg *);
 static bool_t svc_dg_reply(SVCXPRT *, struct rpc_msg *);
+static bool_t svc_dg_send(SVCXPRT *, char *, size_t);
+static bool_t svc_dg_bigreply(SVCXPRT *, struct rpc_msg *, xdrproc_t, caddr_t);
+static u_long svc_dg_maxreply(SVCXPRT *);
 static bool_t svc_dg_getargs(SVCXPRT *, xdrproc_t, void *);
 static bool_t svc_dg_freeargs(SVCXPRT *, xdrproc_t, void *);
 static void svc_dg_destroy(SVCXPRT *);
@@ -88,6 +95,8 @@ static const char svc_dg_str[] = "svc_dg_create: %s";
 static const char svc_dg_err1[] = "could not get transport information";
 static const char svc_dg_err2[] = " transport does not support data transfer";
 static const char __no_mem_str[] = "out of memory";
+static const char svc_dg_reply_err[] =
+	"svc_dg_reply: %lu byte reply is too large for a datagram";
 
 SVCXPRT *
 svc_dg_create(fd, sendsize, recvsize)
@@ -262,23 +271,101 @@ svc_dg_reply(xprt, msg)
 	    (!has_args ||
 	     SVCAUTH_WRAP(&SVC_XP_AUTH(xprt),
 			  xdrs, xdr_results, xdr_location))) {
-		struct msghdr *msg = &su->su_msghdr;
-		struct iovec iov;
-
-		iov.iov_base = rpc_buffer(xprt);
-		iov.iov_len = slen = XDR_GETPOS(xdrs);
-		msg->msg_iov = &iov;
-		msg->msg_iovlen = 1;
-		msg->msg_name = (struct sockaddr *)(void *) xprt->xp_rtaddr.buf;
-		msg->msg_namelen = xprt->xp_rtaddr.len;
-		/* cmsg already set in svc_dg_recv */
-
-		if (sendmsg(xprt->xp_fd, msg, 0) == (ssize_t) slen) {
+		slen = XDR_GETPOS(xdrs);
+		if (svc_dg_send(xprt, rpc_buffer(xprt), slen)) {
 			stat = TRUE;
 			if (su->su_cache)
 				cache_set(xprt, slen);
 		}
+	} else if (has_args)
+		stat = svc_dg_bigreply(xprt, msg, xdr_results, xdr_location);
+	return (stat);
+}
+
+static bool_t
+svc_dg_send(xprt, buf, len)
+	SVCXPRT *xprt;
+	char *buf;
+	size_t len;
+{
+	struct msghdr *msg = &su_data(xprt)->su_msghdr;
+	struct iovec iov;
+
+	iov.iov_base = buf;
+	iov.iov_len = len;
+	msg->msg_iov = &iov;
+	msg->msg_iovlen = 1;
+	msg->msg_name = (struct sockaddr *)(void *) xprt->xp_rtaddr.buf;
+	msg->msg_namelen = xprt->xp_rtaddr.len;
+	/* cmsg already set in svc_dg_recv */
+
+	return (sendmsg(xprt->xp_fd, msg, 0) == (ssize_t) len);
+}
+
+/*
+ * The largest datagram the transport's address family can carry.  For
+ * families other than IP there is no known bound, so replies never
+ * grow past su_iosz.
+ */
+static u_long
+svc_dg_maxreply(xprt)
+	SVCXPRT *xprt;
+{
+	struct sockaddr *sa = (struct sockaddr *)(void *)xprt->xp_ltaddr.buf;
+
+	switch (sa->sa_family) {
+	case AF_INET:
+		return (DG_MAXREPLY_INET);
+#ifdef INET6
+	case AF_INET6:
+		return (DG_MAXREPLY_INET6);
+#endif
+	default:
+		return (su_data(xprt)->su_iosz);
+	}
+}
+
+/*
+ * Called when a reply with results did not fit in su_iosz bytes.  If
+ * it is sized (see __svc_replysize()) and a datagram can carry it, it
+ * is sent from a buffer of its exact size; if it is too large for
+ * that, the client gets SYSTEM_ERR at once instead of timing out.
+ * Such replies are not kept by the duplicate request cache, which
+ * holds buffers of su_iosz bytes.
+ */
+static bool_t
+svc_dg_bigreply(xprt, msg, xdr_results, xdr_location)
+	SVCXPRT *xprt;
+	struct rpc_msg *msg;
+	xdrproc_t xdr_results;
+	caddr_t xdr_location;
+{
+	struct svc_dg_data *su = su_data(xprt);
+	XDR xdrs;
+	u_long len;
+	char *buf;
+	bool_t stat = FALSE;
+
+	len = __svc_replysize(xprt, msg, xdr_results, xdr_location);
+	if (len <= su->su_iosz)
+		return (FALSE);		/* not sized, or failed otherwise */
+	if (len > svc_dg_maxreply(xprt)) {
+		warnx(svc_dg_reply_err, len);
+		msg->acpted_rply.ar_stat = SYSTEM_ERR;
+		XDR_SETPOS(&(su->su_xdrs), 0);
+		if (xdr_replymsg(&(su->su_xdrs), msg))
+			(void) svc_dg_send(xprt, rpc_buffer(xprt),
+			    XDR_GETPOS(&(su->su_xdrs)));
+		return (FALSE);
 	}
+	if ((buf = mem_alloc(len)) == NULL)
+		return (FALSE);
+	xdrmem_create(&xdrs, buf, len, XDR_ENCODE);
+	if (xdr_replymsg(&xdrs, msg) &&
+	    SVCAUTH_WRAP(&SVC_XP_AUTH(xprt), &xdrs, xdr_results, xdr_location))
+		stat = svc_dg_send(xprt, buf, XDR_GETPOS(&xdrs));
+	XDR_DESTROY(&xdrs);
+	mem_free(buf, len);
 	return (stat);
 }
 
@@ -288,12 +375,9 @@ svc_dg_getargs(xprt, xdr_args, args_ptr)
 	xdrproc_t xdr_args;
 	void *args_ptr;
 {
-	if (!SVCAUTH_UNWRAP(&SVC_XP_AUTH(xprt),
-			    &(su_data(xprt)->su_xdrs),
-			    xdr_args, args_ptr)) {
-		return FALSE;
-	}
-	return TRUE;
+	/* replies are encoded into the receive buffer: never lend it */
+	return (__svc_getargs(xprt, &(su_data(xprt)->su_xdrs),
+	    xdr_args, args_ptr, FALSE));
 }
 
 static bool_t
@@ -302,10 +386,8 @@ svc_dg_freeargs(xprt, xdr_args, args_ptr)
 	xdrproc_t xdr_args;
 	void *args_ptr;
 {
-	XDR *xdrs = &(su_data(xprt)->su_xdrs);
-
-	xdrs->x_op = XDR_FREE;
-	return (*xdr_args)(xdrs, args_ptr);
+	return (__svc_freeargs(xprt, &(su_data(xprt)->su_xdrs),
+	    xdr_args, args_ptr));
 }
 
 static void
@@ -321,6 +403,7 @@ svc_dg_destroy(xprt)
 	XDR_DESTROY(&(su->su_xdrs));
 	(void) mem_free(rpc_buffer(xprt), su->su_iosz);
 	(void) mem_free(su, sizeof (*su));
+	xdr_arena_destroy(ext->xp_arena);
 	(void) mem_free(ext, sizeof (*ext));
 	if (xprt->xp_rtaddr.buf)
 		(void) mem_free(xprt->xp_rtaddr.buf, xprt->xp_rtaddr.maxlen);
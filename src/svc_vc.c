@@ -40,6 +40,7 @@
 #include <sys/socket.h>
 #include <sys/types.h>
 #include <sys/param.h>
+#include <sys/sendfile.h>
 #include <poll.h>
 #include <sys/un.h>
 #include <sys/time.h>
@@ -74,6 +75,8 @@ static void svc_vc_destroy(SVCXPRT *);
 static void __svc_vc_dodestroy (SVCXPRT *);
 static int read_vc(void *, void *, int);
 static int write_vc(void *, void *, int);
+static bool_t sendfile_vc(void *, int, off_t *, size_t);
+static bool_t input_pending(int);
 static enum xprt_stat svc_vc_stat(SVCXPRT *);
 static bool_t svc_vc_recv(SVCXPRT *, struct rpc_msg *);
 static bool_t svc_vc_getargs(SVCXPRT *, xdrproc_t, void *);
@@ -90,6 +93,7 @@ struct cf_rendezvous { /* kept in xprt->xp_p1 for rendezvouser */
 	u_int sendsize;
 	u_int recvsize;
 	int maxrec;
+	bool_t zerocopy;
 };
 
 struct cf_conn {  /* kept in xprt->xp_p1 for actual connection */
@@ -101,6 +105,7 @@ struct cf_conn {  /* kept in xprt->xp_p1 for actual connection */
 	u_int recvsize;
 	int maxrec;
 	bool_t nonblock;
+	bool_t zerocopy;
 	struct timeval last_recv_time;
 };
 
@@ -168,6 +173,7 @@ svc_vc_create(fd, sendsize, recvsize)
 	r->sendsize = __rpc_get_t_size(si.si_af, si.si_proto, (int)sendsize);
 	r->recvsize = __rpc_get_t_size(si.si_af, si.si_proto, (int)recvsize);
 	r->maxrec = __svc_maxrec;
+	r->zerocopy = FALSE;
 	xprt = mem_alloc(sizeof(SVCXPRT));
 	if (xprt == NULL) {
 		warnx("svc_vc_create: out of memory");
@@ -291,6 +297,7 @@ makefd_xprt(fd, sendsize, recvsize)
 		goto done;
 	}
 	memset(ext, 0, sizeof (*ext));
+	ext->flags = SVC_CONNECTED;
 	cd = mem_alloc(sizeof(struct cf_conn));
 	if (cd == NULL) {
 		warnx("svc_vc: makefd_xprt: out of memory");
@@ -300,8 +307,10 @@ makefd_xprt(fd, sendsize, recvsize)
 		goto done;
 	}
 	cd->strm_stat = XPRT_IDLE;
+	cd->zerocopy = FALSE;
 	xdrrec_create(&(cd->xdrs), sendsize, recvsize,
 	    xprt, read_vc, write_vc);
+	__xdrrec_setsendfile(&(cd->xdrs), sendfile_vc);
 	xprt->xp_p1 = cd;
 	xprt->xp_p3 = ext;
 	xprt->xp_verf.oa_base = cd->verf_body;
@@ -380,6 +389,8 @@ again:
 		__xdrrec_setnonblock(&cd->xdrs, cd->maxrec);
 	} else
 		cd->nonblock = FALSE;
+	if (r->zerocopy)
+		cd->zerocopy = __xdrrec_setzerocopy(&cd->xdrs, sock, TRUE);
 
 	gettimeofday(&cd->last_recv_time, NULL);
 
@@ -438,20 +449,24 @@ __svc_vc_dodestroy(xprt)
                SVC_XP_PRV(xprt) = NULL;
        }
 
-	if (xprt->xp_fd != RPC_ANYFD)
-		(void)close(xprt->xp_fd);
 	if (__svc_rendezvous_socket(xprt)) {
 		/* a rendezvouser socket */
 		r = (struct cf_rendezvous *)xprt->xp_p1;
 		mem_free(r, sizeof (struct cf_rendezvous));
 		xprt->xp_port = 0;
 	} else {
-		/* an actual connection socket */
+		/* an actual connection socket; zerocopy buffers are
+		 * reclaimed through it, so close it afterwards */
 		XDR_DESTROY(&(cd->xdrs));
 		mem_free(cd, sizeof(struct cf_conn));
 	}
-	if (ext)
+	if (xprt->xp_fd != RPC_ANYFD)
+		(void)close(xprt->xp_fd);
+	if (ext) {
+		xdr_arena_destroy(ext->xp_arena);
+		free(ext->xp_authsys);
 		mem_free(ext, sizeof (*ext));
+	}
 	if (xprt->xp_rtaddr.buf)
 		mem_free(xprt->xp_rtaddr.buf, xprt->xp_rtaddr.maxlen);
 	if (xprt->xp_ltaddr.buf)
@@ -470,7 +485,23 @@ svc_vc_control(xprt, rq, in)
 	const u_int rq;
 	void *in;
 {
-	return (FALSE);
+	struct cf_conn *cd;
+
+	cd = (struct cf_conn *)xprt->xp_p1;
+	switch (rq) {
+		case SVCGET_ZEROCOPY:
+			*(int *)in = cd->zerocopy;
+			break;
+		case SVCSET_ZEROCOPY:
+			if (!__xdrrec_setzerocopy(&cd->xdrs, xprt->xp_fd,
+			    *(int *)in != 0))
+				return (FALSE);
+			cd->zerocopy = (*(int *)in != 0);
+			break;
+		default:
+			return (FALSE);
+	}
+	return (TRUE);
 }
 
 static bool_t
@@ -480,6 +511,7 @@ svc_vc_rendezvous_control(xprt, rq, in)
 	void *in;
 {
 	struct cf_rendezvous *cfp;
+	int one;
 
 	cfp = (struct cf_rendezvous *)xprt->xp_p1;
 	if (cfp == NULL)
@@ -491,6 +523,22 @@ svc_vc_rendezvous_control(xprt, rq, in)
 		case SVCSET_CONNMAXREC:
 			cfp->maxrec = *(int *)in;
 			break;
+		case SVCGET_ZEROCOPY:
+			*(int *)in = cfp->zerocopy;
+			break;
+		case SVCSET_ZEROCOPY:
+			/* accepted connections inherit SO_ZEROCOPY */
+			one = (*(int *)in != 0);
+#ifdef SO_ZEROCOPY
+			if (one && setsockopt(xprt->xp_fd, SOL_SOCKET,
+			    SO_ZEROCOPY, &one, sizeof (one)) == -1)
+				return (FALSE);
+#else
+			if (one)
+				return (FALSE);
+#endif
+			cfp->zerocopy = one;
+			break;
 		default:
 			return (FALSE);
 	}
@@ -554,6 +602,9 @@ read_vc(xprtp, buf, len)
 			goto fatal_err;
 
 		default:
+			/* zerocopy completions also wake poll */
+			if ((pollfd.revents & POLLIN) == 0)
+				(void)__xdrrec_zcreap(&cfp->xdrs);
 			break;
 		}
 	} while ((pollfd.revents & POLLIN) == 0);
@@ -617,6 +668,72 @@ write_vc(xprtp, buf, len)
 	return (len);
 }
 
+/*
+ * true if the connection has something for read_vc(): data, a
+ * hangup or an error.
+ */
+static bool_t
+input_pending(fd)
+	int fd;
+{
+	struct pollfd pollfd;
+
+	pollfd.fd = fd;
+	pollfd.events = POLLIN;
+	pollfd.revents = 0;
+	return (poll(&pollfd, 1, 0) != 0);
+}
+
+/*
+ * sends len bytes of fd at *offp, for xdr_bytes_file().
+ */
+static bool_t
+sendfile_vc(xprtp, fd, offp, len)
+	void *xprtp;
+	int fd;
+	off_t *offp;
+	size_t len;
+{
+	SVCXPRT *xprt;
+	struct cf_conn *cd;
+	struct timeval tv0, tv1;
+	ssize_t i;
+
+	xprt = (SVCXPRT *)xprtp;
+	assert(xprt != NULL);
+
+	cd = (struct cf_conn *)xprt->xp_p1;
+
+	if (cd->nonblock)
+		gettimeofday(&tv0, NULL);
+
+	while (len > 0) {
+		i = sendfile(xprt->xp_fd, fd, offp, len);
+		if (i == 0) {
+			/* the file is shorter than the record says */
+			cd->strm_stat = XPRT_DIED;
+			return (FALSE);
+		}
+		if (i < 0) {
+			if (errno == EINTR)
+				continue;
+			if (errno != EAGAIN || !cd->nonblock) {
+				cd->strm_stat = XPRT_DIED;
+				return (FALSE);
+			}
+			/* same limit as write_vc() */
+			gettimeofday(&tv1, NULL);
+			if (tv1.tv_sec - tv0.tv_sec >= 2) {
+				cd->strm_stat = XPRT_DIED;
+				return (FALSE);
+			}
+			continue;
+		}
+		len -= i;
+	}
+	return (TRUE);
+}
+
 static enum xprt_stat
 svc_vc_stat(xprt)
 	SVCXPRT *xprt;
@@ -648,6 +765,13 @@ svc_vc_recv(xprt, msg)
 	cd = (struct cf_conn *)(xprt->xp_p1);
 	xdrs = &(cd->xdrs);
 
+	/*
+	 * The only news may be zerocopy completions on the error queue;
+	 * a blocking read would then wait for a call that is not there.
+	 */
+	if (__xdrrec_zcreap(xdrs) > 0 && !input_pending(xprt->xp_fd))
+		return (FALSE);
+
 	if (cd->nonblock) {
 		if (!__xdrrec_getrec(xdrs, &cd->strm_stat, TRUE))
 			return FALSE;
@@ -673,16 +797,15 @@ svc_vc_getargs(xprt, xdr_args, args_ptr)
 	xdrproc_t xdr_args;
 	void *args_ptr;
 {
+	struct cf_conn *cd;
 
 	assert(xprt != NULL);
 	/* args_ptr may be NULL */
 
-	if (!SVCAUTH_UNWRAP(&SVC_XP_AUTH(xprt),
-			    &(((struct cf_conn *)(xprt->xp_p1))->xdrs),
-			    xdr_args, args_ptr)) {
-		return FALSE;  
-	}
-	return TRUE;
+	cd = (struct cf_conn *)(xprt->xp_p1);
+	/* nonblocking connections buffer whole records */
+	return (__svc_getargs(xprt, &cd->xdrs, xdr_args, args_ptr,
+	    cd->nonblock));
 }
 
 static bool_t
@@ -698,8 +821,7 @@ svc_vc_freeargs(xprt, xdr_args, args_ptr)
 
 	xdrs = &(((struct cf_conn *)(xprt->xp_p1))->xdrs);
 
-	xdrs->x_op = XDR_FREE;
-	return ((*xdr_args)(xdrs, args_ptr));
+	return (__svc_freeargs(xprt, xdrs, xdr_args, args_ptr));
 }
 
 static bool_t
@@ -707,9 +829,11 @@ svc_vc_reply(xprt, msg)
 	SVCXPRT *xprt;
 	struct rpc_msg *msg;
 {
+	extern SVCAUTH svc_auth_none;
 	struct cf_conn *cd;
 	XDR *xdrs;
-	bool_t rstat;
+	bool_t rstat, held, exact;
+	u_long len;
 
 	xdrproc_t xdr_results;
 	caddr_t xdr_location;
@@ -729,19 +853,43 @@ svc_vc_reply(xprt, msg)
 
 		msg->acpted_rply.ar_results.proc = (xdrproc_t)xdr_void;
 		msg->acpted_rply.ar_results.where = NULL;
-	} else
+	} else {
 		has_args = FALSE;
+		xdr_results = NULL;
+		xdr_location = NULL;
+	}
 
 	xdrs->x_op = XDR_ENCODE;
 	msg->rm_xid = cd->x_id;
 	rstat = FALSE;
+	/*
+	 * A reply that outgrows the buffer is counted as it is encoded,
+	 * then encoded again as a single fragment of that length, rather
+	 * than sent as one fragment per buffer.
+	 */
+	held = has_args &&
+	    SVC_XP_AUTH(xprt).svc_ah_ops == svc_auth_none.svc_ah_ops &&
+	    __xdrrec_hold(xdrs);
+	exact = FALSE;
+again:
 	if (xdr_replymsg(xdrs, msg) &&
 	    (!has_args ||
 	     SVCAUTH_WRAP(&SVC_XP_AUTH(xprt),
 			  xdrs, xdr_results, xdr_location))) {
 		rstat = TRUE;
 	}
-	(void)xdrrec_endofrecord(xdrs, TRUE);
+	if (held && __xdrrec_unhold(xdrs, &len)) {
+		/* a reply that could not be counted is sent as it comes */
+		held = FALSE;
+		exact = (rstat && __xdrrec_setreclen(xdrs, len));
+		rstat = FALSE;
+		goto again;
+	}
+	if (!xdrrec_endofrecord(xdrs, TRUE) && exact) {
+		/* the record was cut short: the peer has lost its place */
+		cd->strm_stat = XPRT_DIED;
+		rstat = FALSE;
+	}
 	return (rstat);
 }
 
@@ -798,7 +946,8 @@ svc_vc_rendezvous_ops(xprt)
 
 /*
  * Get the effective UID of the sending process. Used by rpcbind, keyserv
- * and rpc.yppasswdd on AF_LOCAL.
+ * and rpc.yppasswdd on AF_LOCAL.  The peer of a connection cannot
+ * change, so its answer is kept with the transport.
  */
 int
 __rpc_get_local_uid(SVCXPRT *transp, uid_t *uid) {
@@ -806,13 +955,23 @@ __rpc_get_local_uid(SVCXPRT *transp, uid_t *uid) {
 	gid_t egid;
 	uid_t euid;
 	struct sockaddr *sa;
+	SVCXPRT_EXT *ext = SVCEXT(transp);
 
+	if (ext != NULL && (ext->flags & SVC_PEERUID)) {
+		*uid = ext->xp_peeruid;
+		return (0);
+	}
 	sock = transp->xp_fd;
 	sa = (struct sockaddr *)transp->xp_rtaddr.buf;
 	if (sa->sa_family == AF_LOCAL) {
 		ret = getpeereid(sock, &euid, &egid);
-		if (ret == 0)
+		if (ret == 0) {
 			*uid = euid;
+			if (ext != NULL && (ext->flags & SVC_CONNECTED)) {
+				ext->xp_peeruid = euid;
+				ext->flags |= SVC_PEERUID;
+			}
+		}
 		return (ret);
 	} else
 		return (-1);
@@ -38,14 +38,18 @@
  */
 
 #include <err.h>
+#include <errno.h>
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 #include <rpc/rpc.h>
 #include <rpc/types.h>
 #include <rpc/xdr.h>
 #include <rpc/rpc_com.h>
+#include "rpc_com.h"
 
 typedef quad_t          longlong_t;     /* ANSI long long type */
 typedef u_quad_t        u_longlong_t;   /* ANSI unsigned long long type */
@@ -564,6 +568,22 @@ xdr_enum(xdrs, ep)
 	}
 }
 
+/*
+ * x_control routine of streams that implement the extended xdr_ops
+ * (x_getint64 and following).  Its address marks the table as having
+ * them; it handles no requests itself.
+ */
+/* ARGSUSED */
+bool_t
+xdr_extops_control(xdrs, request, info)
+	XDR *xdrs;
+	int request;
+	void *info;
+{
+
+	return (FALSE);
+}
+
 /*
  * XDR opaque data
  * Allows the specification of a fixed size sequence of opaque bytes.
@@ -584,6 +604,12 @@ xdr_opaque(xdrs, cp, cnt)
 	if (cnt == 0)
 		return (TRUE);
 
+	if (xdrs->x_op != XDR_FREE && XDR_HAS_EXTOPS(xdrs)) {
+		if (xdrs->x_op == XDR_DECODE)
+			return (XDR_GETOPAQUE(xdrs, cp, cnt));
+		return (XDR_PUTOPAQUE(xdrs, cp, cnt));
+	}
+
 	/*
 	 * round byte count to full xdr units
 	 */
@@ -652,8 +678,14 @@ xdr_bytes(xdrs, cpp, sizep, maxsize)
 		if (nodesize == 0) {
 			return (TRUE);
 		}
+		if (sp == NULL && nodesize <= UINT_MAX - BYTES_PER_XDR_UNIT &&
+		    __xdr_borrowing(xdrs) &&
+		    (sp = (char *)XDR_INLINE(xdrs, RNDUP(nodesize))) != NULL) {
+			*cpp = sp;
+			return (TRUE);
+		}
 		if (sp == NULL) {
-			*cpp = sp = mem_alloc(nodesize);
+			*cpp = sp = __xdr_alloc(xdrs, nodesize);
 			allocated = TRUE;
 		}
 		if (sp == NULL) {
@@ -666,7 +698,7 @@ xdr_bytes(xdrs, cpp, sizep, maxsize)
 		ret = xdr_opaque(xdrs, sp, nodesize);
 		if ((xdrs->x_op == XDR_DECODE) && (ret == FALSE)) {
 			if (allocated == TRUE) {
-				free(sp);
+				__xdr_free(xdrs, sp, nodesize);
 				*cpp = NULL;
 			}
 		}
@@ -674,7 +706,7 @@ xdr_bytes(xdrs, cpp, sizep, maxsize)
 
 	case XDR_FREE:
 		if (sp != NULL) {
-			mem_free(sp, nodesize);
+			__xdr_free(xdrs, sp, nodesize);
 			*cpp = NULL;
 		}
 		return (TRUE);
@@ -683,6 +715,158 @@ xdr_bytes(xdrs, cpp, sizep, maxsize)
 	return (FALSE);
 }
 
+#define XDR_STREAM_CHUNK	8192
+
+/*
+ * XDR a variable-length opaque without holding all of it in memory
+ * (decode only).  The length is decoded into *sizep, then the bytes go
+ * to sink in pieces as they arrive: record streams hand over their
+ * input buffer fragment by fragment and other streams are read through
+ * a bounce buffer, unless the whole body can be inlined.
+ */
+bool_t
+xdr_bytes_stream(xdrs, sizep, maxsize, sink, arg)
+	XDR *xdrs;
+	u_int *sizep;
+	u_int maxsize;
+	xdrsink_t sink;
+	void *arg;
+{
+	char buf[XDR_STREAM_CHUNK];
+	char *p;
+	u_int left, pad;
+	int got;
+
+	switch (xdrs->x_op) {
+	case XDR_FREE:
+		return (TRUE);
+	case XDR_ENCODE:
+		return (FALSE);
+	case XDR_DECODE:
+		break;
+	}
+	if (! xdr_u_int(xdrs, sizep) || *sizep > maxsize)
+		return (FALSE);
+	left = *sizep;
+	pad = (BYTES_PER_XDR_UNIT - left % BYTES_PER_XDR_UNIT) %
+	    BYTES_PER_XDR_UNIT;
+	if (left > 0 && left <= INT_MAX &&
+	    (p = (char *)XDR_INLINE(xdrs, left + pad)) != NULL)
+		return ((*sink)(arg, p, left));
+
+	while (left > 0) {
+		if ((got = __xdrrec_getchunk(xdrs, &p, left)) == 0)
+			return (FALSE);
+		if (got < 0) {
+			got = left < sizeof (buf) ? left : sizeof (buf);
+			if (! XDR_GETBYTES(xdrs, buf, got))
+				return (FALSE);
+			p = buf;
+		}
+		if (! (*sink)(arg, p, got))
+			return (FALSE);
+		left -= got;
+	}
+	if (pad > 0 && ! XDR_GETBYTES(xdrs, buf, pad))
+		return (FALSE);
+	return (TRUE);
+}
+
+static bool_t
+xdr_fd_sink(arg, buf, len)
+	void *arg;
+	const char *buf;
+	u_int len;
+{
+	int fd = *(int *)arg;
+	ssize_t n;
+
+	while (len > 0) {
+		if ((n = write(fd, buf, len)) < 0) {
+			if (errno == EINTR)
+				continue;
+			return (FALSE);
+		}
+		buf += n;
+		len -= n;
+	}
+	return (TRUE);
+}
+
+/*
+ * XDR a variable-length opaque straight into the file descriptor fd
+ * (decode only).
+ */
+bool_t
+xdr_bytes_tofd(xdrs, sizep, maxsize, fd)
+	XDR *xdrs;
+	u_int *sizep;
+	u_int maxsize;
+	int fd;
+{
+	return (xdr_bytes_stream(xdrs, sizep, maxsize, xdr_fd_sink, &fd));
+}
+
+/*
+ * XDR a variable-length opaque made of len bytes of fd at offset
+ * (encode only).  Record streams that can send files (svc_vc) move the
+ * body with sendfile(); other streams read it through a buffer.  The
+ * offset is 64 bits wide whatever the caller's off_t; one that this
+ * library's off_t cannot hold fails.
+ */
+bool_t
+xdr_bytes_file(xdrs, fd, offset64, len)
+	XDR *xdrs;
+	int fd;
+	int64_t offset64;
+	u_int len;
+{
+	char buf[XDR_STREAM_CHUNK];
+	u_int left, pad;
+	off_t offset;
+	ssize_t got;
+	int ret;
+
+	switch (xdrs->x_op) {
+	case XDR_FREE:
+		return (TRUE);
+	case XDR_DECODE:
+		return (FALSE);
+	case XDR_ENCODE:
+		break;
+	}
+	offset = (off_t)offset64;
+	if (offset64 < 0 || (int64_t)offset != offset64)
+		return (FALSE);
+	if (! xdr_u_int(xdrs, &len))
+		return (FALSE);
+	if (__xdr_sizing(xdrs))
+		ret = XDR_PUTBYTES(xdrs, NULL, len);	/* only counts */
+	else
+		ret = __xdrrec_putfile(xdrs, fd, offset, len);
+	if (ret == FALSE)
+		return (FALSE);
+	if (ret < 0) {
+		for (left = len; left > 0; left -= got, offset += got) {
+			got = pread(fd, buf, left < sizeof (buf) ?
+			    left : sizeof (buf), offset);
+			if (got < 0 && errno == EINTR) {
+				got = 0;
+				continue;
+			}
+			if (got <= 0)
+				return (FALSE);
+			if (! XDR_PUTBYTES(xdrs, buf, got))
+				return (FALSE);
+		}
+	}
+	pad = (BYTES_PER_XDR_UNIT - len % BYTES_PER_XDR_UNIT) %
+	    BYTES_PER_XDR_UNIT;
+	if (pad > 0)
+		return (XDR_PUTBYTES(xdrs, xdr_zero, pad));
+	return (TRUE);
+}
+
 /*
  * Implemented here due to commonality of the object.
  */
@@ -747,6 +931,52 @@ xdr_union(xdrs, dscmp, unp, choices, dfault)
  */
 
 
+/*
+ * Decodes a string in place in the buffer of a stream lent to the
+ * decode arena; lp points at the length.  The NUL goes in the first pad
+ * byte.  A string without padding is copied into the arena instead, so
+ * the bytes of the message are never moved.  Strings skimmed by
+ * xdr_skip() are just passed over.
+ */
+static bool_t
+xdr_string_borrow(xdrs, cpp, lp, maxsize)
+	XDR *xdrs;
+	char **cpp;
+	char *lp;
+	u_int maxsize;
+{
+	u_int32_t size;
+	char *sp;
+
+	memcpy(&size, lp, sizeof (size));
+	size = ntohl(size);
+	if (size > maxsize || size > UINT_MAX - BYTES_PER_XDR_UNIT)
+		return (FALSE);
+	if ((sp = (char *)XDR_INLINE(xdrs, RNDUP(size))) != NULL) {
+		if (__xdr_skimming(xdrs)) {
+			/* not terminated; nobody looks at it */
+			*cpp = sp;
+			return (TRUE);
+		}
+		if (size % BYTES_PER_XDR_UNIT == 0) {
+			if ((*cpp = __xdr_alloc(xdrs, size + 1)) == NULL)
+				return (FALSE);
+			memcpy(*cpp, sp, size);
+			return (TRUE);
+		}
+		sp[size] = 0;
+		*cpp = sp;
+		return (TRUE);
+	}
+	/* the arena's memory is zero-filled */
+	if ((sp = __xdr_alloc(xdrs, size + 1)) == NULL)
+		return (FALSE);
+	if (! xdr_opaque(xdrs, sp, size))
+		return (FALSE);
+	*cpp = sp;
+	return (TRUE);
+}
+
 /*
  * XDR null terminated ASCII strings
  * xdr_string deals with "C strings" - arrays of bytes that are
@@ -762,6 +992,7 @@ xdr_string(xdrs, cpp, maxsize)
 	u_int maxsize;
 {
 	char *sp = *cpp;  /* sp is the actual string pointer */
+	char *lp;
 	u_int size;
 	u_int nodesize;
 	bool_t ret, allocated = FALSE;
@@ -781,6 +1012,9 @@ xdr_string(xdrs, cpp, maxsize)
 		size = strlen(sp);
 		break;
 	case XDR_DECODE:
+		if (sp == NULL && __xdr_borrowing(xdrs) &&
+		    (lp = (char *)XDR_INLINE(xdrs, BYTES_PER_XDR_UNIT)) != NULL)
+			return (xdr_string_borrow(xdrs, cpp, lp, maxsize));
 		break;
 	}
 	if (! xdr_u_int(xdrs, &size)) {
@@ -805,7 +1039,7 @@ xdr_string(xdrs, cpp, maxsize)
 
 	case XDR_DECODE:
 		if (sp == NULL) {
-			*cpp = sp = mem_alloc(nodesize);
+			*cpp = sp = __xdr_alloc(xdrs, nodesize);
 			allocated = TRUE;
 		}
 		if (sp == NULL) {
@@ -819,14 +1053,14 @@ xdr_string(xdrs, cpp, maxsize)
 		ret = xdr_opaque(xdrs, sp, size);
 		if ((xdrs->x_op == XDR_DECODE) && (ret == FALSE)) {
 			if (allocated == TRUE) {
-				free(sp);
+				__xdr_free(xdrs, sp, nodesize);
 				*cpp = NULL;
 			}
 		}
 		return (ret);
 
 	case XDR_FREE:
-		mem_free(sp, nodesize);
+		__xdr_free(xdrs, sp, nodesize);
 		*cpp = NULL;
 		return (TRUE);
 	}
@@ -864,6 +1098,11 @@ xdr_int64_t(xdrs, llp)
 {
 	u_long ul[2];
 
+	if (xdrs->x_op != XDR_FREE && XDR_HAS_EXTOPS(xdrs)) {
+		if (xdrs->x_op == XDR_DECODE)
+			return (XDR_GETINT64(xdrs, llp));
+		return (XDR_PUTINT64(xdrs, llp));
+	}
 	switch (xdrs->x_op) {
 	case XDR_ENCODE:
 		ul[0] = (u_long)((u_int64_t)*llp >> 32) & 0xffffffff;
@@ -898,6 +1137,11 @@ xdr_u_int64_t(xdrs, ullp)
 {
 	u_long ul[2];
 
+	if (xdrs->x_op != XDR_FREE && XDR_HAS_EXTOPS(xdrs)) {
+		if (xdrs->x_op == XDR_DECODE)
+			return (XDR_GETINT64(xdrs, (int64_t *)ullp));
+		return (XDR_PUTINT64(xdrs, (int64_t *)ullp));
+	}
 	switch (xdrs->x_op) {
 	case XDR_ENCODE:
 		ul[0] = (u_long)(*ullp >> 32) & 0xffffffff;
@@ -0,0 +1,328 @@
+/*
+ * Copyright (c) 2009, Sun Microsystems, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * - Neither the name of Sun Microsystems, Inc. nor the names of its
+ *   contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * xdr_arena.c, decode arenas.
+ *
+ * While an arena is bound to an XDR stream, the memory that the XDR
+ * routines allocate when decoding from that stream is carved out of
+ * the arena instead of being obtained with mem_alloc().  All of it is
+ * released at once by xdr_arena_reset(), so the decoded objects must
+ * not be passed through XDR_FREE.  The binding is per thread: a thread
+ * has at most one arena bound at a time, either to one stream or to
+ * every stream it decodes from (which covers the temporary streams that
+ * authentication flavors unwrap arguments through).
+ *
+ * A stream whose buffer stays put until the arena is reset may also be
+ * lent to the arena with xdr_arena_borrow(): strings and variable-length
+ * opaques decoded from it then point into the buffer instead of being
+ * copied.
+ */
+
+#include <pthread.h>
+#include <reentrant.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <rpc/rpc.h>
+#include "rpc_com.h"
+
+#define ARENA_ALIGN	16
+#define ARENA_DEFSIZE	8192
+
+struct xdr_arena_chunk {
+	struct xdr_arena_chunk *ac_next;
+	size_t	ac_size;		/* usable bytes in ac_data */
+	size_t	ac_used;
+	char	*ac_data;
+};
+
+struct xdr_arena {
+	size_t	xa_chunksize;		/* size of regular chunks */
+	struct xdr_arena_chunk *xa_chunks;	/* current chunk first */
+};
+
+extern thread_key_t xdr_arena_key;
+extern mutex_t tsd_lock;
+
+static struct xdr_arena_chunk *
+arena_chunk(size)
+	size_t size;
+{
+	struct xdr_arena_chunk *ac;
+
+	ac = malloc(sizeof (*ac) + ARENA_ALIGN + size);
+	if (ac == NULL)
+		return (NULL);
+	ac->ac_data = (char *)(((unsigned long)(ac + 1) + ARENA_ALIGN - 1) &
+	    ~(unsigned long)(ARENA_ALIGN - 1));
+	ac->ac_size = size;
+	ac->ac_used = 0;
+	return (ac);
+}
+
+/*
+ * Creates an arena that grows in chunks of chunksize bytes (a default
+ * size if 0).
+ */
+xdr_arena_t *
+xdr_arena_create(chunksize)
+	u_int chunksize;
+{
+	xdr_arena_t *xa;
+
+	if ((xa = malloc(sizeof (*xa))) == NULL)
+		return (NULL);
+	xa->xa_chunksize = chunksize ? chunksize : ARENA_DEFSIZE;
+	xa->xa_chunks = NULL;
+	return (xa);
+}
+
+/*
+ * Releases everything allocated from the arena.  One regular chunk is
+ * kept for reuse.
+ */
+void
+xdr_arena_reset(xa)
+	xdr_arena_t *xa;
+{
+	struct xdr_arena_chunk *ac, *keep = NULL;
+
+	if (xa == NULL)
+		return;
+	while ((ac = xa->xa_chunks) != NULL) {
+		xa->xa_chunks = ac->ac_next;
+		if (keep == NULL && ac->ac_size == xa->xa_chunksize) {
+			keep = ac;
+			continue;
+		}
+		free(ac);
+	}
+	if (keep != NULL) {
+		keep->ac_used = 0;
+		keep->ac_next = NULL;
+		xa->xa_chunks = keep;
+	}
+}
+
+void
+xdr_arena_destroy(xa)
+	xdr_arena_t *xa;
+{
+	struct xdr_arena_chunk *ac;
+
+	if (xa == NULL)
+		return;
+	while ((ac = xa->xa_chunks) != NULL) {
+		xa->xa_chunks = ac->ac_next;
+		free(ac);
+	}
+	free(xa);
+}
+
+static void *
+arena_alloc(xa, size)
+	xdr_arena_t *xa;
+	size_t size;
+{
+	struct xdr_arena_chunk *ac = xa->xa_chunks;
+	void *p;
+
+	size = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+	if (ac == NULL || ac->ac_size - ac->ac_used < size) {
+		if (size > xa->xa_chunksize / 4) {
+			/* big objects get a chunk of their own */
+			if ((ac = arena_chunk(size)) == NULL)
+				return (NULL);
+			if (xa->xa_chunks != NULL) {
+				ac->ac_next = xa->xa_chunks->ac_next;
+				xa->xa_chunks->ac_next = ac;
+			} else {
+				ac->ac_next = NULL;
+				xa->xa_chunks = ac;
+			}
+			ac->ac_used = size;
+			return (memset(ac->ac_data, 0, size));
+		}
+		if ((ac = arena_chunk(xa->xa_chunksize)) == NULL)
+			return (NULL);
+		ac->ac_next = xa->xa_chunks;
+		xa->xa_chunks = ac;
+	}
+	p = ac->ac_data + ac->ac_used;
+	ac->ac_used += size;
+	return (memset(p, 0, size));
+}
+
+static void
+arena_binding_free(arg)
+	void *arg;
+{
+	struct xdr_arena_binding *ab = arg;
+
+	xdr_arena_destroy(ab->ab_scratch);
+	free(ab);
+}
+
+/*
+ * Returns the calling thread's binding, creating it if create is set.
+ */
+struct xdr_arena_binding *
+__xdr_arena_binding(create)
+	bool_t create;
+{
+	struct xdr_arena_binding *ab;
+
+	if (xdr_arena_key == KEY_INITIALIZER) {
+		if (!create)
+			return (NULL);
+		mutex_lock(&tsd_lock);
+		if (xdr_arena_key == KEY_INITIALIZER)
+			thr_keycreate(&xdr_arena_key, arena_binding_free);
+		mutex_unlock(&tsd_lock);
+	}
+	ab = (struct xdr_arena_binding *)thr_getspecific(xdr_arena_key);
+	if (ab == NULL && create) {
+		if ((ab = calloc(1, sizeof (*ab))) == NULL)
+			return (NULL);
+		thr_setspecific(xdr_arena_key, ab);
+	}
+	return (ab);
+}
+
+/*
+ * Binds arena to xdrs for the calling thread, or to every stream if
+ * xdrs is NULL.  Unbinds the thread's arena if arena is NULL.
+ */
+void
+xdr_arena_bind(xdrs, xa)
+	XDR *xdrs;
+	xdr_arena_t *xa;
+{
+	struct xdr_arena_binding *ab;
+
+	if ((ab = __xdr_arena_binding(xa != NULL)) == NULL)
+		return;
+	ab->ab_xdrs = xa ? xdrs : NULL;
+	ab->ab_arena = xa;
+	ab->ab_borrow = NULL;
+	ab->ab_skim = NULL;
+}
+
+/*
+ * Lets the strings and variable-length opaques that the calling thread
+ * decodes from xdrs point into the stream's buffer, until the thread's
+ * arena is unbound.  The caller guarantees that the buffer is neither
+ * refilled nor released before the arena is reset.
+ */
+void
+xdr_arena_borrow(xdrs)
+	XDR *xdrs;
+{
+	struct xdr_arena_binding *ab;
+
+	ab = __xdr_arena_binding(FALSE);
+	if (ab != NULL && ab->ab_arena != NULL)
+		ab->ab_borrow = xdrs;
+}
+
+/*
+ * Returns the arena bound to xdrs by the calling thread, if any.
+ */
+xdr_arena_t *
+__xdr_arena(xdrs)
+	XDR *xdrs;
+{
+	struct xdr_arena_binding *ab;
+
+	ab = __xdr_arena_binding(FALSE);
+	if (ab == NULL || (ab->ab_xdrs != NULL && ab->ab_xdrs != xdrs))
+		return (NULL);
+	return (ab->ab_arena);
+}
+
+/*
+ * Returns TRUE if bytes decoded from xdrs may be borrowed from its
+ * buffer (see xdr_arena_borrow()).  Streams being skimmed by xdr_skip()
+ * also lend their bytes.
+ */
+bool_t
+__xdr_borrowing(xdrs)
+	XDR *xdrs;
+{
+	struct xdr_arena_binding *ab;
+
+	if (xdrs->x_op != XDR_DECODE ||
+	    (ab = __xdr_arena_binding(FALSE)) == NULL)
+		return (FALSE);
+	return (ab->ab_arena != NULL &&
+	    (ab->ab_borrow == xdrs || ab->ab_skim == xdrs));
+}
+
+/*
+ * Returns TRUE if xdrs is being skimmed by xdr_skip(): borrowed bytes
+ * are then neither converted nor NUL-terminated, and the buffer is
+ * left untouched.
+ */
+bool_t
+__xdr_skimming(xdrs)
+	XDR *xdrs;
+{
+	struct xdr_arena_binding *ab;
+
+	if (xdrs->x_op != XDR_DECODE ||
+	    (ab = __xdr_arena_binding(FALSE)) == NULL)
+		return (FALSE);
+	return (ab->ab_arena != NULL && ab->ab_skim == xdrs);
+}
+
+/*
+ * Allocation and release of decoded objects.  Objects from an arena
+ * are zero-filled like mem_alloc()'s and are never freed one by one.
+ */
+void *
+__xdr_alloc(xdrs, size)
+	XDR *xdrs;
+	u_int size;
+{
+	xdr_arena_t *xa;
+
+	if ((xa = __xdr_arena(xdrs)) != NULL)
+		return (arena_alloc(xa, size));
+	return (mem_alloc(size));
+}
+
+void
+__xdr_free(xdrs, p, size)
+	XDR *xdrs;
+	void *p;
+	u_int size;
+{
+	if (__xdr_arena(xdrs) == NULL)
+		mem_free(p, size);
+}
@@ -37,15 +37,191 @@
  * arrays.  See xdr.h for more info on the interface to xdr.
  */
 
+#include <endian.h>
 #include <err.h>
 #include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
-#include <rpc/types.h>
-#include <rpc/xdr.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define XDR_BULK_AVX2
+#endif
+
+#include <rpc/rpc.h>
 #include "un-namespace.h"
+#include "rpc_com.h"
+
+/*
+ * Arrays of primitive elements whose XDR form is just the element in
+ * big-endian order are moved as a whole: the span is reserved with
+ * XDR_INLINE() and byte-swapped in one pass (with SSE2, or AVX2 when
+ * the CPU has it) instead of calling the element routine per element.
+ * If the stream cannot inline the span, the per-element loop is used.
+ */
+
+/*
+ * Returns the number of 32-bit XDR units per element if elproc is a
+ * primitive that can be moved in bulk, else 0.
+ */
+static int
+xdr_bulk_units(elproc, elsize)
+	xdrproc_t elproc;
+	u_int elsize;
+{
+	if (elsize == sizeof (int32_t) &&
+	    (elproc == (xdrproc_t)xdr_int ||
+	    elproc == (xdrproc_t)xdr_u_int ||
+	    elproc == (xdrproc_t)xdr_int32_t ||
+	    elproc == (xdrproc_t)xdr_u_int32_t ||
+	    elproc == (xdrproc_t)xdr_uint32_t
+#if !defined(__vax__)
+	    || elproc == (xdrproc_t)xdr_float
+#endif
+	    ))
+		return (1);
+	if (elsize == sizeof (int64_t) &&
+	    (elproc == (xdrproc_t)xdr_hyper ||
+	    elproc == (xdrproc_t)xdr_u_hyper ||
+	    elproc == (xdrproc_t)xdr_int64_t ||
+	    elproc == (xdrproc_t)xdr_u_int64_t ||
+	    elproc == (xdrproc_t)xdr_uint64_t ||
+	    elproc == (xdrproc_t)xdr_longlong_t ||
+	    elproc == (xdrproc_t)xdr_u_longlong_t
+#if !defined(__vax__)
+	    || elproc == (xdrproc_t)xdr_double
+#endif
+	    ))
+		return (2);
+	return (0);
+}
+
+#if BYTE_ORDER == LITTLE_ENDIAN
+
+#if defined(XDR_BULK_AVX2)
+/*
+ * Swaps n elements of the given units with AVX2; returns the number of
+ * elements done.
+ */
+__attribute__((target("avx2")))
+static u_int
+xdr_bulk_swap_avx2(dst, src, n, units)
+	u_int32_t *dst;
+	const u_int32_t *src;
+	u_int n;
+	int units;
+{
+	const __m256i m32 = _mm256_setr_epi8(
+	    3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+	    3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+	const __m256i m64 = _mm256_setr_epi8(
+	    7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8,
+	    7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8);
+	const __m256i m = units == 1 ? m32 : m64;
+	u_int words = n * units, i;
+	__m256i v;
+
+	for (i = 0; i + 8 <= words; i += 8) {
+		v = _mm256_loadu_si256((const __m256i *)(src + i));
+		_mm256_storeu_si256((__m256i *)(dst + i),
+		    _mm256_shuffle_epi8(v, m));
+	}
+	return (i / units);
+}
+#endif
+
+/*
+ * Copies n elements of units 32-bit words each from src to dst,
+ * reversing the byte order of every element.
+ */
+static void
+xdr_bulk_swap(dst, src, n, units)
+	u_int32_t *dst;
+	const u_int32_t *src;
+	u_int n;
+	int units;
+{
+	u_int i = 0;
+#if defined(__SSE2__)
+	__m128i v;
+#endif
+
+#if defined(XDR_BULK_AVX2)
+	if (n >= 16 && __builtin_cpu_supports("avx2"))
+		i = xdr_bulk_swap_avx2(dst, src, n, units);
+#endif
+#if defined(__SSE2__)
+	for (; (i + 4 / units) <= n; i += 4 / units) {
+		v = _mm_loadu_si128((const __m128i *)(src + i * units));
+		v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+		v = _mm_shufflehi_epi16(_mm_shufflelo_epi16(v, 0xb1), 0xb1);
+		if (units == 2)
+			v = _mm_shuffle_epi32(v, 0xb1);
+		_mm_storeu_si128((__m128i *)(dst + i * units), v);
+	}
+#endif
+	for (; i < n; i++) {
+		if (units == 1) {
+			dst[i] = htonl(src[i]);
+		} else {
+			dst[2 * i] = htonl(src[2 * i + 1]);
+			dst[2 * i + 1] = htonl(src[2 * i]);
+		}
+	}
+}
+
+#else /* BYTE_ORDER != LITTLE_ENDIAN */
+
+static void
+xdr_bulk_swap(dst, src, n, units)
+	u_int32_t *dst;
+	const u_int32_t *src;
+	u_int n;
+	int units;
+{
+	memcpy(dst, src, (size_t)n * units * BYTES_PER_XDR_UNIT);
+}
+
+#endif /* BYTE_ORDER */
+
+/*
+ * Moves nelem elements at base in bulk if elproc allows it.  Returns
+ * TRUE if the elements were handled, FALSE if the caller has to fall
+ * back to calling elproc per element.
+ */
+static bool_t
+xdr_bulk(xdrs, base, nelem, elsize, elproc)
+	XDR *xdrs;
+	char *base;
+	u_int nelem;
+	u_int elsize;
+	xdrproc_t elproc;
+{
+	int32_t *buf;
+	int units;
+
+	if (nelem == 0 || (units = xdr_bulk_units(elproc, elsize)) == 0)
+		return (FALSE);
+	if (xdrs->x_op == XDR_FREE)
+		return (TRUE);		/* nothing to free in a primitive */
+	if (nelem > INT_MAX / elsize)
+		return (FALSE);
+	if ((buf = XDR_INLINE(xdrs, nelem * elsize)) == NULL)
+		return (FALSE);
+	if (__xdr_skimming(xdrs))
+		return (TRUE);
+	if (xdrs->x_op == XDR_ENCODE)
+		xdr_bulk_swap((u_int32_t *)buf, (u_int32_t *)base, nelem,
+		    units);
+	else
+		xdr_bulk_swap((u_int32_t *)base, (u_int32_t *)buf, nelem,
+		    units);
+	return (TRUE);
+}
 
 /*
  * XDR an array of arbitrary elements
@@ -89,7 +265,16 @@ xdr_array(xdrs, addrp, sizep, maxsize, elsize, elproc)
 		case XDR_DECODE:
 			if (c == 0)
 				return (TRUE);
-			*addrp = target = mem_alloc(nodesize);
+			if (__xdr_skimming(xdrs) &&
+			    xdr_bulk_units(elproc, elsize) != 0 &&
+			    nodesize <= INT_MAX &&
+			    (target = (caddr_t)XDR_INLINE(xdrs, nodesize))
+			    != NULL) {
+				/* left in XDR order; see xdr_skip() */
+				*addrp = target;
+				return (TRUE);
+			}
+			*addrp = target = __xdr_alloc(xdrs, nodesize);
 			if (target == NULL) {
 				warnx("xdr_array: out of memory");
 				return (FALSE);
@@ -107,7 +292,11 @@ xdr_array(xdrs, addrp, sizep, maxsize, elsize, elproc)
 	/*
 	 * now we xdr each element of array
 	 */
-	for (i = 0; (i < c) && stat; i++) {
+	if (xdr_bulk(xdrs, target, c, elsize, elproc))
+		i = c;
+	else
+		i = 0;
+	for (; (i < c) && stat; i++) {
 		stat = (*elproc)(xdrs, target);
 		target += elsize;
 	}
@@ -116,7 +305,7 @@ xdr_array(xdrs, addrp, sizep, maxsize, elsize, elproc)
 	 * the array may need freeing
 	 */
 	if (xdrs->x_op == XDR_FREE) {
-		mem_free(*addrp, nodesize);
+		__xdr_free(xdrs, *addrp, nodesize);
 		*addrp = NULL;
 	}
 	return (stat);
@@ -143,6 +332,8 @@ xdr_vector(xdrs, basep, nelem, elemsize, xdr_elem)
 	u_int i;
 	char *elptr;
 
+	if (xdr_bulk(xdrs, basep, nelem, elemsize, xdr_elem))
+		return (TRUE);
 	elptr = basep;
 	for (i = 0; i < nelem; i++) {
 		if (!(*xdr_elem)(xdrs, elptr)) {
@@ -152,3 +343,79 @@ xdr_vector(xdrs, basep, nelem, elemsize, xdr_elem)
 	}
 	return(TRUE);	
 }
+
+/*
+ * Encoding of generated sequences.  The items are produced one at a
+ * time by xg_next and encoded as they come, so a stream that flushes
+ * as it fills (xdrrec) never holds more than a buffer of the sequence.
+ * xg_next returns FALSE on error and sets *objp to NULL after the last
+ * item.  Only XDR_ENCODE is supported; there is nothing to free.
+ * As a generator runs only once, the sequences cannot be sized with
+ * xdr_sizeof() or counted by a record stream holding its record (see
+ * __xdrrec_hold()); a record stream still holding one within its
+ * buffer is told to flush as usual.
+ */
+static bool_t
+generated_begin(xdrs)
+	XDR *xdrs;
+{
+	if (__xdr_sizing(xdrs) || __xdrrec_counting(xdrs))
+		return (FALSE);
+	(void)__xdrrec_unhold(xdrs, NULL);
+	return (TRUE);
+}
+
+/*
+ * A counted array of xg_count items.
+ */
+bool_t
+xdr_generated_array(xdrs, xg)
+	XDR *xdrs;
+	struct xdr_generator *xg;
+{
+	u_int i;
+	void *obj;
+
+	if (xdrs->x_op == XDR_FREE)
+		return (TRUE);
+	if (xdrs->x_op != XDR_ENCODE || !generated_begin(xdrs) ||
+	    !xdr_u_int(xdrs, &xg->xg_count))
+		return (FALSE);
+	for (i = 0; i < xg->xg_count; i++) {
+		if (!(*xg->xg_next)(xg->xg_arg, &obj) || obj == NULL)
+			return (FALSE);
+		if (!(*xg->xg_proc)(xdrs, obj))
+			return (FALSE);
+	}
+	return (TRUE);
+}
+
+/*
+ * A linked list in the form of optional-data chains: each item is
+ * preceded by TRUE and the list ends with FALSE.  xg_proc encodes the
+ * fields of an item but not its link to the next one.
+ */
+bool_t
+xdr_generated_list(xdrs, xg)
+	XDR *xdrs;
+	struct xdr_generator *xg;
+{
+	bool_t more;
+	void *obj;
+
+	if (xdrs->x_op == XDR_FREE)
+		return (TRUE);
+	if (xdrs->x_op != XDR_ENCODE || !generated_begin(xdrs))
+		return (FALSE);
+	for (;;) {
+		if (!(*xg->xg_next)(xg->xg_arg, &obj))
+			return (FALSE);
+		more = (obj != NULL);
+		if (!xdr_bool(xdrs, &more))
+			return (FALSE);
+		if (!more)
+			return (TRUE);
+		if (!(*xg->xg_proc)(xdrs, obj))
+			return (FALSE);
+	}
+}
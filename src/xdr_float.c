@@ -210,6 +210,8 @@ xdr_double(xdrs, dp)
 
 	case XDR_ENCODE:
 #ifdef IEEEFP
+		if (XDR_HAS_EXTOPS(xdrs))
+			return (XDR_PUTINT64(xdrs, (int64_t *)(void *)dp));
 		i32p = (int32_t *)(void *)dp;
 #if BYTE_ORDER == BIG_ENDIAN
 		rv = XDR_PUTINT32(xdrs, i32p);
@@ -250,6 +252,8 @@ xdr_double(xdrs, dp)
 
 	case XDR_DECODE:
 #ifdef IEEEFP
+		if (XDR_HAS_EXTOPS(xdrs))
+			return (XDR_GETINT64(xdrs, (int64_t *)(void *)dp));
 		i32p = (int32_t *)(void *)dp;
 #if BYTE_ORDER == BIG_ENDIAN
 		rv = XDR_GETINT32(xdrs, i32p);
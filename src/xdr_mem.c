@@ -60,6 +60,10 @@ static u_int xdrmem_getpos(XDR *);
 static bool_t xdrmem_setpos(XDR *, u_int);
 static int32_t *xdrmem_inline_aligned(XDR *, u_int);
 static int32_t *xdrmem_inline_unaligned(XDR *, u_int);
+static bool_t xdrmem_getint64(XDR *, int64_t *);
+static bool_t xdrmem_putint64(XDR *, const int64_t *);
+static bool_t xdrmem_getopaque(XDR *, char *, u_int);
+static bool_t xdrmem_putopaque(XDR *, const char *, u_int);
 
 static const struct	xdr_ops xdrmem_ops_aligned = {
 	xdrmem_getlong_aligned,
@@ -69,7 +73,12 @@ static const struct	xdr_ops xdrmem_ops_aligned = {
 	xdrmem_getpos,
 	xdrmem_setpos,
 	xdrmem_inline_aligned,
-	xdrmem_destroy
+	xdrmem_destroy,
+	xdr_extops_control,
+	xdrmem_getint64,
+	xdrmem_putint64,
+	xdrmem_getopaque,
+	xdrmem_putopaque
 };
 
 static const struct	xdr_ops xdrmem_ops_unaligned = {
@@ -80,7 +89,12 @@ static const struct	xdr_ops xdrmem_ops_unaligned = {
 	xdrmem_getpos,
 	xdrmem_setpos,
 	xdrmem_inline_unaligned,
-	xdrmem_destroy
+	xdrmem_destroy,
+	xdr_extops_control,
+	xdrmem_getint64,
+	xdrmem_putint64,
+	xdrmem_getopaque,
+	xdrmem_putopaque
 };
 
 /*
@@ -248,3 +262,71 @@ xdrmem_inline_unaligned(xdrs, len)
 
 	return (0);
 }
+
+static bool_t
+xdrmem_getint64(xdrs, llp)
+	XDR *xdrs;
+	int64_t *llp;
+{
+	u_int32_t l[2];
+
+	if (xdrs->x_handy < sizeof(l))
+		return (FALSE);
+	xdrs->x_handy -= sizeof(l);
+	memcpy(l, xdrs->x_private, sizeof(l));
+	*llp = (int64_t)(((u_int64_t)ntohl(l[0]) << 32) | ntohl(l[1]));
+	xdrs->x_private = (char *)xdrs->x_private + sizeof(l);
+	return (TRUE);
+}
+
+static bool_t
+xdrmem_putint64(xdrs, llp)
+	XDR *xdrs;
+	const int64_t *llp;
+{
+	u_int32_t l[2];
+
+	if (xdrs->x_handy < sizeof(l))
+		return (FALSE);
+	xdrs->x_handy -= sizeof(l);
+	l[0] = htonl((u_int32_t)((u_int64_t)*llp >> 32));
+	l[1] = htonl((u_int32_t)*llp);
+	memcpy(xdrs->x_private, l, sizeof(l));
+	xdrs->x_private = (char *)xdrs->x_private + sizeof(l);
+	return (TRUE);
+}
+
+static bool_t
+xdrmem_getopaque(xdrs, addr, len)
+	XDR *xdrs;
+	char *addr;
+	u_int len;
+{
+	u_int pad = (BYTES_PER_XDR_UNIT - len % BYTES_PER_XDR_UNIT) %
+	    BYTES_PER_XDR_UNIT;
+
+	if (xdrs->x_handy < len || xdrs->x_handy - len < pad)
+		return (FALSE);
+	xdrs->x_handy -= len + pad;
+	memmove(addr, xdrs->x_private, len);
+	xdrs->x_private = (char *)xdrs->x_private + len + pad;
+	return (TRUE);
+}
+
+static bool_t
+xdrmem_putopaque(xdrs, addr, len)
+	XDR *xdrs;
+	const char *addr;
+	u_int len;
+{
+	u_int pad = (BYTES_PER_XDR_UNIT - len % BYTES_PER_XDR_UNIT) %
+	    BYTES_PER_XDR_UNIT;
+
+	if (xdrs->x_handy < len || xdrs->x_handy - len < pad)
+		return (FALSE);
+	xdrs->x_handy -= len + pad;
+	memmove(xdrs->x_private, addr, len);
+	memset((char *)xdrs->x_private + len, 0, pad);
+	xdrs->x_private = (char *)xdrs->x_private + len + pad;
+	return (TRUE);
+}
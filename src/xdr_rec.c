@@ -46,13 +46,20 @@
  */
 
 #include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/time.h>
 
 #include <netinet/in.h>
+#ifdef MSG_ZEROCOPY
+#include <linux/errqueue.h>
+#endif
 
 #include <err.h>
 #include <stdio.h>
+#include <poll.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 #include <rpc/types.h>
 #include <rpc/xdr.h>
@@ -72,6 +79,10 @@ static u_int	xdrrec_getpos(XDR *);
 static bool_t	xdrrec_setpos(XDR *, u_int);
 static int32_t *xdrrec_inline(XDR *, u_int);
 static void	xdrrec_destroy(XDR *);
+static bool_t	xdrrec_getint64(XDR *, int64_t *);
+static bool_t	xdrrec_putint64(XDR *, const int64_t *);
+static bool_t	xdrrec_getopaque(XDR *, char *, u_int);
+static bool_t	xdrrec_putopaque(XDR *, const char *, u_int);
 
 static const struct  xdr_ops xdrrec_ops = {
 	xdrrec_getlong,
@@ -81,7 +92,12 @@ static const struct  xdr_ops xdrrec_ops = {
 	xdrrec_getpos,
 	xdrrec_setpos,
 	xdrrec_inline,
-	xdrrec_destroy
+	xdrrec_destroy,
+	xdr_extops_control,
+	xdrrec_getint64,
+	xdrrec_putint64,
+	xdrrec_getopaque,
+	xdrrec_putopaque
 };
 
 /*
@@ -99,6 +115,18 @@ static const struct  xdr_ops xdrrec_ops = {
 
 #define LAST_FRAG ((u_int32_t)(1 << 31))
 
+/*
+ * An output buffer handed to the kernel with MSG_ZEROCOPY.  It may not
+ * be written again until the kernel has completed sends [lo, lo + n).
+ */
+struct zc_buf {
+	struct zc_buf *next;
+	char *base;
+	u_int32_t lo;
+	u_int32_t n;
+	u_int pending;
+};
+
 typedef struct rec_strm {
 	char *tcp_handle;
 	/*
@@ -131,10 +159,31 @@ typedef struct rec_strm {
 	int in_reclen;
 	int in_received;
 	int in_maxrec;
+	/* sends bytes of a file (see __xdrrec_setsendfile()) */
+	bool_t (*sendfileit)(void *, int, off_t *, size_t);
+	/* MSG_ZEROCOPY state (see __xdrrec_setzerocopy()) */
+	int zc_fd;		/* socket the busy buffers were sent on */
+	bool_t zc_on;		/* send large flushes with MSG_ZEROCOPY */
+	u_int32_t zc_next;	/* id the kernel gives the next send */
+	struct zc_buf *zc_busy;	/* buffers still owned by the kernel */
+	struct zc_buf *zc_spare;	/* completed buffers kept for reuse */
+	int zc_nbusy;
+	int zc_nspare;
+	/* whole-record output (see __xdrrec_hold(), __xdrrec_setreclen()) */
+	bool_t out_hold;	/* count rather than flush a full buffer */
+	bool_t out_overflow;	/* the held record did not fit */
+	u_long out_count;	/* bytes of it counted and discarded */
+	bool_t out_exact;	/* the record is one fragment of known size */
+	u_long out_left;	/* bytes from out_base to the end of it */
 } RECSTREAM;
 
 static u_int	fix_buf_size(u_int);
 static bool_t	flush_out(RECSTREAM *, bool_t);
+static bool_t	flush_exact(RECSTREAM *, bool_t);
+static bool_t	write_out(RECSTREAM *, int);
+static bool_t	zc_write(RECSTREAM *, int);
+static int	zc_reap(RECSTREAM *);
+static void	zc_drain(RECSTREAM *);
 static bool_t	fill_input_buf(RECSTREAM *);
 static bool_t	get_input_bytes(RECSTREAM *, char *, int);
 static bool_t	set_input_fragment(RECSTREAM *);
@@ -211,6 +260,14 @@ xdrrec_create(xdrs, sendsize, recvsize, tcp_handle, readit, writeit)
 	rstrm->nonblock = FALSE;
 	rstrm->in_reclen = 0;
 	rstrm->in_received = 0;
+	rstrm->sendfileit = NULL;
+	rstrm->zc_fd = -1;
+	rstrm->zc_on = FALSE;
+	rstrm->zc_next = 0;
+	rstrm->zc_busy = rstrm->zc_spare = NULL;
+	rstrm->zc_nbusy = rstrm->zc_nspare = 0;
+	rstrm->out_hold = rstrm->out_overflow = rstrm->out_exact = FALSE;
+	rstrm->out_left = 0;
 }
 
 
@@ -321,6 +378,76 @@ xdrrec_putbytes(xdrs, addr, len)
 	return (TRUE);
 }
 
+static bool_t
+xdrrec_getint64(xdrs, llp)
+	XDR *xdrs;
+	int64_t *llp;
+{
+	RECSTREAM *rstrm = (RECSTREAM *)(xdrs->x_private);
+	u_int32_t l[2];
+
+	/* first try the inline, fast case */
+	if ((rstrm->fbtbc >= sizeof(l)) &&
+		(((long)rstrm->in_boundry - (long)rstrm->in_finger) >=
+		sizeof(l))) {
+		memcpy(l, rstrm->in_finger, sizeof(l));
+		rstrm->fbtbc -= sizeof(l);
+		rstrm->in_finger += sizeof(l);
+	} else {
+		if (! xdrrec_getbytes(xdrs, (char *)(void *)l, sizeof(l)))
+			return (FALSE);
+	}
+	*llp = (int64_t)(((u_int64_t)ntohl(l[0]) << 32) | ntohl(l[1]));
+	return (TRUE);
+}
+
+static bool_t
+xdrrec_putint64(xdrs, llp)
+	XDR *xdrs;
+	const int64_t *llp;
+{
+	RECSTREAM *rstrm = (RECSTREAM *)(xdrs->x_private);
+	u_int32_t l[2];
+
+	l[0] = htonl((u_int32_t)((u_int64_t)*llp >> 32));
+	l[1] = htonl((u_int32_t)*llp);
+	if (rstrm->out_finger + sizeof(l) > rstrm->out_boundry)
+		return (xdrrec_putbytes(xdrs, (char *)(void *)l, sizeof(l)));
+	memcpy(rstrm->out_finger, l, sizeof(l));
+	rstrm->out_finger += sizeof(l);
+	return (TRUE);
+}
+
+static bool_t
+xdrrec_getopaque(xdrs, addr, len)
+	XDR *xdrs;
+	char *addr;
+	u_int len;
+{
+	char crud[BYTES_PER_XDR_UNIT];
+	u_int pad = (BYTES_PER_XDR_UNIT - len % BYTES_PER_XDR_UNIT) %
+	    BYTES_PER_XDR_UNIT;
+
+	if (! xdrrec_getbytes(xdrs, addr, len))
+		return (FALSE);
+	return (pad == 0 || xdrrec_getbytes(xdrs, crud, pad));
+}
+
+static bool_t
+xdrrec_putopaque(xdrs, addr, len)
+	XDR *xdrs;
+	const char *addr;
+	u_int len;
+{
+	static const char zero[BYTES_PER_XDR_UNIT];
+	u_int pad = (BYTES_PER_XDR_UNIT - len % BYTES_PER_XDR_UNIT) %
+	    BYTES_PER_XDR_UNIT;
+
+	if (! xdrrec_putbytes(xdrs, addr, len))
+		return (FALSE);
+	return (pad == 0 || xdrrec_putbytes(xdrs, zero, pad));
+}
+
 static u_int
 xdrrec_getpos(xdrs)
 	XDR *xdrs;
@@ -424,6 +551,8 @@ xdrrec_destroy(xdrs)
 {
 	RECSTREAM *rstrm = (RECSTREAM *)xdrs->x_private;
 
+	if (rstrm->zc_busy != NULL || rstrm->zc_spare != NULL)
+		zc_drain(rstrm);
 	mem_free(rstrm->out_base, rstrm->sendsize);
 	mem_free(rstrm->in_base, rstrm->recvsize);
 	mem_free(rstrm, sizeof(RECSTREAM));
@@ -506,7 +635,8 @@ xdrrec_endofrecord(xdrs, sendnow)
 	RECSTREAM *rstrm = (RECSTREAM *)(xdrs->x_private);
 	u_long len;  /* fragment length */
 
-	if (sendnow || rstrm->frag_sent ||
+	rstrm->out_hold = FALSE;
+	if (sendnow || rstrm->frag_sent || rstrm->out_exact ||
 		((u_long)rstrm->out_finger + sizeof(u_int32_t) >=
 		(u_long)rstrm->out_boundry)) {
 		rstrm->frag_sent = FALSE;
@@ -614,6 +744,231 @@ __xdrrec_getrec(xdrs, statp, expectdata)
 	return FALSE;
 }
 
+/*
+ * Consumes up to len bytes of the current record that sit contiguously
+ * in the input buffer, refilling the buffer and moving on to the next
+ * fragment as needed.  *bufp is set to the bytes, which stay valid
+ * until the stream is read again.  Returns their number, 0 on error or
+ * at the end of the record, or -1 if xdrs is not a record stream.
+ */
+int
+__xdrrec_getchunk(xdrs, bufp, len)
+	XDR *xdrs;
+	char **bufp;
+	u_int len;
+{
+	RECSTREAM *rstrm;
+	u_long current;
+
+	if (xdrs->x_ops != &xdrrec_ops)
+		return (-1);
+	rstrm = (RECSTREAM *)(xdrs->x_private);
+	while (rstrm->fbtbc == 0) {
+		if (rstrm->last_frag || ! set_input_fragment(rstrm))
+			return (0);
+	}
+	if (rstrm->in_finger == rstrm->in_boundry &&
+	    ! fill_input_buf(rstrm))
+		return (0);
+	current = (u_long)rstrm->in_boundry - (u_long)rstrm->in_finger;
+	if (current > (u_long)rstrm->fbtbc)
+		current = (u_long)rstrm->fbtbc;
+	if (current > len)
+		current = len;
+	*bufp = rstrm->in_finger;
+	rstrm->in_finger += current;
+	rstrm->fbtbc -= current;
+	return ((int)current);
+}
+
+/*
+ * Lets __xdrrec_putfile() move file contents with sendfileit, which
+ * sends len bytes of fd at *offp to the connection and advances *offp.
+ */
+void
+__xdrrec_setsendfile(xdrs, sendfileit)
+	XDR *xdrs;
+	bool_t (*sendfileit)(void *, int, off_t *, size_t);
+{
+	RECSTREAM *rstrm = (RECSTREAM *)(xdrs->x_private);
+
+	rstrm->sendfileit = sendfileit;
+}
+
+#define FILE_FRAG_MAX	(1U << 30)
+
+/*
+ * Encodes len bytes of fd at offset as the next bytes of the record
+ * without copying them through the output buffer: the fragment so far
+ * is written out, and the file is sent as fragments of its own.  The
+ * last four bytes are read into the buffer to start the following
+ * fragment, so that no fragment is ever empty.  Returns -1 if the
+ * stream cannot do this (the caller then copies), else TRUE or FALSE.
+ */
+int
+__xdrrec_putfile(xdrs, fd, offset, len)
+	XDR *xdrs;
+	int fd;
+	off_t offset;
+	u_int len;
+{
+	RECSTREAM *rstrm;
+	u_int chunk, tail = BYTES_PER_XDR_UNIT;
+	int n;
+
+	if (xdrs->x_ops != &xdrrec_ops || xdrs->x_op != XDR_ENCODE)
+		return (-1);
+	rstrm = (RECSTREAM *)(xdrs->x_private);
+	/* small bodies are cheaper to copy */
+	if (rstrm->sendfileit == NULL || len < rstrm->sendsize)
+		return (-1);
+	if (rstrm->out_hold) {
+		/* only counted, like the rest of a held record */
+		rstrm->out_overflow = TRUE;
+		rstrm->out_count += len;
+		return (TRUE);
+	}
+	if (rstrm->out_exact) {
+		/* no fragment headers to write: send it all in one go */
+		n = (int)((u_long)rstrm->out_finger - (u_long)rstrm->out_base);
+		if (n + (u_long)len > rstrm->out_left || ! flush_exact(rstrm,
+		    FALSE))
+			return (FALSE);
+		rstrm->out_left -= len;
+		return ((*(rstrm->sendfileit))(rstrm->tcp_handle, fd, &offset,
+		    len));
+	}
+	len -= tail;
+
+	/* end the current fragment, unless it is still empty */
+	if (rstrm->out_finger !=
+	    (char *)rstrm->frag_header + sizeof(u_int32_t)) {
+		*(rstrm->frag_header) = htonl((u_int32_t)((u_long)
+		    rstrm->out_finger - (u_long)rstrm->frag_header -
+		    sizeof(u_int32_t)));
+		if (rstrm->out_finger + sizeof(u_int32_t) >
+		    rstrm->out_boundry) {
+			n = (int)((u_long)rstrm->out_finger -
+			    (u_long)rstrm->out_base);
+			if (! write_out(rstrm, n))
+				return (FALSE);
+			rstrm->out_finger = rstrm->out_base;
+		}
+		rstrm->frag_header = (u_int32_t *)(void *)rstrm->out_finger;
+		rstrm->out_finger += sizeof(u_int32_t);
+	}
+	while (len > 0) {
+		chunk = len < FILE_FRAG_MAX ? len : FILE_FRAG_MAX;
+		*(rstrm->frag_header) = htonl(chunk);
+		n = (int)((u_long)rstrm->out_finger - (u_long)rstrm->out_base);
+		if (! write_out(rstrm, n))
+			return (FALSE);
+		rstrm->frag_header = (u_int32_t *)(void *)rstrm->out_base;
+		rstrm->out_finger = rstrm->out_base + sizeof(u_int32_t);
+		if (! (*(rstrm->sendfileit))(rstrm->tcp_handle, fd, &offset,
+		    chunk))
+			return (FALSE);
+		len -= chunk;
+	}
+	rstrm->frag_sent = TRUE;
+
+	while ((n = pread(fd, rstrm->out_finger, tail, offset)) != (int)tail)
+		if (n >= 0 || errno != EINTR)
+			return (FALSE);
+	rstrm->out_finger += tail;
+	return (TRUE);
+}
+
+/*
+ * Holds the record about to be encoded in the output buffer: if it
+ * does not fit, nothing is flushed and the rest of it is only counted,
+ * so that the caller can start it over knowing its length (see
+ * __xdrrec_unhold() and __xdrrec_setreclen()).  Returns FALSE if the
+ * stream cannot do this.
+ */
+bool_t
+__xdrrec_hold(xdrs)
+	XDR *xdrs;
+{
+	RECSTREAM *rstrm;
+
+	if (xdrs->x_ops != &xdrrec_ops || xdrs->x_op != XDR_ENCODE)
+		return (FALSE);
+	rstrm = (RECSTREAM *)(xdrs->x_private);
+	if (rstrm->frag_sent || rstrm->out_exact ||
+	    (char *)rstrm->frag_header != rstrm->out_base ||
+	    rstrm->out_finger != rstrm->out_base + sizeof(u_int32_t))
+		return (FALSE);
+	rstrm->out_hold = TRUE;
+	rstrm->out_overflow = FALSE;
+	rstrm->out_count = 0;
+	return (TRUE);
+}
+
+/*
+ * Stops holding the record.  Returns TRUE if it did not fit; it was then
+ * only counted and must be encoded again, and *lenp (if lenp is not
+ * NULL) is set to the length counted.
+ */
+bool_t
+__xdrrec_unhold(xdrs, lenp)
+	XDR *xdrs;
+	u_long *lenp;
+{
+	RECSTREAM *rstrm;
+
+	if (xdrs->x_ops != &xdrrec_ops)
+		return (FALSE);
+	rstrm = (RECSTREAM *)(xdrs->x_private);
+	rstrm->out_hold = FALSE;
+	if (! rstrm->out_overflow)
+		return (FALSE);
+	if (lenp != NULL)
+		*lenp = rstrm->out_count + (u_long)rstrm->out_finger -
+		    (u_long)rstrm->frag_header - sizeof(u_int32_t);
+	rstrm->out_overflow = FALSE;
+	rstrm->out_count = 0;
+	rstrm->frag_sent = FALSE;
+	rstrm->out_finger = (char *)rstrm->frag_header + sizeof(u_int32_t);
+	return (TRUE);
+}
+
+/*
+ * TRUE while a held record that did not fit is being counted.
+ */
+bool_t
+__xdrrec_counting(xdrs)
+	XDR *xdrs;
+{
+	RECSTREAM *rstrm = (RECSTREAM *)(xdrs->x_private);
+
+	return (xdrs->x_ops == &xdrrec_ops && rstrm->out_overflow);
+}
+
+/*
+ * Sends the record about to be encoded as a single fragment of len
+ * bytes instead of one per buffer.  The record must then come out at
+ * exactly that length: if it does not, xdrrec_endofrecord() fails and
+ * the connection is out of step with its peer.
+ */
+bool_t
+__xdrrec_setreclen(xdrs, len)
+	XDR *xdrs;
+	u_long len;
+{
+	RECSTREAM *rstrm = (RECSTREAM *)(xdrs->x_private);
+
+	if (rstrm->frag_sent || rstrm->out_exact || len == 0 ||
+	    len >= LAST_FRAG || rstrm->out_finger !=
+	    (char *)rstrm->frag_header + sizeof(u_int32_t))
+		return (FALSE);
+	*(rstrm->frag_header) = htonl((u_int32_t)len | LAST_FRAG);
+	rstrm->out_left = (u_long)rstrm->out_finger -
+	    (u_long)rstrm->out_base + len;
+	rstrm->out_exact = TRUE;
+	return (TRUE);
+}
+
 bool_t
 __xdrrec_setnonblock(xdrs, maxrec)
 	XDR *xdrs;
@@ -628,6 +983,52 @@ __xdrrec_setnonblock(xdrs, maxrec)
 	return TRUE;
 }
 
+/*
+ * Sends flushes of at least ZC_MIN bytes on fd with MSG_ZEROCOPY when
+ * on is TRUE.  A buffer handed to the kernel this way is swapped for
+ * a spare one and only written again once the completion notification
+ * for it has been read from the socket error queue.  Returns FALSE if
+ * the socket cannot do this.
+ */
+bool_t
+__xdrrec_setzerocopy(xdrs, fd, on)
+	XDR *xdrs;
+	int fd;
+	bool_t on;
+{
+	RECSTREAM *rstrm = (RECSTREAM *)(xdrs->x_private);
+#ifdef MSG_ZEROCOPY
+	int one = 1;
+
+	if (on && rstrm->zc_fd != fd) {
+		if (rstrm->zc_busy != NULL || setsockopt(fd, SOL_SOCKET,
+		    SO_ZEROCOPY, &one, sizeof (one)) == -1)
+			return (FALSE);
+		rstrm->zc_fd = fd;
+		rstrm->zc_next = 0;
+	}
+	rstrm->zc_on = on;
+	return (TRUE);
+#else
+	return (! on);
+#endif
+}
+
+/*
+ * Reads the zerocopy completions queued on the socket, so that the
+ * transport can tell them from input.  Returns how many were read.
+ */
+int
+__xdrrec_zcreap(xdrs)
+	XDR *xdrs;
+{
+	RECSTREAM *rstrm = (RECSTREAM *)(xdrs->x_private);
+
+	if (rstrm->zc_fd == -1)
+		return (0);
+	return (zc_reap(rstrm));
+}
+
 /*
  * Internal useful routines
  */
@@ -640,17 +1041,259 @@ flush_out(rstrm, eor)
 	u_int32_t len = (u_int32_t)((u_long)(rstrm->out_finger) - 
 		(u_long)(rstrm->frag_header) - sizeof(u_int32_t));
 
+	if (rstrm->out_exact)
+		return (flush_exact(rstrm, eor));
+	if (rstrm->out_hold && ! eor) {
+		/* the record does not fit: count the buffer and reuse it */
+		rstrm->out_overflow = TRUE;
+		rstrm->out_count += len;
+		rstrm->out_finger = (char *)rstrm->frag_header +
+		    sizeof(u_int32_t);
+		return (TRUE);
+	}
 	*(rstrm->frag_header) = htonl(len | eormask);
 	len = (u_int32_t)((u_long)(rstrm->out_finger) - 
 	    (u_long)(rstrm->out_base));
-	if ((*(rstrm->writeit))(rstrm->tcp_handle, rstrm->out_base, (int)len)
-		!= (int)len)
+	if (! write_out(rstrm, (int)len))
 		return (FALSE);
 	rstrm->frag_header = (u_int32_t *)(void *)rstrm->out_base;
 	rstrm->out_finger = (char *)rstrm->out_base + sizeof(u_int32_t);
 	return (TRUE);
 }
 
+/*
+ * The kernel numbers MSG_ZEROCOPY sends on a socket and reports each
+ * range of completed ones with SO_EE_ORIGIN_ZEROCOPY on the error
+ * queue.  Up to ZC_MAXBUSY buffers may be in flight at once; a few
+ * completed ones are kept rather than freed.
+ */
+#define ZC_MIN		(32 * 1024)
+#define ZC_MAXBUSY	16
+#define ZC_MAXSPARE	4
+#define ZC_DRAIN_MS	1000
+
+/*
+ * flush_out() for a record sent as a single fragment whose header was
+ * written by __xdrrec_setreclen(): the buffer is written as is, and
+ * the record must end exactly where the header said it would.
+ */
+static bool_t
+flush_exact(rstrm, eor)
+	RECSTREAM *rstrm;
+	bool_t eor;
+{
+	u_long len = (u_long)rstrm->out_finger - (u_long)rstrm->out_base;
+	bool_t stat = TRUE;
+
+	if (len > rstrm->out_left || (eor && len != rstrm->out_left))
+		stat = FALSE;
+	else if (len > 0)
+		stat = write_out(rstrm, (int)len);
+	if (! stat || eor) {
+		rstrm->out_exact = FALSE;
+		rstrm->frag_header = (u_int32_t *)(void *)rstrm->out_base;
+		rstrm->out_finger = rstrm->out_base + sizeof(u_int32_t);
+		return (stat);
+	}
+	rstrm->out_left -= len;
+	rstrm->frag_header = (u_int32_t *)(void *)rstrm->out_base;
+	rstrm->out_finger = rstrm->out_base;
+	return (TRUE);
+}
+
+/*
+ * Writes the first len bytes of the output buffer to the connection.
+ */
+static bool_t
+write_out(rstrm, len)
+	RECSTREAM *rstrm;
+	int len;
+{
+	if (rstrm->zc_on && len >= ZC_MIN)
+		return (zc_write(rstrm, len));
+	return ((*(rstrm->writeit))(rstrm->tcp_handle, rstrm->out_base, len)
+	    == len);
+}
+
+static bool_t
+zc_write(rstrm, len)
+	RECSTREAM *rstrm;
+	int len;
+{
+#ifdef MSG_ZEROCOPY
+	struct zc_buf *zb;
+	char *buf = rstrm->out_base;
+	u_int32_t lo = rstrm->zc_next;
+	bool_t stat = TRUE;
+	ssize_t i;
+
+	if (rstrm->zc_busy != NULL)
+		(void)zc_reap(rstrm);
+	if (rstrm->zc_nbusy >= ZC_MAXBUSY)
+		goto copy;
+	if ((zb = rstrm->zc_spare) != NULL) {
+		rstrm->zc_spare = zb->next;
+		rstrm->zc_nspare--;
+	} else {
+		if ((zb = mem_alloc(sizeof (*zb))) == NULL)
+			goto copy;
+		if ((zb->base = mem_alloc(rstrm->sendsize)) == NULL) {
+			mem_free(zb, sizeof (*zb));
+			goto copy;
+		}
+	}
+
+	/*
+	 * Whatever the socket will not take without blocking (or pinning
+	 * more memory) goes through writeit, which knows how long to wait
+	 * and how to report errors.
+	 */
+	while (len > 0) {
+		i = send(rstrm->zc_fd, buf, (size_t)len,
+		    MSG_ZEROCOPY | MSG_DONTWAIT | MSG_NOSIGNAL);
+		if (i == -1) {
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+		rstrm->zc_next++;
+		buf += i;
+		len -= (int)i;
+	}
+	if (len > 0 && (*(rstrm->writeit))(rstrm->tcp_handle, buf, len) != len)
+		stat = FALSE;
+
+	if (rstrm->zc_next == lo) {
+		zb->next = rstrm->zc_spare;
+		rstrm->zc_spare = zb;
+		rstrm->zc_nspare++;
+		return (stat);
+	}
+	buf = zb->base;
+	zb->base = rstrm->out_base;
+	zb->lo = lo;
+	zb->n = zb->pending = rstrm->zc_next - lo;
+	zb->next = rstrm->zc_busy;
+	rstrm->zc_busy = zb;
+	rstrm->zc_nbusy++;
+	rstrm->out_base = buf;
+	rstrm->out_boundry = buf + rstrm->sendsize;
+	return (stat);
+copy:
+#endif
+	return ((*(rstrm->writeit))(rstrm->tcp_handle, rstrm->out_base, len)
+	    == len);
+}
+
+static int
+zc_reap(rstrm)
+	RECSTREAM *rstrm;
+{
+	int n = 0;
+#ifdef MSG_ZEROCOPY
+	char control[128];
+	struct msghdr msg;
+	struct cmsghdr *cm;
+	struct sock_extended_err *ee;
+	struct zc_buf *zb, **zbp;
+	u_int32_t id, span;
+
+	for (;;) {
+		memset(&msg, 0, sizeof (msg));
+		msg.msg_control = control;
+		msg.msg_controllen = sizeof (control);
+		if (recvmsg(rstrm->zc_fd, &msg, MSG_ERRQUEUE) == -1) {
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+		for (cm = CMSG_FIRSTHDR(&msg); cm != NULL;
+		    cm = CMSG_NXTHDR(&msg, cm)) {
+			if (!(cm->cmsg_level == SOL_IP &&
+			    cm->cmsg_type == IP_RECVERR) &&
+			    !(cm->cmsg_level == SOL_IPV6 &&
+			    cm->cmsg_type == IPV6_RECVERR))
+				continue;
+			ee = (struct sock_extended_err *)(void *)CMSG_DATA(cm);
+			if (ee->ee_origin != SO_EE_ORIGIN_ZEROCOPY ||
+			    ee->ee_errno != 0)
+				continue;
+			n++;
+			/* sends ee_info through ee_data have completed */
+			span = ee->ee_data - ee->ee_info;
+			for (zb = rstrm->zc_busy; zb != NULL; zb = zb->next)
+				for (id = zb->lo; id != zb->lo + zb->n; id++)
+					if (id - ee->ee_info <= span &&
+					    zb->pending > 0)
+						zb->pending--;
+		}
+	}
+
+	for (zbp = &rstrm->zc_busy; (zb = *zbp) != NULL; ) {
+		if (zb->pending > 0) {
+			zbp = &zb->next;
+			continue;
+		}
+		*zbp = zb->next;
+		rstrm->zc_nbusy--;
+		if (rstrm->zc_nspare < ZC_MAXSPARE) {
+			zb->next = rstrm->zc_spare;
+			rstrm->zc_spare = zb;
+			rstrm->zc_nspare++;
+		} else {
+			mem_free(zb->base, rstrm->sendsize);
+			mem_free(zb, sizeof (*zb));
+		}
+	}
+#endif
+	return (n);
+}
+
+/*
+ * Waits a little for the kernel to let go of the busy buffers, then
+ * frees the ones it has.  A buffer still queued on the socket may
+ * yet be transmitted, so it is leaked rather than handed back to
+ * malloc.
+ */
+static void
+zc_drain(rstrm)
+	RECSTREAM *rstrm;
+{
+	struct zc_buf *zb;
+	struct pollfd pfd;
+	struct timeval t0, t1;
+	int ms;
+
+	gettimeofday(&t0, NULL);
+	while (rstrm->zc_busy != NULL) {
+		(void)zc_reap(rstrm);
+		if (rstrm->zc_busy == NULL)
+			break;
+		gettimeofday(&t1, NULL);
+		ms = ZC_DRAIN_MS - (int)((t1.tv_sec - t0.tv_sec) * 1000 +
+		    (t1.tv_usec - t0.tv_usec) / 1000);
+		if (ms <= 0)
+			break;
+		pfd.fd = rstrm->zc_fd;
+		pfd.events = 0;
+		pfd.revents = 0;
+		if (poll(&pfd, 1, ms) == -1 && errno != EINTR)
+			break;
+		/* an error or hangup that is not a completion */
+		if (pfd.revents != 0 && zc_reap(rstrm) == 0)
+			break;
+	}
+	while ((zb = rstrm->zc_spare) != NULL) {
+		rstrm->zc_spare = zb->next;
+		mem_free(zb->base, rstrm->sendsize);
+		mem_free(zb, sizeof (*zb));
+	}
+	while ((zb = rstrm->zc_busy) != NULL) {
+		rstrm->zc_busy = zb->next;
+		mem_free(zb, sizeof (*zb));
+	}
+}
+
 static bool_t  /* knows nothing about records!  Only about input buffers */
 fill_input_buf(rstrm)
 	RECSTREAM *rstrm;
@@ -681,6 +1324,7 @@ get_input_bytes(rstrm, addr, len)
 	int len;
 {
 	size_t current;
+	int n;
 
 	if (rstrm->nonblock) {
 		if (len > (int)(rstrm->in_boundry - rstrm->in_finger))
@@ -694,6 +1338,20 @@ get_input_bytes(rstrm, addr, len)
 		current = (size_t)((long)rstrm->in_boundry -
 		    (long)rstrm->in_finger);
 		if (current == 0) {
+			if (len >= (int)rstrm->in_size) {
+				/* read large spans straight into place */
+				n = (*(rstrm->readit))(rstrm->tcp_handle, addr, len);
+				if (n <= 0)
+					return (FALSE);
+				addr += n;
+				len -= n;
+				/* keep the buffer aligned with the stream */
+				rstrm->in_boundry = rstrm->in_base +
+				    ((u_long)rstrm->in_boundry + n) %
+				    BYTES_PER_XDR_UNIT;
+				rstrm->in_finger = rstrm->in_boundry;
+				continue;
+			}
 			if (! fill_input_buf(rstrm))
 				return (FALSE);
 			continue;
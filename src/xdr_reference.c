@@ -41,8 +41,8 @@
 #include <stdlib.h>
 #include <string.h>
 
-#include <rpc/types.h>
-#include <rpc/xdr.h>
+#include <rpc/rpc.h>
+#include "rpc_com.h"
 
 #if defined(__FreeBSD__) || defined(__NetBSD__)
 #include <libc_private.h>
@@ -73,7 +73,7 @@ xdr_reference(xdrs, pp, size, proc)
 			return (TRUE);
 
 		case XDR_DECODE:
-			*pp = loc = (caddr_t) mem_alloc(size);
+			*pp = loc = (caddr_t) __xdr_alloc(xdrs, size);
 			if (loc == NULL) {
 				warnx("xdr_reference: out of memory");
 				return (FALSE);
@@ -88,7 +88,7 @@ xdr_reference(xdrs, pp, size, proc)
 	stat = (*proc)(xdrs, loc);
 
 	if (xdrs->x_op == XDR_FREE) {
-		mem_free(loc, size);
+		__xdr_free(xdrs, loc, size);
 		*pp = NULL;
 	}
 	return (stat);
@@ -35,18 +35,26 @@
  */
 
 
-#include <rpc/types.h>
-#include <rpc/xdr.h>
+#include <rpc/rpc.h>
 #include <sys/types.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <string.h>
 #include "un-namespace.h"
+#include "rpc_com.h"
+
+/*
+ * Inline requests are given this much scratch space, which the caller
+ * of xdr_sizeof() keeps on its stack; longer ones fail, and the xdr
+ * routines then fall back to XDR_PUTLONG/XDR_PUTBYTES.
+ */
+#define SIZEOF_SCRATCH	1024
 
 /* ARGSUSED */
 static bool_t
 x_putlong(xdrs, longp)
 	XDR *xdrs;
-	long *longp;
+	const long *longp;
 {
 	xdrs->x_handy += BYTES_PER_XDR_UNIT;
 	return (TRUE);
@@ -56,13 +64,34 @@ x_putlong(xdrs, longp)
 static bool_t
 x_putbytes(xdrs, bp, len)
 	XDR *xdrs;
-	char  *bp;
+	const char *bp;
 	u_int len;
 {
 	xdrs->x_handy += len;
 	return (TRUE);
 }
 
+/* ARGSUSED */
+static bool_t
+x_putint64(xdrs, llp)
+	XDR *xdrs;
+	const int64_t *llp;
+{
+	xdrs->x_handy += 2 * BYTES_PER_XDR_UNIT;
+	return (TRUE);
+}
+
+/* ARGSUSED */
+static bool_t
+x_putopaque(xdrs, bp, len)
+	XDR *xdrs;
+	const char *bp;
+	u_int len;
+{
+	xdrs->x_handy += RNDUP(len);
+	return (TRUE);
+}
+
 static u_int
 x_getpostn(xdrs)
 	XDR *xdrs;
@@ -85,28 +114,15 @@ x_inline(xdrs, len)
 	XDR *xdrs;
 	u_int len;
 {
-	if (len == 0) {
+	if (len == 0 || len > SIZEOF_SCRATCH) {
 		return (NULL);
 	}
 	if (xdrs->x_op != XDR_ENCODE) {
 		return (NULL);
 	}
-	if (len < (uintptr_t)xdrs->x_base) {
-		/* x_private was already allocated */
-		xdrs->x_handy += len;
-		return ((int32_t *) xdrs->x_private);
-	} else {
-		/* Free the earlier space and allocate new area */
-		if (xdrs->x_private)
-			free(xdrs->x_private);
-		if ((xdrs->x_private = (caddr_t) malloc(len)) == NULL) {
-			xdrs->x_base = 0;
-			return (NULL);
-		}
-		xdrs->x_base = (caddr_t)(uintptr_t)len;
-		xdrs->x_handy += len;
-		return ((int32_t *) xdrs->x_private);
-	}
+	/* whatever is written there is thrown away */
+	xdrs->x_handy += len;
+	return ((int32_t *) xdrs->x_private);
 }
 
 static int
@@ -121,45 +137,56 @@ x_destroy(xdrs)
 	XDR *xdrs;
 {
 	xdrs->x_handy = 0;
-	xdrs->x_base = 0;
-	if (xdrs->x_private) {
-		free(xdrs->x_private);
-		xdrs->x_private = NULL;
-	}
 	return;
 }
 
+/* to stop ANSI-C compiler from complaining */
+typedef  bool_t (* dummyfunc1)(XDR *, long *);
+typedef  bool_t (* dummyfunc2)(XDR *, char *, u_int);
+typedef  bool_t (* dummyfunc3)(XDR *, int64_t *);
+
+static const struct xdr_ops xdrsizeof_ops = {
+	(dummyfunc1) harmless,
+	x_putlong,
+	(dummyfunc2) harmless,
+	x_putbytes,
+	x_getpostn,
+	x_setpostn,
+	x_inline,
+	x_destroy,
+	xdr_extops_control,
+	(dummyfunc3) harmless,
+	x_putint64,
+	(dummyfunc2) harmless,
+	x_putopaque
+};
+
+/*
+ * True for the stream xdr_sizeof() runs routines on.  Routines whose
+ * encoding has side effects (generators, file reads) only count.
+ */
+bool_t
+__xdr_sizing(xdrs)
+	XDR *xdrs;
+{
+	return (xdrs->x_ops == &xdrsizeof_ops);
+}
+
 unsigned long
 xdr_sizeof(func, data)
 	xdrproc_t func;
 	void *data;
 {
 	XDR x;
-	struct xdr_ops ops;
+	int32_t scratch[SIZEOF_SCRATCH / sizeof (int32_t)];
 	bool_t stat;
-	/* to stop ANSI-C compiler from complaining */
-	typedef  bool_t (* dummyfunc1)(XDR *, long *);
-	typedef  bool_t (* dummyfunc2)(XDR *, caddr_t, u_int);
-
-	ops.x_putlong = x_putlong;
-	ops.x_putbytes = x_putbytes;
-	ops.x_inline = x_inline;
-	ops.x_getpostn = x_getpostn;
-	ops.x_setpostn = x_setpostn;
-	ops.x_destroy = x_destroy;
-
-	/* the other harmless ones */
-	ops.x_getlong =  (dummyfunc1) harmless;
-	ops.x_getbytes = (dummyfunc2) harmless;
 
 	x.x_op = XDR_ENCODE;
-	x.x_ops = &ops;
+	x.x_ops = &xdrsizeof_ops;
 	x.x_handy = 0;
-	x.x_private = (caddr_t) NULL;
+	x.x_private = (caddr_t) scratch;
 	x.x_base = (caddr_t) 0;
 
 	stat = func(&x, data);
-	if (x.x_private)
-		free(x.x_private);
 	return (stat == TRUE ? (unsigned) x.x_handy: 0);
 }
@@ -0,0 +1,174 @@
+/*
+ * Copyright (c) 2009, Sun Microsystems, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * - Neither the name of Sun Microsystems, Inc. nor the names of its
+ *   contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/*
+ * xdr_view.c, skimming and lazy decoding of XDR messages.
+ *
+ * xdr_skip() passes over one object by decoding it into a scratch
+ * arena with the stream being skimmed: strings, variable-length opaques
+ * and arrays of primitives are stepped over in place, without being
+ * copied or converted.  A view over an XDR message in memory uses it to
+ * find where each member starts, as far as the members asked for, and
+ * decodes only those members.
+ */
+
+#include <pthread.h>
+#include <reentrant.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <rpc/rpc.h>
+#include "rpc_com.h"
+
+struct xdr_view {
+	char	*xv_base;		/* the message */
+	u_int	xv_len;
+	XDR	xv_xdrs;		/* at the end of the skimmed members */
+	u_int	xv_nmembers;
+	u_int	xv_skimmed;		/* members whose extent is known */
+	struct xdr_view_member *xv_members;
+	u_int	*xv_offsets;		/* start of each member, and the end */
+};
+
+/*
+ * Passes over an object that proc decodes; size is the size of the
+ * decoded object.
+ */
+bool_t
+xdr_skip(xdrs, proc, size)
+	XDR *xdrs;
+	xdrproc_t proc;
+	u_int size;
+{
+	struct xdr_arena_binding *ab, saved;
+	void *obj;
+	bool_t stat;
+
+	if (xdrs->x_op != XDR_DECODE)
+		return (FALSE);
+	if ((ab = __xdr_arena_binding(TRUE)) == NULL)
+		return (FALSE);
+	if (ab->ab_scratch == NULL &&
+	    (ab->ab_scratch = xdr_arena_create(0)) == NULL)
+		return (FALSE);
+
+	saved = *ab;
+	ab->ab_xdrs = xdrs;
+	ab->ab_arena = ab->ab_scratch;
+	ab->ab_borrow = NULL;
+	ab->ab_skim = xdrs;
+	if ((obj = __xdr_alloc(xdrs, size)) != NULL)
+		stat = (*proc)(xdrs, obj);
+	else
+		stat = FALSE;
+	/* xdr routines may skip on their own */
+	if (saved.ab_arena != ab->ab_scratch)
+		xdr_arena_reset(ab->ab_scratch);
+	*ab = saved;
+	return (stat);
+}
+
+/*
+ * Creates a view of the message of len bytes at buf, made of nmembers
+ * members in sequence.  Nothing is decoded until xdr_view_get().  buf
+ * and the view must stay in place together.
+ */
+xdr_view_t *
+xdr_view_create(buf, len, members, nmembers)
+	char *buf;
+	u_int len;
+	const struct xdr_view_member *members;
+	u_int nmembers;
+{
+	xdr_view_t *xv;
+
+	xv = mem_alloc(sizeof (*xv) + nmembers * sizeof (*members) +
+	    (nmembers + 1) * sizeof (u_int));
+	if (xv == NULL)
+		return (NULL);
+	xv->xv_base = buf;
+	xv->xv_len = len;
+	xdrmem_create(&xv->xv_xdrs, buf, len, XDR_DECODE);
+	xv->xv_nmembers = nmembers;
+	xv->xv_skimmed = 0;
+	xv->xv_members = (struct xdr_view_member *)(xv + 1);
+	memcpy(xv->xv_members, members, nmembers * sizeof (*members));
+	xv->xv_offsets = (u_int *)(xv->xv_members + nmembers);
+	xv->xv_offsets[0] = 0;
+	return (xv);
+}
+
+/*
+ * Decodes member i of the view into objp, skimming the members before
+ * it the first time one of them is reached.  objp is released with
+ * xdr_free() like any decoded object.
+ */
+bool_t
+xdr_view_get(xv, i, objp)
+	xdr_view_t *xv;
+	u_int i;
+	void *objp;
+{
+	struct xdr_view_member *m;
+	XDR xdrs;
+
+	if (xv == NULL || i >= xv->xv_nmembers)
+		return (FALSE);
+	while (xv->xv_skimmed < i) {
+		m = &xv->xv_members[xv->xv_skimmed];
+		if (!xdr_skip(&xv->xv_xdrs, m->xm_proc, m->xm_size)) {
+			/* back to the start of the member for the next try */
+			XDR_SETPOS(&xv->xv_xdrs, xv->xv_offsets[xv->xv_skimmed]);
+			return (FALSE);
+		}
+		xv->xv_offsets[++xv->xv_skimmed] = XDR_GETPOS(&xv->xv_xdrs);
+	}
+
+	m = &xv->xv_members[i];
+	xdrmem_create(&xdrs, xv->xv_base, xv->xv_len, XDR_DECODE);
+	if (!XDR_SETPOS(&xdrs, xv->xv_offsets[i]) ||
+	    !(*m->xm_proc)(&xdrs, objp))
+		return (FALSE);
+	if (i == xv->xv_skimmed) {
+		xv->xv_offsets[++xv->xv_skimmed] = XDR_GETPOS(&xdrs);
+		XDR_SETPOS(&xv->xv_xdrs, xv->xv_offsets[xv->xv_skimmed]);
+	}
+	return (TRUE);
+}
+
+void
+xdr_view_destroy(xv)
+	xdr_view_t *xv;
+{
+	if (xv == NULL)
+		return;
+	mem_free(xv, sizeof (*xv) + xv->xv_nmembers *
+	    sizeof (struct xdr_view_member) +
+	    (xv->xv_nmembers + 1) * sizeof (u_int));
+}
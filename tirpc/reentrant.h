@@ -55,6 +55,7 @@
 #define mutex_init(m, a)	pthread_mutex_init(m, a)
 #define mutex_lock(m)		pthread_mutex_lock(m)
 #define mutex_unlock(m)		pthread_mutex_unlock(m)
+#define mutex_destroy(m)	pthread_mutex_destroy(m)
 
 #define cond_init(c, a, p)	pthread_cond_init(c, a)
 #define cond_destroy(c)		pthread_cond_destroy(c)
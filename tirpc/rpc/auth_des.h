@@ -110,6 +110,18 @@ struct authdes_verf {
 #define adv_xtimeverf	adv_time_u.adv_xtime
 #define adv_nickname	adv_int_u
 
+/*
+ * AUTH_DES server conversation key cache counters, as returned by
+ * rpc_control(RPC_SVC_DESSTATS_GET)
+ */
+struct svcauthdes_stats {
+	u_long ncachehits;	/* times cache hit, and is not replay */
+	u_long ncachereplays;	/* times cache hit, and is replay */
+	u_long ncachemisses;	/* times cache missed */
+	u_long nkeyhits;	/* conversation keys known without keyserv */
+	u_long nkeymisses;	/* conversation keys asked of keyserv */
+};
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -222,6 +222,9 @@ struct rpc_timers {
 #define CLSET_SVC_ADDR		16	/* get server's address (netbuf) */
 #define CLSET_PUSH_TIMOD	17	/* push timod if not already present */
 #define CLSET_POP_TIMOD		18	/* pop timod */
+#define CLSET_ARENA		21	/* decode results into an arena
+					 * (xdr_arena_t *, NULL = none) */
+#define CLGET_ARENA		22	/* get results arena */
 /*
  * Connectionless only control operations
  */
@@ -229,6 +232,15 @@ struct rpc_timers {
 #define CLGET_RETRY_TIMEOUT 5   /* get retry timeout (timeval) */
 #define CLSET_ASYNC		19
 #define CLSET_CONNECT		20	/* Use connect() for UDP. (int) */
+#define CLSET_BORROW		23	/* results arena borrows strings and
+					 * opaques from the reply (int) */
+#define CLGET_BORROW		24
+/*
+ * Connection oriented only control operations
+ */
+#define CLSET_ZEROCOPY		25	/* send large calls with
+					 * MSG_ZEROCOPY (int) */
+#define CLGET_ZEROCOPY		26
 
 /*
  * void
@@ -49,6 +49,8 @@
  *	success = rpcb_gettime(host, timep)
  *	uaddr = rpcb_taddr2uaddr(nconf, taddr);
  *	taddr = rpcb_uaddr2uaddr(nconf, uaddr);
+ *	success = rpcb_batch_begin();
+ *	failed = rpcb_batch_end();
  */
 
 #ifndef _RPC_RPCB_CLNT_H
@@ -80,6 +82,8 @@ extern bool_t rpcb_getaddr(const rpcprog_t, const rpcvers_t,
 extern bool_t rpcb_gettime(const char *, time_t *);
 extern char *rpcb_taddr2uaddr(struct netconfig *, struct netbuf *);
 extern struct netbuf *rpcb_uaddr2taddr(struct netconfig *, char *);
+extern bool_t rpcb_batch_begin(void);
+extern int rpcb_batch_end(void);
 #ifdef __cplusplus
 }
 #endif
@@ -70,6 +70,8 @@
 #define SVCSET_VERSQUIET	2
 #define SVCGET_CONNMAXREC	3
 #define SVCSET_CONNMAXREC	4
+#define SVCGET_ZEROCOPY		5	/* large replies use MSG_ZEROCOPY */
+#define SVCSET_ZEROCOPY		6	/* (int) */
 
 /*
  * Operations for rpc_control().
@@ -87,12 +89,47 @@
 #define RPC_SVC_IDLECLEANUP_SET 56   /* enable/disable cleanup of idle sockets (0 = disabled, 1 = enabled (default)) */
 #define RPC_SVC_IDLECLEANUP_GET 57
 
+#define RPC_SVC_ARENA_SET       58   /* decode arguments into per-transport arenas (RPC_SVC_ARENA_*) */
+#define RPC_SVC_ARENA_GET       59
+
+#define RPC_RPCB_CACHETTL_SET   60   /* lifetime (secs) of cached rpcbind lookups (0 = no caching) */
+#define RPC_RPCB_CACHETTL_GET   61
+#define RPC_RPCB_NEGCACHETTL_SET 62  /* lifetime (secs) of cached "program not registered" answers */
+#define RPC_RPCB_NEGCACHETTL_GET 63
+
+#define RPC_SVC_GSSWIN_SET      64   /* RPCSEC_GSS sequence window for new contexts (32 to 4096, default 128) */
+#define RPC_SVC_GSSWIN_GET      65
+#define RPC_SVC_GSSESTAB_SET    66   /* concurrent RPCSEC_GSS context establishments (default 4) */
+#define RPC_SVC_GSSESTAB_GET    67
+#define RPC_SVC_GSSQUEUE_SET    68   /* RPCSEC_GSS establishments allowed to wait for a turn (default 64) */
+#define RPC_SVC_GSSQUEUE_GET    69
+
+#define RPC_GROUPS_CACHETTL_SET 70   /* lifetime (secs) of cached uid2groups() answers (0 = no caching) */
+#define RPC_GROUPS_CACHETTL_GET 71
+#define RPC_GROUPS_NEGCACHETTL_SET 72 /* lifetime (secs) of cached "no such user" answers */
+#define RPC_GROUPS_NEGCACHETTL_GET 73
+
+#define RPC_SVC_DESCACHE_SET    74   /* AUTH_DES conversation key cache entries (16 to 65536, default 1024);
+                                      * must be set before the first AUTH_DES request */
+#define RPC_SVC_DESCACHE_GET    75
+#define RPC_SVC_DESSTATS_GET    76   /* AUTH_DES cache counters (struct svcauthdes_stats) */
+
 /*
  * Multithreading modes
  */
 #define RPC_SVC_MT_NONE         50   /* single-threaded (default) */
 #define RPC_SVC_MT_AUTO         51   /* automatic multi-threading */
 
+/*
+ * Argument arena modes
+ */
+#define RPC_SVC_ARENA_NONE      0    /* XDR_FREE in svc_freeargs() (default) */
+#define RPC_SVC_ARENA_ON        1    /* decode arguments into an arena */
+#define RPC_SVC_ARENA_BORROW    2    /* ... with strings and opaques left in the
+                                      * receive buffer of nonblocking stream
+                                      * transports (valid until the reply)
+                                      */
+
 enum xprt_stat {
 	XPRT_DIED,
 	XPRT_MOREREQS,
@@ -37,6 +37,9 @@ typedef struct __rpc_svcxprt_ext {
 	int 		flags;
 	SVCAUTH		xp_auth;
 	void            *prv;
+	xdr_arena_t	*xp_arena;	/* arguments arena (RPC_SVC_ARENA_SET) */
+	struct __rpc_authsys_cache *xp_authsys;	/* decoded AUTH_SYS creds */
+	uid_t		xp_peeruid;	/* AF_LOCAL peer, with SVC_PEERUID */
 } SVCXPRT_EXT;
 
 typedef enum {
@@ -67,6 +70,8 @@ typedef struct __rpc_svcxprt_ext_prv {
 	(SVCEXT(xprt)->xp_auth)
 
 #define SVC_VERSQUIET 0x0001	/* keep quiet about version mismatch */
+#define SVC_CONNECTED 0x0002	/* connection: one client for its lifetime */
+#define SVC_PEERUID   0x0004	/* xp_peeruid holds the peer's uid */
 
 #define svc_flags(xprt)					\
 	(SVCEXT(xprt)->flags)
@@ -119,6 +119,20 @@ typedef struct __rpc_xdr {
 		/* free privates of this xdr_stream */
 		void	(*x_destroy)(struct __rpc_xdr *);
 		bool_t	(*x_control)(struct __rpc_xdr *, int, void *);
+		/*
+		 * The ops below are only looked at if x_control is
+		 * xdr_extops_control (see XDR_HAS_EXTOPS), in which case
+		 * all of them must be set.  Tables compiled against older
+		 * versions of this header end at x_control.
+		 */
+		/* get a 64-bit int from underlying stream */
+		bool_t	(*x_getint64)(struct __rpc_xdr *, int64_t *);
+		/* put a 64-bit int to " */
+		bool_t	(*x_putint64)(struct __rpc_xdr *, const int64_t *);
+		/* get bytes and skip their padding to a unit from " */
+		bool_t	(*x_getopaque)(struct __rpc_xdr *, char *, u_int);
+		/* put bytes and pad them to a unit to " */
+		bool_t	(*x_putopaque)(struct __rpc_xdr *, const char *, u_int);
 	} *x_ops;
 	char *	 	x_public;	/* users' data */
 	void *		x_private;	/* pointer to private data */
@@ -143,6 +157,24 @@ typedef	bool_t (*xdrproc_t)(XDR *, void *, u_int);
 typedef	bool_t (*xdrproc_t)(XDR *, ...);
 #endif
 
+/*
+ * An xdrsink_t receives the successive pieces of an opaque decoded by
+ * xdr_bytes_stream(): (arg, bytes, count).
+ */
+typedef	bool_t (*xdrsink_t)(void *, const char *, u_int);
+
+/*
+ * A generated sequence for xdr_generated_array() and
+ * xdr_generated_list(): xg_next(xg_arg, &obj) produces the items one at
+ * a time and xg_proc encodes each of them.
+ */
+struct xdr_generator {
+	bool_t		(*xg_next)(void *, void **);
+	void		*xg_arg;
+	xdrproc_t	xg_proc;
+	u_int		xg_count;	/* items in an array */
+};
+
 /*
  * Operations defined on a XDR handle
  *
@@ -222,6 +254,27 @@ xdr_putint32(XDR *xdrs, int32_t *ip)
 		(*(xdrs)->x_ops->x_control)(xdrs, req, op)
 #define xdr_control(xdrs, req, op) XDR_CONTROL(xdrs, req, op)
 
+/*
+ * Extended operations, only valid if XDR_HAS_EXTOPS(xdrs)
+ *
+ * XDR		*xdrs;
+ * int64_t	*int64p;
+ * char *	 addr;
+ * u_int	 len;
+ */
+#define XDR_HAS_EXTOPS(xdrs)				\
+	((xdrs)->x_ops->x_control == xdr_extops_control)
+
+#define XDR_GETINT64(xdrs, int64p)			\
+	(*(xdrs)->x_ops->x_getint64)(xdrs, int64p)
+#define XDR_PUTINT64(xdrs, int64p)			\
+	(*(xdrs)->x_ops->x_putint64)(xdrs, int64p)
+
+#define XDR_GETOPAQUE(xdrs, addr, len)			\
+	(*(xdrs)->x_ops->x_getopaque)(xdrs, addr, len)
+#define XDR_PUTOPAQUE(xdrs, addr, len)			\
+	(*(xdrs)->x_ops->x_putopaque)(xdrs, addr, len)
+
 #define xdr_rpcvers(xdrs, versp) xdr_u_int32_t(xdrs, versp)
 #define xdr_rpcprog(xdrs, progp) xdr_u_int32_t(xdrs, progp)
 #define xdr_rpcproc(xdrs, procp) xdr_u_int32_t(xdrs, procp)
@@ -310,14 +363,53 @@ extern bool_t	xdr_bool(XDR *, bool_t *);
 extern bool_t	xdr_enum(XDR *, enum_t *);
 extern bool_t	xdr_array(XDR *, char **, u_int *, u_int, u_int, xdrproc_t);
 extern bool_t	xdr_bytes(XDR *, char **, u_int *, u_int);
+extern bool_t	xdr_bytes_stream(XDR *, u_int *, u_int, xdrsink_t, void *);
+extern bool_t	xdr_bytes_tofd(XDR *, u_int *, u_int, int);
+extern bool_t	xdr_bytes_file(XDR *, int, int64_t, u_int);
 extern bool_t	xdr_opaque(XDR *, char *, u_int);
 extern bool_t	xdr_string(XDR *, char **, u_int);
 extern bool_t	xdr_union(XDR *, enum_t *, char *, const struct xdr_discrim *, xdrproc_t);
 extern bool_t	xdr_char(XDR *, char *);
 extern bool_t	xdr_u_char(XDR *, u_char *);
 extern bool_t	xdr_vector(XDR *, char *, u_int, u_int, xdrproc_t);
+extern bool_t	xdr_generated_array(XDR *, struct xdr_generator *);
+extern bool_t	xdr_generated_list(XDR *, struct xdr_generator *);
 extern bool_t	xdr_float(XDR *, float *);
 extern bool_t	xdr_double(XDR *, double *);
+extern bool_t	xdr_extops_control(XDR *, int, void *);
+
+/*
+ * Decode arenas: while an arena is bound to a stream (by the calling
+ * thread), objects decoded from the stream are allocated from the arena
+ * and released all at once by xdr_arena_reset() instead of XDR_FREE.
+ * Binding to a NULL stream covers every stream the thread decodes.
+ * Strings and variable-length opaques decoded from a stream lent with
+ * xdr_arena_borrow() point into the stream's buffer.
+ */
+typedef struct xdr_arena xdr_arena_t;
+extern xdr_arena_t *xdr_arena_create(u_int);
+extern void	xdr_arena_reset(xdr_arena_t *);
+extern void	xdr_arena_destroy(xdr_arena_t *);
+extern void	xdr_arena_bind(XDR *, xdr_arena_t *);
+extern void	xdr_arena_borrow(XDR *);
+
+/*
+ * Skimming and lazy decoding: xdr_skip() passes over an object without
+ * copying its strings, opaques or primitive arrays.  A view over a
+ * message in memory finds its members that way and decodes only the
+ * ones asked for.
+ */
+struct xdr_view_member {
+	xdrproc_t	xm_proc;	/* decodes the member */
+	u_int		xm_size;	/* size of the decoded member */
+};
+typedef struct xdr_view xdr_view_t;
+extern bool_t	xdr_skip(XDR *, xdrproc_t, u_int);
+extern xdr_view_t *xdr_view_create(char *, u_int,
+		    const struct xdr_view_member *, u_int);
+extern bool_t	xdr_view_get(xdr_view_t *, u_int, void *);
+extern void	xdr_view_destroy(xdr_view_t *);
+
 extern bool_t	xdr_quadruple(XDR *, long double *);
 extern bool_t	xdr_reference(XDR *, char **, u_int, xdrproc_t);
 extern bool_t	xdr_pointer(XDR *, char **, u_int, xdrproc_t);